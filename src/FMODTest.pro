@@ -12,19 +12,18 @@ TEMPLATE = app
 #-------------------------------------------------
 #-------------------------------------------------
 
-LIBS += -L/share/users/ssell/Desktop/fmodapi44203linux64/api/lib \
-        -lfmodex64
-
-INCLUDEPATH += /share/users/ssell/Desktop/fmodapi44203linux64/api/inc
+include( fmod_common.pri )
 
 #-------------------------------------------------
 #-------------------------------------------------
 
 SOURCES += main.cpp\
         mainwindow.cpp \
-    fmod_resources.cpp
+        spectrogram_widget.cpp \
+        waveform_widget.cpp
 
 HEADERS  += mainwindow.h \
-    fmod_resources.h
+        spectrogram_widget.h \
+        waveform_widget.h
 
 FORMS    += mainwindow.ui
@@ -0,0 +1,211 @@
+#include "analysis_worker.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+//------------------------------------------------------------------------------------------
+
+AnalysisWorker::AnalysisWorker( unsigned period_ms )
+    : stft( ANALYSIS_WINDOW, ANALYSIS_HOP, WINDOW_HANN ),
+      results( ANALYSIS_RING_FRAMES ),
+      spectra( ANALYSIS_SPECTRA, ANALYSIS_WINDOW / 2 + 1 ),
+      notes( ANALYSIS_NOTES )
+{
+    system       = 0;
+    channel      = 0;
+    period       = period_ms;
+    rate         = OUTPUTRATE;
+    binSize      = 0;
+    estimator    = 0;
+    segmenter    = 0;
+    fill         = 0;
+    consumed     = 0;
+    basePosition = 0;
+    running      = false;
+    requested    = PITCH_SPECTRUM_PEAK;
+    overflow     = 0;
+
+    window.resize( ANALYSIS_WINDOW );
+    spectrum.resize( stft.bins( ) );
+}
+
+AnalysisWorker::~AnalysisWorker( )
+{
+    stop( );
+    delete estimator;
+    delete segmenter;
+}
+
+//------------------------------------------------------------------------------------------
+
+STATUS AnalysisWorker::start( FMOD::System* system_, FMOD::Channel* channel_, PITCH_METHOD method )
+{
+    stop( );
+
+    PitchFrame stale;
+
+    while( results.pop( &stale ) )
+        ;
+
+    while( spectra.front( ) != 0 )
+        spectra.release( );
+
+    NoteEvent note;
+
+    while( notes.pop( &note ) )
+        ;
+
+    system       = system_;
+    channel      = channel_;
+    requested    = method;
+    overflow     = 0;
+    fill         = 0;
+    consumed     = 0;
+    basePosition = 0;
+
+    gate.reset( );
+
+    // Nothing is mixing into the ring yet, so clearing it cannot race the mixer.
+    tap.clear( );
+
+    if( channel != 0 )
+        channel->getPosition( &basePosition, FMOD_TIMEUNIT_MS );
+
+    STATUS status = tap.attach( system, channel );
+
+    if( channel != 0 )
+        channel->setPaused( false );
+
+    if( status != OK )
+        return status;
+
+    rate    = tap.sampleRate( );
+    binSize = ( float )rate / ANALYSIS_WINDOW;
+
+    delete segmenter;
+    segmenter = new NoteSegmenter( stft.bins( ), binSize, [ this ]( const NoteEvent& note )
+    {
+        if( !notes.push( note ) )
+            overflow++;
+    }, NoteSegmenter::minConfidenceFor( method ) );
+
+    running = true;
+    thread  = std::thread( &AnalysisWorker::run, this );
+
+    return OK;
+}
+
+void AnalysisWorker::stop( )
+{
+    if( !thread.joinable( ) )
+        return;
+
+    running = false;
+    thread.join( );
+
+    tap.detach( );
+    channel = 0;
+}
+
+//------------------------------------------------------------------------------------------
+
+void AnalysisWorker::run( )
+{
+    typedef std::chrono::steady_clock Clock;
+
+    Clock::time_point begin = Clock::now( );
+    Clock::time_point next  = begin;
+
+    while( running )
+    {
+        system->update( );
+
+        // Every complete hop in the ring, oldest first.
+        for( ;; )
+        {
+            unsigned read = tap.read( &window[ fill ], ANALYSIS_WINDOW - fill );
+
+            fill     += read;
+            consumed += read;
+
+            if( fill < ANALYSIS_WINDOW )
+                break;
+
+            analyse( std::chrono::duration< double >( Clock::now( ) - begin ).count( ) );
+
+            memmove( &window[ 0 ], &window[ ANALYSIS_HOP ], ( ANALYSIS_WINDOW - ANALYSIS_HOP ) * sizeof( float ) );
+            fill = ANALYSIS_WINDOW - ANALYSIS_HOP;
+        }
+
+        // Fixed cadence rather than fixed sleep, so analysis time does not drift the rate.
+        next += std::chrono::milliseconds( period );
+
+        if( next < Clock::now( ) )
+            next = Clock::now( );
+
+        std::this_thread::sleep_until( next );
+    }
+
+    segmenter->finish( basePosition / 1000.0 + ( double )consumed / rate );
+}
+
+/**
+ * One full window: energy gate, spectrum, pitch by the requested method, then the
+ * three rings. A gated frame goes out unvoiced with an empty spectrum.
+ */
+void AnalysisWorker::analyse( double time )
+{
+    PITCH_METHOD method = ( PITCH_METHOD )requested.load( );
+    PitchFrame   frame;
+
+    TRACE_SCOPE( TRACE_LEVEL_INFO, "AnalysisWorker::analyse" );
+
+    // Silence costs one pass over the newest samples, not an FFT.
+    if( !gate.process( &window[ ANALYSIS_WINDOW - GATE_WINDOW ], GATE_WINDOW ) )
+    {
+        std::fill( spectrum.begin( ), spectrum.end( ), 0.0f );
+        fmodUnvoicedPitch( &frame.pitch );
+    }
+    else if( method == PITCH_SPECTRUM_PEAK )
+    {
+        stft.analyse( &window[ 0 ], &spectrum[ 0 ] );
+        fmodDetectPitchFromSpectrum( &spectrum[ 0 ], stft.bins( ), binSize, &frame.pitch );
+    }
+    else
+    {
+        if( estimator == 0 || estimator->method( ) != method )
+        {
+            delete estimator;
+            estimator = new PitchEstimator( method, ANALYSIS_TIME_WINDOW, ( float )rate );
+        }
+
+        // The spectrogram and the onset detector still want the spectrum.
+        stft.analyse( &window[ 0 ], &spectrum[ 0 ] );
+        fmodDetectPitchFromPCM( estimator, &window[ ANALYSIS_WINDOW - estimator->windowSize( ) ], &frame.pitch );
+    }
+
+    double seconds = basePosition / 1000.0 + ( double )consumed / rate;
+
+    frame.time     = time;
+    frame.position = ( unsigned )( seconds * 1000.0 );
+
+    if( !results.push( frame ) )
+        overflow++;
+
+    float* slot = spectra.claim( );
+
+    if( slot != 0 )
+    {
+        memcpy( slot, &spectrum[ 0 ], spectrum.size( ) * sizeof( float ) );
+        spectra.publish( );
+    }
+    else
+    {
+        overflow++;
+    }
+
+    segmenter->setMinConfidence( NoteSegmenter::minConfidenceFor( method ) );
+    segmenter->process( seconds, &spectrum[ 0 ], frame.pitch );
+}
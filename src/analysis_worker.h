@@ -0,0 +1,131 @@
+#ifndef ANALYSIS_WORKER_H
+#define ANALYSIS_WORKER_H
+
+#include "fmod_resources.h"
+#include "note_segmenter.h"
+#include "dsp_tap.h"
+#include "stft.h"
+#include "spsc_ring.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+//------------------------------------------------------------------------------------------
+
+#define ANALYSIS_PERIOD_MS     5        /* how often the tap is drained and System::update runs */
+#define ANALYSIS_WINDOW        8192     /* Stft frame; also the spectrum shown and segmented */
+#define ANALYSIS_HOP           512      /* samples between frames */
+#define ANALYSIS_TIME_WINDOW   2048     /* YIN / McLeod window, the newest end of the frame */
+#define ANALYSIS_RING_FRAMES   256
+#define ANALYSIS_SPECTRA       32       /* spectrum frames kept for display */
+#define ANALYSIS_NOTES         64       /* finished notes waiting for the GUI */
+
+struct PitchFrame
+{
+    double   time;          /* seconds since AnalysisWorker::start */
+    unsigned position;      /* channel position in ms of the newest sample in the frame */
+    Pitch    pitch;
+};
+
+/**
+ * Runs pitch detection on its own thread, fed by a DspTap on the channel.
+ *
+ * The tap hands over every mixed sample through a lock-free ring; the worker drains it
+ * every ANALYSIS_PERIOD_MS into a sliding ANALYSIS_WINDOW frame and analyses each
+ * ANALYSIS_HOP as it completes. So no block is skipped between polls, and a result
+ * lags its newest sample by the drain period at most, not by the GUI timer.
+ *
+ * Each result is pushed as a timestamped PitchFrame into a lock-free SPSC ring; the GUI
+ * thread only ever pops from it. The magnitude spectrum of every frame goes into a
+ * second ring of fixed frames, for the spectrogram, whichever pitch method is active.
+ * Frames an EnergyGate finds silent skip the FFT and the estimate and go out unvoiced
+ * with an empty spectrum. A NoteSegmenter runs over the same frames, and each note it
+ * completes goes out on a third ring, timed by channel position. The worker also owns
+ * the System::update calls for the channel it analyses while it runs.
+ */
+class AnalysisWorker
+{
+public:
+
+    explicit AnalysisWorker( unsigned period_ms = ANALYSIS_PERIOD_MS );
+    ~AnalysisWorker( );
+
+    /**
+     * Attaches the tap to 'channel' and starts the worker. A channel started paused is
+     * unpaused only once the tap is on it (or the tap failed), so its first block is
+     * analysed and positions count from where the tap began.
+     */
+    STATUS start( FMOD::System* system, FMOD::Channel* channel, PITCH_METHOD method );
+    void   stop( );
+
+    /**
+     * May be called from any thread while running; picked up on the next frame.
+     */
+    void setMethod( PITCH_METHOD method ) { requested = method; }
+
+    bool isRunning( ) const { return running; }
+
+    /**
+     * Consumer side of the result ring. False when empty.
+     */
+    bool pop( PitchFrame* frame ) { return results.pop( frame ); }
+
+    unsigned dropped( ) const { return overflow; }
+
+    /**
+     * Consumer side of the spectrum ring: the oldest unread frame of spectrumBins()
+     * magnitudes, valid until releaseSpectrum, or null when empty.
+     */
+    const float* frontSpectrum( ) const { return spectra.front( ); }
+    void         releaseSpectrum( )     { spectra.release( ); }
+
+    /**
+     * Consumer side of the note ring. False when empty. The last note of a run is
+     * pushed when the worker stops.
+     */
+    bool popNote( NoteEvent* note ) { return notes.pop( note ); }
+
+    unsigned spectrumBins( ) const    { return stft.bins( ); }
+
+    /**
+     * Hz per spectrum bin for the system passed to start.
+     */
+    float spectrumBinSize( ) const { return binSize; }
+
+private:
+
+    void run( );
+    void analyse( double time );
+
+    FMOD::System*  system;
+    FMOD::Channel* channel;
+    unsigned       period;
+
+    DspTap     tap;
+    Stft       stft;
+    EnergyGate gate;
+    int    rate;
+    float  binSize;
+
+    // Only touched by the worker thread while running.
+    PitchEstimator*      estimator;
+    NoteSegmenter*       segmenter;
+    std::vector< float > window;
+    std::vector< float > spectrum;
+    unsigned             fill;
+    unsigned long long   consumed;      /* samples read from the tap */
+    unsigned             basePosition;  /* channel position in ms when the tap went in */
+
+    SpscRing< PitchFrame >    results;
+    SpscBlockRing             spectra;
+    SpscRing< NoteEvent >     notes;
+    std::thread               thread;
+    std::atomic< bool >       running;
+    std::atomic< int >        requested;
+    std::atomic< unsigned >   overflow;
+};
+
+//------------------------------------------------------------------------------------------
+
+#endif // ANALYSIS_WORKER_H
@@ -0,0 +1,231 @@
+#include "audio_engine.h"
+#include "capture_writer.h"
+
+//------------------------------------------------------------------------------------------
+
+SoundHandle& SoundHandle::operator=( SoundHandle&& other )
+{
+    if( this != &other )
+    {
+        reset( other.sound );
+        other.sound = 0;
+    }
+
+    return *this;
+}
+
+void SoundHandle::reset( FMOD::Sound* s )
+{
+    if( sound != 0 && sound != s )
+        fmodReleaseSound( sound );
+
+    sound = s;
+}
+
+//------------------------------------------------------------------------------------------
+
+ChannelHandle& ChannelHandle::operator=( ChannelHandle&& other )
+{
+    if( this != &other )
+    {
+        reset( other.channel );
+        other.channel = 0;
+    }
+
+    return *this;
+}
+
+void ChannelHandle::reset( FMOD::Channel* c )
+{
+    // Fails harmlessly with FMOD_ERR_INVALID_HANDLE if the channel already ended.
+    if( channel != 0 && channel != c )
+        channel->stop( );
+
+    channel = c;
+}
+
+//------------------------------------------------------------------------------------------
+
+AudioEngine::AudioEngine( OUTPUT_TYPE output, FMOD_INITFLAGS flags )
+{
+    this->fmodSystem  = 0;
+    this->output      = output;
+    this->flags       = flags;
+    this->driver      = -1;
+    this->initialised = false;
+}
+
+AudioEngine::~AudioEngine( )
+{
+    if( fmodSystem != 0 )
+        fmodSystem->release( );
+}
+
+//------------------------------------------------------------------------------------------
+
+STATUS AudioEngine::open( )
+{
+    if( initialised )
+        return OK;
+
+    STATUS status;
+
+    if( fmodSystem == 0 )
+    {
+        status = fmodSetup( &fmodSystem );
+
+        if( status != OK )
+        {
+            fmodSystem = 0;
+            return status;
+        }
+    }
+
+    status = fmodSetOutputType( fmodSystem, output );
+
+    if( status != OK )
+        return status;
+
+    if( driver >= 0 )
+    {
+        status = fmodSetPlaybackDriver( fmodSystem, driver );
+
+        if( status != OK )
+            return status;
+    }
+
+    status = fmodSystemInit( fmodSystem, flags );
+
+    if( status != OK )
+        return status;
+
+    initialised = true;
+
+    return OK;
+}
+
+FMOD::System* AudioEngine::system( )
+{
+    return ( open( ) == OK ? fmodSystem : 0 );
+}
+
+//------------------------------------------------------------------------------------------
+
+STATUS AudioEngine::setOutputType( OUTPUT_TYPE output )
+{
+    if( output == this->output )
+        return OK;
+
+    this->output = output;
+
+    if( !initialised )
+        return OK;
+
+    // setOutput is only accepted on a closed system; the object itself is kept.
+    FMOD_RESULT result = fmodSystem->close( );
+
+    if( result != FMOD_OK )
+    {
+        DEBUG_OUT( FMOD_ErrorString( result ) );
+        return OUTPUT_TYPE_SET_FAILED;
+    }
+
+    initialised = false;
+
+    return open( );
+}
+
+STATUS AudioEngine::setPlaybackDriver( unsigned driver )
+{
+    if( ( int )driver == this->driver )
+        return OK;
+
+    this->driver = driver;
+
+    if( !initialised )
+        return OK;
+
+    // FMOD Ex restarts the output on the new driver when called after init.
+    return fmodSetPlaybackDriver( fmodSystem, driver );
+}
+
+//------------------------------------------------------------------------------------------
+
+STATUS AudioEngine::createSound( unsigned max_length, SoundHandle* sound, const CaptureFormat* format )
+{
+    if( sound == 0 )
+    {
+        DEBUG_OUT( "sound == NULL" );
+        return PARAM_NULL_PASSED;
+    }
+
+    STATUS status = open( );
+
+    if( status != OK )
+        return status;
+
+    return fmodCreateSound( fmodSystem, sound->out( ), max_length, format );
+}
+
+STATUS AudioEngine::createSoundFromFile( const char* file, SoundHandle* sound )
+{
+    if( sound == 0 )
+    {
+        DEBUG_OUT( "sound == NULL" );
+        return PARAM_NULL_PASSED;
+    }
+
+    STATUS status = open( );
+
+    if( status != OK )
+        return status;
+
+    return fmodCreateSoundFromFile( fmodSystem, sound->out( ), file );
+}
+
+STATUS AudioEngine::createCaptureSound( SoundHandle* sound, const CaptureFormat* format )
+{
+    if( sound == 0 )
+    {
+        DEBUG_OUT( "sound == NULL" );
+        return PARAM_NULL_PASSED;
+    }
+
+    STATUS status = open( );
+
+    if( status != OK )
+        return status;
+
+    return fmodCreateCaptureSound( fmodSystem, sound->out( ), format );
+}
+
+//------------------------------------------------------------------------------------------
+
+STATUS AudioEngine::play( const SoundHandle& sound, ChannelHandle* channel, bool paused )
+{
+    if( !sound || channel == 0 )
+    {
+        DEBUG_OUT( "sound == NULL || channel == NULL" );
+        return PARAM_NULL_PASSED;
+    }
+
+    STATUS status = open( );
+
+    if( status != OK )
+        return status;
+
+    channel->reset( );
+
+    FMOD::Channel* playing = 0;
+    FMOD_RESULT    result  = fmodSystem->playSound( FMOD_CHANNEL_FREE, sound.get( ), paused, &playing );
+
+    if( result != FMOD_OK )
+    {
+        DEBUG_OUT( FMOD_ErrorString( result ) );
+        return SOUND_PLAY_FAILED;
+    }
+
+    channel->reset( playing );
+
+    return OK;
+}
@@ -0,0 +1,125 @@
+#ifndef AUDIO_ENGINE_H
+#define AUDIO_ENGINE_H
+
+#include "fmod_resources.h"
+
+//------------------------------------------------------------------------------------------
+
+/**
+ * Owns an FMOD::Sound and releases it through fmodReleaseSound (which also drops any
+ * file mapping behind it). Move-only.
+ */
+class SoundHandle
+{
+public:
+
+    SoundHandle( )                         { sound = 0; }
+    explicit SoundHandle( FMOD::Sound* s ) { sound = s; }
+    SoundHandle( SoundHandle&& other )     { sound = other.sound; other.sound = 0; }
+    ~SoundHandle( )                        { reset( ); }
+
+    SoundHandle& operator=( SoundHandle&& other );
+
+    void reset( FMOD::Sound* s = 0 );
+
+    FMOD::Sound* get( ) const    { return sound; }
+    FMOD::Sound** out( )         { reset( ); return &sound; }
+    explicit operator bool( ) const { return sound != 0; }
+
+private:
+
+    SoundHandle( const SoundHandle& );
+    SoundHandle& operator=( const SoundHandle& );
+
+    FMOD::Sound* sound;
+};
+
+/**
+ * A playing channel; stops it when reset or destroyed. FMOD owns the channel itself,
+ * so this only guarantees nothing keeps playing a sound that is about to be released.
+ */
+class ChannelHandle
+{
+public:
+
+    ChannelHandle( )                       { channel = 0; }
+    ChannelHandle( ChannelHandle&& other ) { channel = other.channel; other.channel = 0; }
+    ~ChannelHandle( )                      { reset( ); }
+
+    ChannelHandle& operator=( ChannelHandle&& other );
+
+    void reset( FMOD::Channel* c = 0 );
+
+    FMOD::Channel* get( ) const  { return channel; }
+    explicit operator bool( ) const { return channel != 0; }
+
+private:
+
+    ChannelHandle( const ChannelHandle& );
+    ChannelHandle& operator=( const ChannelHandle& );
+
+    FMOD::Channel* channel;
+};
+
+//------------------------------------------------------------------------------------------
+
+/**
+ * The one FMOD::System for the process.
+ *
+ * The system is created and initialised on first use and kept until the engine is
+ * destroyed, so recording and playback no longer pay for System_Create/init (or leak
+ * the previous system) on every take. Output type and playback driver are changed in
+ * place: the driver with System::setDriver on the live system, the output type with
+ * System::close, setOutput and init, since FMOD Ex only accepts setOutput while closed.
+ *
+ * Closing the system invalidates every sound created from it, so all SoundHandles must
+ * be reset before changing the output type.
+ */
+class AudioEngine
+{
+public:
+
+    AudioEngine( OUTPUT_TYPE output = OSS, FMOD_INITFLAGS flags = FMOD_INIT_NORMAL );
+    ~AudioEngine( );
+
+    /**
+     * Creates and initialises the system if that has not happened yet.
+     */
+    STATUS open( );
+
+    /**
+     * The initialised system, or null if it could not be opened.
+     */
+    FMOD::System* system( );
+
+    STATUS setOutputType( OUTPUT_TYPE output );
+    STATUS setPlaybackDriver( unsigned driver );
+
+    STATUS createSound( unsigned max_length, SoundHandle* sound, const CaptureFormat* format = 0 );
+    STATUS createSoundFromFile( const char* file, SoundHandle* sound );
+    STATUS createCaptureSound( SoundHandle* sound, const CaptureFormat* format = 0 );
+
+    /**
+     * Starts 'sound' on a free channel, stopping whatever 'channel' was playing. With
+     * 'paused' nothing is mixed until the caller unpauses it, e.g. once a tap is on it.
+     */
+    STATUS play( const SoundHandle& sound, ChannelHandle* channel, bool paused = false );
+
+    OUTPUT_TYPE outputType( ) const { return output; }
+    bool        isOpen( ) const     { return initialised; }
+
+private:
+
+    AudioEngine( const AudioEngine& );
+    AudioEngine& operator=( const AudioEngine& );
+
+    FMOD::System*  fmodSystem;
+    OUTPUT_TYPE    output;
+    FMOD_INITFLAGS flags;
+    int            driver;      /* -1 until a playback driver is chosen */
+    bool           initialised;
+};
+
+//------------------------------------------------------------------------------------------
+
+#endif // AUDIO_ENGINE_H
@@ -0,0 +1,247 @@
+#include "capture_writer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+//------------------------------------------------------------------------------------------
+
+/**
+ * The ring the recording loops around while CaptureWriter drains it.
+ */
+STATUS fmodCreateCaptureSound( FMOD::System* system, FMOD::Sound** sound, const CaptureFormat* format )
+{
+    return fmodCreateSound( system, sound, CAPTURE_RING_SECONDS, format );
+}
+
+//------------------------------------------------------------------------------------------
+
+CaptureWriter::CaptureWriter( )
+{
+    system       = 0;
+    sound        = 0;
+    driver       = 0;
+    fp           = 0;
+    flac         = 0;
+    channels     = 0;
+    bits         = 0;
+    floatSamples = false;
+    rate         = 0;
+    ringFrames   = 0;
+    frameBytes   = 0;
+    lastPosition = 0;
+    limit        = 0;
+    running      = false;
+    written      = 0;
+}
+
+CaptureWriter::~CaptureWriter( )
+{
+    stop( );
+}
+
+//------------------------------------------------------------------------------------------
+
+STATUS CaptureWriter::start( FMOD::System* system_, int driver_, FMOD::Sound* sound_, const char* file_name,
+                             unsigned preroll_frames, unsigned long long max_frames )
+{
+    if( system_ == 0 || sound_ == 0 || file_name == 0 )
+    {
+        DEBUG_OUT( "system, sound or file_name == NULL" );
+        return PARAM_NULL_PASSED;
+    }
+
+    stop( );
+
+    system = system_;
+    sound  = sound_;
+    driver = driver_;
+
+    unsigned          ringBytes;
+    FMOD_SOUND_FORMAT format;
+
+    sound->getFormat( 0, &format, &channels, &bits );
+    sound->getDefaults( &rate, 0, 0, 0 );
+    sound->getLength( &ringBytes, FMOD_TIMEUNIT_PCMBYTES );
+
+    floatSamples = ( format == FMOD_SOUND_FORMAT_PCMFLOAT );
+    frameBytes   = channels * bits / 8;
+    ringFrames = ( frameBytes == 0 ? 0 : ringBytes / frameBytes );
+
+    if( ringFrames == 0 )
+    {
+        DEBUG_OUT( "Capture sound has no length" );
+        return PARAM_NULL_PASSED;
+    }
+
+    size_t nameLength = strlen( file_name );
+
+    if( nameLength > 5 && strcmp( file_name + nameLength - 5, ".flac" ) == 0 )
+    {
+        flac = new FlacEncoder( );
+
+        STATUS status = flac->open( file_name, ( int )rate, channels, format );
+
+        if( status != OK )
+        {
+            delete flac;
+            flac = 0;
+            return status;
+        }
+    }
+    else
+    {
+        fp = fopen( file_name, "wb" );
+
+        if( fp == 0 )
+        {
+            DEBUG_OUT( "Unable to open capture file" );
+            DEBUG_OUT( file_name );
+            return FILE_OPEN_FAILED;
+        }
+
+        WriteWavHeader( fp, channels, bits, rate, 0, floatSamples );
+    }
+
+    // Pre-roll is simply a drain that starts behind the recorder.
+    unsigned margin   = ( unsigned )( rate * CAPTURE_PREROLL_MARGIN );
+    unsigned position = 0;
+
+    preroll_frames = std::min( preroll_frames, ringFrames > margin ? ringFrames - margin : 0u );
+
+    if( system->getRecordPosition( driver, &position ) != FMOD_OK || position >= ringFrames )
+        position = 0;
+
+    lastPosition = ( position + ringFrames - preroll_frames ) % ringFrames;
+    limit        = max_frames * frameBytes;
+    written      = 0;
+    running      = true;
+    thread       = std::thread( &CaptureWriter::run, this );
+
+    return OK;
+}
+
+void CaptureWriter::stop( )
+{
+    if( !thread.joinable( ) )
+        return;
+
+    running = false;
+    thread.join( );
+
+    if( flac != 0 )
+    {
+        flac->close( );
+        delete flac;
+    }
+    else
+    {
+        fixHeader( );
+        fclose( fp );
+    }
+
+    fp     = 0;
+    flac   = 0;
+    sound  = 0;
+    system = 0;
+}
+
+//------------------------------------------------------------------------------------------
+
+void CaptureWriter::run( )
+{
+    std::chrono::steady_clock::time_point lastFixup = std::chrono::steady_clock::now( );
+
+    while( running )
+    {
+        std::this_thread::sleep_for( std::chrono::milliseconds( CAPTURE_DRAIN_MS ) );
+
+        drain( );
+
+        if( limit != 0 && written >= limit )
+        {
+            running = false;
+            return;
+        }
+
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now( );
+
+        if( now - lastFixup >= std::chrono::milliseconds( CAPTURE_HEADER_FIXUP_MS ) )
+        {
+            fixHeader( );
+            lastFixup = now;
+        }
+    }
+
+    // Whatever arrived between the last tick and stop( ).
+    drain( );
+}
+
+/**
+ * Copies everything recorded since the last call, up to the limit. Sound::lock hands
+ * back two pointers when the region wraps the end of the ring, so both halves are
+ * written in order.
+ */
+void CaptureWriter::drain( )
+{
+    unsigned position = 0;
+
+    if( system->getRecordPosition( driver, &position ) != FMOD_OK || position >= ringFrames )
+        return;
+
+    unsigned frames = ( position + ringFrames - lastPosition ) % ringFrames;
+
+    if( limit != 0 )
+        frames = ( unsigned )std::min< unsigned long long >( frames, ( limit - std::min( limit, written.load( ) ) ) / frameBytes );
+
+    if( frames == 0 )
+        return;
+
+    void     *ptr1, *ptr2;
+    unsigned  len1, len2;
+
+    if( sound->lock( lastPosition * frameBytes, frames * frameBytes, &ptr1, &ptr2, &len1, &len2 ) != FMOD_OK )
+        return;
+
+    size_t bytes = len1 + ( ptr2 != 0 ? len2 : 0 );
+
+    if( flac != 0 )
+    {
+        flac->write( ptr1, len1 / frameBytes );
+
+        if( ptr2 != 0 && len2 > 0 )
+            flac->write( ptr2, len2 / frameBytes );
+    }
+    else
+    {
+        bytes = fwrite( ptr1, 1, len1, fp );
+
+        if( ptr2 != 0 && len2 > 0 )
+            bytes += fwrite( ptr2, 1, len2, fp );
+    }
+
+    sound->unlock( ptr1, ptr2, len1, len2 );
+
+    // Hand it to the OS every tick; a crash then loses at most one drain period.
+    if( fp != 0 )
+        fflush( fp );
+
+    written     += bytes;
+    lastPosition = ( lastPosition + frames ) % ringFrames;
+}
+
+void CaptureWriter::fixHeader( )
+{
+    if( flac != 0 )
+    {
+        flac->sync( );
+        return;
+    }
+
+    off_t end = ftello( fp );
+
+    fseeko( fp, 0, SEEK_SET );
+    WriteWavHeader( fp, channels, bits, rate, written, floatSamples );
+    fseeko( fp, end, SEEK_SET );
+    fflush( fp );
+}
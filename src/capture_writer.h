@@ -0,0 +1,97 @@
+#ifndef CAPTURE_WRITER_H
+#define CAPTURE_WRITER_H
+
+#include "fmod_resources.h"
+#include "flac_encoder.h"
+
+#include <atomic>
+#include <thread>
+#include <cstdio>
+
+//------------------------------------------------------------------------------------------
+
+#define CAPTURE_RING_SECONDS     2       /* length of the looping record sound */
+#define CAPTURE_DRAIN_MS         20      /* how often the writer empties the ring */
+#define CAPTURE_HEADER_FIXUP_MS  250     /* how often the WAV sizes / FLAC STREAMINFO are rewritten */
+#define CAPTURE_PREROLL_MARGIN   1       /* seconds of an always-on ring that pre-roll may not reach into */
+
+/**
+ * Streams a recording to a WAV file while it is being made.
+ *
+ * Recording goes into a short looping sound (see fmodCreateCaptureSound) and a
+ * background thread follows System::getRecordPosition, copying each newly recorded
+ * region to disk through Sound::lock. The RIFF/data sizes are patched every few
+ * hundred milliseconds, so memory use is fixed by the ring length and a crash only
+ * costs the tail since the last fix-up.
+ *
+ * A file name ending in ".flac" is encoded losslessly through FlacEncoder instead,
+ * whose frames are compressed on its own pool of threads.
+ *
+ * The same writer saves from an always-on capture: the ring is recording anyway, so
+ * starting with a pre-roll just begins draining that many frames behind the record
+ * position, straight out of the ring, and a frame limit ends the file by itself once
+ * the part after the trigger is in. Recording never stops and nothing is copied aside.
+ */
+class CaptureWriter
+{
+public:
+
+    CaptureWriter( );
+    ~CaptureWriter( );
+
+    /**
+     * Starts draining 'sound', which must already be recording (looped) from 'driver'.
+     *
+     * 'preroll_frames' of what is already in the ring go first; the caller must not ask
+     * for more than has been recorded since recordStart. It is clamped so the recorder
+     * stays CAPTURE_PREROLL_MARGIN seconds clear of it. With 'max_frames' set the writer
+     * finishes by itself after that many frames in all, see isRunning.
+     */
+    STATUS start( FMOD::System* system, int driver, FMOD::Sound* sound, const char* file_name,
+                  unsigned preroll_frames = 0, unsigned long long max_frames = 0 );
+
+    /**
+     * Writes whatever is left up to the current record position and finalises the file.
+     * Call before System::recordStop, which resets the record position. Also call it
+     * once a limited save has stopped running, to close the file.
+     */
+    void stop( );
+
+    /**
+     * False once stopped, or once 'max_frames' have been written.
+     */
+    bool               isRunning( ) const    { return running; }
+    unsigned long long bytesWritten( ) const { return written; }
+
+private:
+
+    void run( );
+    void drain( );
+    void fixHeader( );
+
+    FMOD::System* system;
+    FMOD::Sound*  sound;
+    int           driver;
+    FILE*         fp;
+    FlacEncoder*  flac;
+
+    int      channels;
+    int      bits;
+    bool     floatSamples;
+    float    rate;
+    unsigned ringFrames;
+    unsigned frameBytes;
+    unsigned lastPosition;
+
+    unsigned long long limit;       /* bytes, 0 for no limit */
+
+    std::thread                         thread;
+    std::atomic< bool >                 running;
+    std::atomic< unsigned long long >   written;
+};
+
+STATUS fmodCreateCaptureSound( FMOD::System* system, FMOD::Sound** sound, const CaptureFormat* format = 0 );
+
+//------------------------------------------------------------------------------------------
+
+#endif // CAPTURE_WRITER_H
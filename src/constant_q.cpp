@@ -0,0 +1,226 @@
+#include "constant_q.h"
+#include "stft.h"
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+//------------------------------------------------------------------------------------------
+
+/**
+ * Frequency of any note index, including the ones below C0 that the top octave of a
+ * short range may start on.
+ */
+static double noteFrequency( int note )
+{
+    double scale = 1.0;
+
+    for( ; note < 0; note += 12 )
+        scale *= 0.5;
+
+    return Tuning::tables.hz[ note ] * scale;
+}
+
+static double binFrequency( int note, unsigned sub, unsigned per_note )
+{
+    return noteFrequency( note ) * exp2( sub / ( 12.0 * per_note ) );
+}
+
+ConstantQ::ConstantQ( float sample_rate, unsigned bins_per_note, int lowest_note, int highest_note, FFT_KERNEL kernel )
+{
+    rate    = std::max( sample_rate, 1.0f );
+    perNote = std::max( 1u, bins_per_note );
+    lowest  = std::max( 0, std::min( lowest_note, TUNING_NOTES - 1 ) );
+    highest = std::max( lowest, std::min( highest_note, TUNING_NOTES - 1 ) );
+
+    while( highest > lowest && binFrequency( highest, perNote - 1, perNote ) >= rate * CQT_MAX_FRACTION )
+        highest--;
+
+    unsigned count = ( unsigned )( highest - lowest ) / 12 + 1;
+    unsigned group = 12 * perNote;
+    int      base  = highest - 11;
+
+    //------------------------------------------------
+    // The top octave sets the FFT size: its lowest bin has the longest kernel.
+
+    double   q       = 1.0 / ( exp2( 1.0 / group ) - 1.0 );
+    unsigned longest = ( unsigned )ceil( q * rate / binFrequency( base, 0, perNote ) );
+    unsigned size    = 16;
+
+    while( size < longest )
+        size *= 2;
+
+    plan = FftPlan::shared( size, kernel );
+
+    re.resize( plan->bins( ) );
+    im.resize( plan->bins( ) );
+    scratch.resize( size );
+
+    //------------------------------------------------
+    // Spectral kernels. A complex kernel t = a + jb is transformed as two real ones,
+    // T = A + jB; only the positive half matters, the signal being real.
+
+    std::vector< float > a( size ), b( size ), window( size );
+    std::vector< float > aRe( plan->bins( ) ), aIm( plan->bins( ) ), bRe( plan->bins( ) ), bIm( plan->bins( ) );
+    std::vector< float > kRe( plan->bins( ) ), kIm( plan->bins( ) );
+
+    kernelStart.resize( group );
+    kernelLength.resize( group );
+    kernelOffset.resize( group );
+
+    for( unsigned g = 0; g < group; g++ )
+    {
+        double   hz     = binFrequency( base + ( int )( g / perNote ), g % perNote, perNote );
+        double   omega  = 2.0 * M_PI * hz / rate;
+        unsigned length = std::min( size, ( unsigned )ceil( q * rate / hz ) );
+        double   sum    = 0.0;
+
+        makeWindow( WINDOW_HANN, &window[ 0 ], length );
+
+        for( unsigned n = 0; n < length; n++ )
+            sum += window[ n ];
+
+        std::fill( a.begin( ), a.end( ), 0.0f );
+        std::fill( b.begin( ), b.end( ), 0.0f );
+
+        for( unsigned n = 0; n < length; n++ )
+        {
+            a[ size - length + n ] = ( float )( window[ n ] / sum * cos( omega * n ) );
+            b[ size - length + n ] = ( float )( window[ n ] / sum * sin( omega * n ) );
+        }
+
+        plan->forward( &a[ 0 ], &aRe[ 0 ], &aIm[ 0 ], &scratch[ 0 ] );
+        plan->forward( &b[ 0 ], &bRe[ 0 ], &bIm[ 0 ], &scratch[ 0 ] );
+
+        // Conjugated and scaled by 2 / size (Parseval, and both halves of a real sine).
+        float peak = 0.0f;
+
+        for( unsigned j = 0; j < plan->bins( ); j++ )
+        {
+            kRe[ j ] = 2.0f / size * ( aRe[ j ] - bIm[ j ] );
+            kIm[ j ] = -2.0f / size * ( aIm[ j ] + bRe[ j ] );
+            peak     = std::max( peak, kRe[ j ] * kRe[ j ] + kIm[ j ] * kIm[ j ] );
+        }
+
+        float    cutoff = peak * CQT_SPARSITY * CQT_SPARSITY;
+        unsigned first = 0;
+        unsigned last  = plan->bins( ) - 1;
+
+        while( first < last && kRe[ first ] * kRe[ first ] + kIm[ first ] * kIm[ first ] < cutoff )
+            first++;
+
+        while( last > first && kRe[ last ] * kRe[ last ] + kIm[ last ] * kIm[ last ] < cutoff )
+            last--;
+
+        kernelStart[ g ]  = first;
+        kernelLength[ g ] = last - first + 1;
+        kernelOffset[ g ] = ( unsigned )kernelRe.size( );
+
+        kernelRe.insert( kernelRe.end( ), kRe.begin( ) + first, kRe.begin( ) + last + 1 );
+        kernelIm.insert( kernelIm.end( ), kIm.begin( ) + first, kIm.begin( ) + last + 1 );
+    }
+
+    //------------------------------------------------
+
+    centres.resize( bins( ) );
+
+    for( unsigned i = 0; i < centres.size( ); i++ )
+        centres[ i ] = ( float )binFrequency( lowest + ( int )( i / perNote ), i % perNote, perNote );
+
+    histories.assign( count, std::vector< float >( size, 0.0f ) );
+
+    for( unsigned o = 1; o < count; o++ )
+        decimators.push_back( Resampler( 2, 1, kernel ) );
+
+    if( !decimators.empty( ) )
+    {
+        ping.resize( decimators[ 0 ].maxOutput( CQT_BLOCK ) );
+        pong.resize( decimators[ 0 ].maxOutput( CQT_BLOCK ) );
+    }
+}
+
+void ConstantQ::reset( )
+{
+    for( unsigned o = 0; o < histories.size( ); o++ )
+        std::fill( histories[ o ].begin( ), histories[ o ].end( ), 0.0f );
+
+    for( unsigned o = 0; o < decimators.size( ); o++ )
+        decimators[ o ].reset( );
+}
+
+//------------------------------------------------------------------------------------------
+
+void ConstantQ::append( unsigned octave, const float* samples, unsigned count )
+{
+    std::vector< float >& history = histories[ octave ];
+    unsigned              size    = ( unsigned )history.size( );
+
+    if( count >= size )
+    {
+        memcpy( &history[ 0 ], samples + count - size, size * sizeof( float ) );
+        return;
+    }
+
+    memmove( &history[ 0 ], &history[ count ], ( size - count ) * sizeof( float ) );
+    memcpy( &history[ size - count ], samples, count * sizeof( float ) );
+}
+
+void ConstantQ::push( const float* samples, unsigned count )
+{
+    while( count > 0 )
+    {
+        unsigned     take  = std::min( count, ( unsigned )CQT_BLOCK );
+        const float* input = samples;
+        unsigned     n     = take;
+
+        append( 0, samples, take );
+
+        for( unsigned o = 0; o < decimators.size( ) && n > 0; o++ )
+        {
+            float* output = ( o % 2 == 0 ? &ping[ 0 ] : &pong[ 0 ] );
+
+            n = decimators[ o ].process( input, n, output );
+            append( o + 1, output, n );
+
+            input = output;
+        }
+
+        samples += take;
+        count   -= take;
+    }
+}
+
+void ConstantQ::analyse( float* magnitudes )
+{
+    int base = highest - 11;
+
+    for( unsigned o = 0; o < histories.size( ); o++ )
+    {
+        int shift = 12 * ( int )o;
+        int first = std::max( lowest, base - shift );
+
+        plan->forward( &histories[ o ][ 0 ], &re[ 0 ], &im[ 0 ], &scratch[ 0 ] );
+
+        for( int note = first; note <= highest - shift; note++ )
+        {
+            for( unsigned sub = 0; sub < perNote; sub++ )
+            {
+                unsigned     g  = ( unsigned )( note - ( base - shift ) ) * perNote + sub;
+                const float* kr = &kernelRe[ kernelOffset[ g ] ];
+                const float* ki = &kernelIm[ kernelOffset[ g ] ];
+                const float* xr = &re[ kernelStart[ g ] ];
+                const float* xi = &im[ kernelStart[ g ] ];
+                float        sr = 0.0f;
+                float        si = 0.0f;
+
+                for( unsigned j = 0; j < kernelLength[ g ]; j++ )
+                {
+                    sr += xr[ j ] * kr[ j ] - xi[ j ] * ki[ j ];
+                    si += xr[ j ] * ki[ j ] + xi[ j ] * kr[ j ];
+                }
+
+                magnitudes[ ( unsigned )( note - lowest ) * perNote + sub ] = sqrtf( sr * sr + si * si );
+            }
+        }
+    }
+}
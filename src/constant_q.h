@@ -0,0 +1,105 @@
+#ifndef CONSTANT_Q_H
+#define CONSTANT_Q_H
+
+#include "fft.h"
+#include "resampler.h"
+#include "tuning.h"
+
+#include <memory>
+#include <vector>
+
+//------------------------------------------------------------------------------------------
+
+#define CQT_BINS_PER_NOTE   1
+#define CQT_MAX_FRACTION    0.3         /* highest bin kept under this fraction of the rate */
+#define CQT_SPARSITY        0.005       /* spectral kernel entries below this, relative to the bin's peak, are dropped */
+#define CQT_BLOCK           1024        /* input samples decimated per pass */
+
+/**
+ * Constant-Q transform with its bins on the notes of the tuning table.
+ *
+ * Bin b is note lowestNote() + b / binsPerNote(), raised by ( b % binsPerNote() ) /
+ * binsPerNote() semitones, so with one bin per note every bin is a note of Tuning. The
+ * notes are split into octaves from the top down. The top octave is analysed at the input
+ * rate; every octave below it runs on the signal halved once more by a Resampler. Since
+ * the table's octaves are exact, every octave uses the same fftSize() FFT and the same
+ * sparse spectral kernels (Brown and Puckette), so a low note costs as much as a high one.
+ * To split C0 from C#0 a linear spectrum would need a 131072 point FFT at 48 kHz.
+ *
+ * Each kernel is a Hann-windowed complex sinusoid Q periods long, aligned to end on the
+ * newest sample. High notes therefore react within a few ms, and the lowest
+ * octaves settle only over frameSize( ) samples. Each decimation adds about 32
+ * samples of delay at its input rate, so the lower octaves also lag by about a quarter
+ * of their kernel. A full scale sine reads ~1.0 on its bin.
+ *
+ *     cqt.push( samples, count );
+ *     cqt.analyse( magnitudes );      // bins( ) values, lowest note first
+ */
+class ConstantQ
+{
+public:
+
+    ConstantQ( float sample_rate, unsigned bins_per_note = CQT_BINS_PER_NOTE, int lowest_note = 0,
+               int highest_note = TUNING_NOTES - 1, FFT_KERNEL kernel = FFT_KERNEL_AUTO );
+
+    unsigned bins( ) const        { return ( unsigned )( highest - lowest + 1 ) * perNote; }
+    unsigned binsPerNote( ) const { return perNote; }
+    int      lowestNote( ) const  { return lowest; }
+
+    /**
+     * The requested highest note, lowered until it fits under CQT_MAX_FRACTION of the rate.
+     */
+    int highestNote( ) const { return highest; }
+
+    unsigned octaves( ) const   { return ( unsigned )histories.size( ); }
+    unsigned fftSize( ) const   { return plan->size( ); }
+    unsigned frameSize( ) const { return plan->size( ) << ( octaves( ) - 1 ); }
+
+    /**
+     * Centre frequency of bin 'bin'.
+     */
+    float binHz( unsigned bin ) const { return centres[ bin ]; }
+
+    /**
+     * Takes any number of samples. Never allocates.
+     */
+    void push( const float* samples, unsigned count );
+
+    /**
+     * Writes bins( ) magnitudes for the newest pushed sample.
+     */
+    void analyse( float* magnitudes );
+
+    void reset( );
+
+private:
+
+    void append( unsigned octave, const float* samples, unsigned count );
+
+    int      lowest;
+    int      highest;
+    unsigned perNote;
+    float    rate;
+
+    std::shared_ptr< const FftPlan > plan;
+
+    // Sparse spectral kernels of the top octave's 12 * perNote bins, conjugated and scaled.
+    std::vector< unsigned > kernelStart;    /* first FFT bin used */
+    std::vector< unsigned > kernelLength;
+    std::vector< unsigned > kernelOffset;   /* into kernelRe / kernelIm */
+    std::vector< float >    kernelRe;
+    std::vector< float >    kernelIm;
+
+    std::vector< float >                  centres;
+    std::vector< Resampler >              decimators;   /* octave i feeds octave i + 1 */
+    std::vector< std::vector< float > >   histories;    /* newest fftSize( ) samples per octave */
+    std::vector< float >                  ping;
+    std::vector< float >                  pong;
+    std::vector< float >                  re;
+    std::vector< float >                  im;
+    std::vector< float >                  scratch;
+};
+
+//------------------------------------------------------------------------------------------
+
+#endif // CONSTANT_Q_H
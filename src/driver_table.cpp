@@ -0,0 +1,223 @@
+#include "driver_table.h"
+#include "trace.h"
+
+#include <chrono>
+#include <cstring>
+
+//------------------------------------------------------------------------------------------
+
+static bool sameDriver( const DriverInfo& a, const DriverInfo& b )
+{
+    return a.name == b.name && memcmp( &a.guid, &b.guid, sizeof( FMOD_GUID ) ) == 0;
+}
+
+static bool sameList( const std::vector< DriverInfo >& a, const std::vector< DriverInfo >& b )
+{
+    if( a.size( ) != b.size( ) )
+        return false;
+
+    for( unsigned i = 0; i < a.size( ); i++ )
+    {
+        if( !sameDriver( a[ i ], b[ i ] ) )
+            return false;
+    }
+
+    return true;
+}
+
+/**
+ * Reads one list, reusing the caps of drivers already in 'known'.
+ */
+static STATUS readDrivers( FMOD::System* system, bool record_drivers, const std::vector< DriverInfo >& known, std::vector< DriverInfo >* drivers )
+{
+    FMOD_RESULT result;
+    int         count = 0;
+
+    result = ( record_drivers ? system->getRecordNumDrivers( &count ) : system->getNumDrivers( &count ) );
+
+    if( result != FMOD_OK )
+    {
+        DEBUG_OUT( FMOD_ErrorString( result ) );
+        return DRIVER_COUNT_RETRIEVE_FAILED;
+    }
+
+    drivers->clear( );
+    drivers->reserve( count );
+
+    for( int i = 0; i < count; i++ )
+    {
+        DriverInfo info;
+        STATUS     status = fmodGetDriverInfo( system, i, record_drivers, &info );
+
+        if( status != OK )
+            return status;
+
+        bool cached = false;
+
+        for( unsigned k = 0; k < known.size( ) && !cached; k++ )
+        {
+            if( sameDriver( known[ k ], info ) )
+            {
+                info   = known[ k ];
+                cached = true;
+            }
+        }
+
+        // A driver whose caps cannot be read is still listed, just without them.
+        if( !cached )
+            fmodGetDriverCaps( system, i, record_drivers, &info );
+
+        drivers->push_back( info );
+    }
+
+    return OK;
+}
+
+//------------------------------------------------------------------------------------------
+
+DriverTable::DriverTable( unsigned period_ms )
+{
+    period     = period_ms;
+    running    = false;
+    generation = 0;
+    output     = OSS;
+    pending    = false;
+}
+
+DriverTable::~DriverTable( )
+{
+    stop( );
+}
+
+//------------------------------------------------------------------------------------------
+
+void DriverTable::start( OUTPUT_TYPE output, Listener changed )
+{
+    stop( );
+
+    this->output   = output;
+    this->listener = changed;
+    this->pending  = true;
+
+    running = true;
+    thread  = std::thread( &DriverTable::run, this );
+}
+
+void DriverTable::stop( )
+{
+    if( !thread.joinable( ) )
+        return;
+
+    {
+        std::lock_guard< std::mutex > guard( lock );
+        running = false;
+    }
+
+    wake.notify_one( );
+    thread.join( );
+}
+
+void DriverTable::setOutputType( OUTPUT_TYPE output )
+{
+    {
+        std::lock_guard< std::mutex > guard( lock );
+
+        if( output == this->output )
+            return;
+
+        this->output = output;
+
+        playback.clear( );
+        record.clear( );
+        pending = true;
+    }
+
+    wake.notify_one( );
+}
+
+void DriverTable::refresh( )
+{
+    {
+        std::lock_guard< std::mutex > guard( lock );
+        pending = true;
+    }
+
+    wake.notify_one( );
+}
+
+std::vector< DriverInfo > DriverTable::drivers( bool record_drivers ) const
+{
+    std::lock_guard< std::mutex > guard( lock );
+    return ( record_drivers ? record : playback );
+}
+
+//------------------------------------------------------------------------------------------
+
+/**
+ * One enumeration pass. Returns true if either list changed.
+ */
+bool DriverTable::enumerate( OUTPUT_TYPE output )
+{
+    TRACE_SCOPE( TRACE_LEVEL_INFO, "DriverTable::enumerate" );
+
+    std::vector< DriverInfo > knownPlayback;
+    std::vector< DriverInfo > knownRecord;
+
+    {
+        std::lock_guard< std::mutex > guard( lock );
+        knownPlayback = playback;
+        knownRecord   = record;
+    }
+
+    FMOD::System* system = 0;
+
+    if( fmodSetup( &system ) != OK )
+        return false;
+
+    std::vector< DriverInfo > newPlayback;
+    std::vector< DriverInfo > newRecord;
+
+    bool ok = fmodSetOutputType( system, output ) == OK &&
+              readDrivers( system, false, knownPlayback, &newPlayback ) == OK &&
+              readDrivers( system, true, knownRecord, &newRecord ) == OK;
+
+    system->release( );
+
+    if( !ok )
+        return false;
+
+    std::lock_guard< std::mutex > guard( lock );
+
+    // The output type may have been switched while this pass was probing.
+    if( output != this->output )
+        return false;
+
+    if( generation > 0 && sameList( playback, newPlayback ) && sameList( record, newRecord ) )
+        return false;
+
+    playback.swap( newPlayback );
+    record.swap( newRecord );
+    generation++;
+
+    return true;
+}
+
+void DriverTable::run( )
+{
+    std::unique_lock< std::mutex > guard( lock );
+
+    while( running )
+    {
+        OUTPUT_TYPE current = output;
+        pending = false;
+
+        guard.unlock( );
+
+        if( enumerate( current ) && listener )
+            listener( );
+
+        guard.lock( );
+
+        wake.wait_for( guard, std::chrono::milliseconds( period ), [ this ]( ) { return pending || !running; } );
+    }
+}
@@ -0,0 +1,78 @@
+#ifndef DRIVER_TABLE_H
+#define DRIVER_TABLE_H
+
+#include "fmod_resources.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//------------------------------------------------------------------------------------------
+
+#define DRIVER_REFRESH_MS  3000     /* how often the device lists are re-read */
+
+/**
+ * Cached playback and record driver lists, enumerated off the GUI thread.
+ *
+ * A background thread builds the lists at start-up and then re-reads them every few
+ * seconds, or immediately after refresh( ) / setOutputType( ). Each pass uses its own
+ * short-lived FMOD::System, because FMOD Ex reads the device list once per system and
+ * DEVICELISTCHANGED is only delivered from System::update on an initialised system
+ * that nobody pumps while the application is idle. Drivers that were already known
+ * (same GUID and name) keep their cached caps, so only new devices are probed.
+ *
+ * The listener runs on the table's thread whenever either list changes.
+ */
+class DriverTable
+{
+public:
+
+    typedef std::function< void( ) > Listener;
+
+    explicit DriverTable( unsigned period_ms = DRIVER_REFRESH_MS );
+    ~DriverTable( );
+
+    void start( OUTPUT_TYPE output, Listener changed );
+    void stop( );
+
+    /**
+     * Drivers belong to an output type; switching drops the cache and re-enumerates.
+     */
+    void setOutputType( OUTPUT_TYPE output );
+    void refresh( );
+
+    /**
+     * Snapshot of the current list. Empty until the first pass has finished.
+     */
+    std::vector< DriverInfo > drivers( bool record_drivers ) const;
+
+    bool     isReady( ) const    { return generation > 0; }
+    unsigned revision( ) const   { return generation; }
+
+private:
+
+    void run( );
+    bool enumerate( OUTPUT_TYPE output );
+
+    unsigned period;
+    Listener listener;
+
+    std::vector< DriverInfo > playback;
+    std::vector< DriverInfo > record;
+
+    mutable std::mutex        lock;
+    std::condition_variable   wake;
+    std::thread               thread;
+    std::atomic< bool >       running;
+    std::atomic< unsigned >   generation;
+
+    OUTPUT_TYPE output;         /* guarded by lock */
+    bool        pending;        /* guarded by lock */
+};
+
+//------------------------------------------------------------------------------------------
+
+#endif // DRIVER_TABLE_H
@@ -0,0 +1,132 @@
+#include "dsp_tap.h"
+
+#include <cstring>
+
+//------------------------------------------------------------------------------------------
+
+DspTap::DspTap( unsigned ring_frames )
+    : ring( ring_frames )
+{
+    dsp  = 0;
+    rate = OUTPUTRATE;
+    lost = 0;
+}
+
+DspTap::~DspTap( )
+{
+    detach( );
+}
+
+//------------------------------------------------------------------------------------------
+
+STATUS DspTap::attach( FMOD::System* system, FMOD::Channel* channel )
+{
+    if( system == 0 )
+    {
+        DEBUG_OUT( "system == NULL" );
+        return PARAM_NULL_PASSED;
+    }
+
+    detach( );
+
+    FMOD_RESULT          result;
+    FMOD_DSP_DESCRIPTION description;
+
+    memset( &description, 0, sizeof( FMOD_DSP_DESCRIPTION ) );
+    strncpy( description.name, "analysis tap", sizeof( description.name ) - 1 );
+
+    description.channels = 0;               /* whatever it is given */
+    description.read     = readCallback;
+
+    rate = OUTPUTRATE;
+    system->getSoftwareFormat( &rate, 0, 0, 0, 0, 0 );
+
+    result = system->createDSP( &description, &dsp );
+
+    if( result != FMOD_OK )
+    {
+        DEBUG_OUT( FMOD_ErrorString( result ) );
+        dsp = 0;
+        return DSP_CREATION_FAILED;
+    }
+
+    // Set before the unit is connected, so the first callback already finds it.
+    dsp->setUserData( this );
+
+    result = ( channel != 0 ? channel->addDSP( dsp, 0 ) : system->addDSP( dsp, 0 ) );
+
+    if( result != FMOD_OK )
+    {
+        DEBUG_OUT( FMOD_ErrorString( result ) );
+        dsp->release( );
+        dsp = 0;
+        return DSP_CREATION_FAILED;
+    }
+
+    return OK;
+}
+
+void DspTap::detach( )
+{
+    if( dsp == 0 )
+        return;
+
+    // remove() returns once the mixer is no longer inside the callback.
+    dsp->remove( );
+    dsp->release( );
+    dsp = 0;
+}
+
+//------------------------------------------------------------------------------------------
+
+FMOD_RESULT F_CALLBACK DspTap::readCallback( FMOD_DSP_STATE* state, float* in, float* out, unsigned length, int in_channels, int out_channels )
+{
+    FMOD::DSP* unit = ( FMOD::DSP* )state->instance;
+    void*      user = 0;
+
+    memcpy( out, in, length * out_channels * sizeof( float ) );
+
+    unit->getUserData( &user );
+
+    if( user != 0 && in_channels > 0 )
+        ( ( DspTap* )user )->process( in, length, in_channels );
+
+    return FMOD_OK;
+}
+
+/**
+ * Mixer thread. Downmixes 'length' interleaved frames in DSP_TAP_CHUNK pieces.
+ */
+void DspTap::process( const float* in, unsigned length, int channels )
+{
+    float scale = 1.0f / channels;
+
+    for( unsigned done = 0; done < length; )
+    {
+        unsigned take = std::min( length - done, ( unsigned )DSP_TAP_CHUNK );
+
+        if( channels == 1 )
+        {
+            memcpy( scratch, in + done, take * sizeof( float ) );
+        }
+        else
+        {
+            const float* frame = in + ( size_t )done * channels;
+
+            for( unsigned i = 0; i < take; i++, frame += channels )
+            {
+                float sum = 0;
+
+                for( int c = 0; c < channels; c++ )
+                    sum += frame[ c ];
+
+                scratch[ i ] = sum * scale;
+            }
+        }
+
+        if( !ring.write( scratch, take ) )
+            lost += take;
+
+        done += take;
+    }
+}
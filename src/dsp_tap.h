@@ -0,0 +1,81 @@
+#ifndef DSP_TAP_H
+#define DSP_TAP_H
+
+#include "fmod_resources.h"
+#include "spsc_ring.h"
+
+#include <atomic>
+
+//------------------------------------------------------------------------------------------
+
+#define DSP_TAP_RING_FRAMES   ( 1 << 16 )   /* ~1.4 s at 48 kHz between mixer and reader */
+#define DSP_TAP_CHUNK         1024          /* frames downmixed per ring write */
+
+/**
+ * Pass-through FMOD::DSP that copies every mixed block, downmixed to mono, into a
+ * lock-free ring.
+ *
+ * The read callback runs on FMOD's mixer thread (inside System::update under NRT
+ * output). It does no locking or allocation: it copies input to output, averages the
+ * channels into a fixed scratch block and writes that to an SpscSampleRing. A reader
+ * that drains the ring sees every sample the unit processed exactly once, in order, as
+ * soon as its block is mixed. A block that finds the ring full is dropped and counted.
+ */
+class DspTap
+{
+public:
+
+    explicit DspTap( unsigned ring_frames = DSP_TAP_RING_FRAMES );
+    ~DspTap( );
+
+    /**
+     * Creates the unit and inserts it on 'channel', or on the master channel group
+     * when 'channel' is null. Detaches from anything it was on before.
+     */
+    STATUS attach( FMOD::System* system, FMOD::Channel* channel = 0 );
+
+    /**
+     * Removes and releases the unit. Samples already in the ring stay readable.
+     */
+    void detach( );
+
+    bool isAttached( ) const { return dsp != 0; }
+
+    /**
+     * Mixer rate, i.e. the rate of the samples in the ring.
+     */
+    int sampleRate( ) const { return rate; }
+
+    /**
+     * Consumer side. Up to 'frames' mono samples; returns how many were read.
+     */
+    unsigned read( float* mono, unsigned frames ) { return ring.read( mono, frames ); }
+    unsigned available( ) const                   { return ring.size( ); }
+    void     clear( )                             { ring.clear( ); }
+
+    /**
+     * Frames the mixer had to drop because the reader fell behind.
+     */
+    unsigned long long dropped( ) const { return lost; }
+
+private:
+
+    DspTap( const DspTap& );
+    DspTap& operator=( const DspTap& );
+
+    static FMOD_RESULT F_CALLBACK readCallback( FMOD_DSP_STATE* state, float* in, float* out, unsigned length, int in_channels, int out_channels );
+
+    void process( const float* in, unsigned length, int channels );
+
+    FMOD::DSP*     dsp;
+    int            rate;
+    SpscSampleRing ring;
+
+    float scratch[ DSP_TAP_CHUNK ];     /* mixer thread only */
+
+    std::atomic< unsigned long long > lost;
+};
+
+//------------------------------------------------------------------------------------------
+
+#endif // DSP_TAP_H
@@ -0,0 +1,167 @@
+#include "energy_gate.h"
+
+#include <cmath>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+    #define GATE_X86 1
+    #include <immintrin.h>
+#endif
+
+//------------------------------------------------------------------------------------------
+// Sum of squares and largest magnitude.
+
+static void levelScalar( const float* samples, unsigned count, float* squares, float* peak )
+{
+    float sum = 0.0f;
+    float max = 0.0f;
+
+    for( unsigned i = 0; i < count; i++ )
+    {
+        sum += samples[ i ] * samples[ i ];
+        max  = std::max( max, fabsf( samples[ i ] ) );
+    }
+
+    *squares += sum;
+    *peak     = std::max( *peak, max );
+}
+
+#ifdef GATE_X86
+
+__attribute__(( target( "sse2" ) ))
+static void levelSSE( const float* samples, unsigned count, float* squares, float* peak )
+{
+    __m128   sign = _mm_set1_ps( -0.0f );
+    __m128   sum  = _mm_setzero_ps( );
+    __m128   max  = _mm_setzero_ps( );
+    unsigned i    = 0;
+
+    for( ; i + 4 <= count; i += 4 )
+    {
+        __m128 x = _mm_loadu_ps( samples + i );
+
+        sum = _mm_add_ps( sum, _mm_mul_ps( x, x ) );
+        max = _mm_max_ps( max, _mm_andnot_ps( sign, x ) );
+    }
+
+    float lanes[ 4 ], peaks[ 4 ];
+
+    _mm_storeu_ps( lanes, sum );
+    _mm_storeu_ps( peaks, max );
+
+    *squares += ( lanes[ 0 ] + lanes[ 1 ] ) + ( lanes[ 2 ] + lanes[ 3 ] );
+    *peak     = std::max( *peak, std::max( std::max( peaks[ 0 ], peaks[ 1 ] ), std::max( peaks[ 2 ], peaks[ 3 ] ) ) );
+
+    levelScalar( samples + i, count - i, squares, peak );
+}
+
+__attribute__(( target( "avx2,fma" ) ))
+static void levelAVX2( const float* samples, unsigned count, float* squares, float* peak )
+{
+    __m256   sign = _mm256_set1_ps( -0.0f );
+    __m256   sumA = _mm256_setzero_ps( );
+    __m256   sumB = _mm256_setzero_ps( );
+    __m256   max  = _mm256_setzero_ps( );
+    unsigned i    = 0;
+
+    // Two accumulators so consecutive FMAs do not wait on each other.
+    for( ; i + 16 <= count; i += 16 )
+    {
+        __m256 x = _mm256_loadu_ps( samples + i );
+        __m256 y = _mm256_loadu_ps( samples + i + 8 );
+
+        sumA = _mm256_fmadd_ps( x, x, sumA );
+        sumB = _mm256_fmadd_ps( y, y, sumB );
+        max  = _mm256_max_ps( max, _mm256_max_ps( _mm256_andnot_ps( sign, x ), _mm256_andnot_ps( sign, y ) ) );
+    }
+
+    float lanes[ 8 ], peaks[ 8 ];
+
+    _mm256_storeu_ps( lanes, _mm256_add_ps( sumA, sumB ) );
+    _mm256_storeu_ps( peaks, max );
+
+    for( unsigned k = 0; k < 8; k++ )
+    {
+        *squares += lanes[ k ];
+        *peak     = std::max( *peak, peaks[ k ] );
+    }
+
+    levelSSE( samples + i, count - i, squares, peak );
+}
+
+#endif
+
+//------------------------------------------------------------------------------------------
+
+void measureLevel( const float* samples, unsigned count, SignalLevel* level, FFT_KERNEL kernel )
+{
+    static const FFT_KERNEL best = resolveKernel( FFT_KERNEL_AUTO );
+
+    float squares = 0.0f;
+    float peak    = 0.0f;
+
+    switch( kernel == FFT_KERNEL_AUTO ? best : resolveKernel( kernel ) )
+    {
+#ifdef GATE_X86
+    case FFT_KERNEL_AVX2:
+        levelAVX2( samples, count, &squares, &peak );
+        break;
+    case FFT_KERNEL_SSE:
+        levelSSE( samples, count, &squares, &peak );
+        break;
+#endif
+    default:
+        levelScalar( samples, count, &squares, &peak );
+        break;
+    }
+
+    level->rms  = ( count > 0 ? sqrtf( squares / count ) : 0.0f );
+    level->peak = peak;
+}
+
+//------------------------------------------------------------------------------------------
+
+static float fromDb( float db )
+{
+    return powf( 10.0f, db / 20.0f );
+}
+
+EnergyGate::EnergyGate( float open_db, float close_db, FFT_KERNEL kernel_ )
+{
+    openRms  = fromDb( open_db );
+    closeRms = fromDb( std::min( close_db, open_db ) );
+    openPeak = fromDb( std::max( GATE_PEAK_DB, open_db ) );
+    kernel   = kernel_;
+
+    reset( );
+}
+
+void EnergyGate::reset( )
+{
+    open      = false;
+    quiet     = 0;
+    last.rms  = 0.0f;
+    last.peak = 0.0f;
+}
+
+bool EnergyGate::process( const float* samples, unsigned count )
+{
+    measureLevel( samples, count, &last, kernel );
+
+    if( last.rms >= openRms || last.peak >= openPeak )
+    {
+        open  = true;
+        quiet = 0;
+    }
+    else if( last.rms >= closeRms )
+    {
+        quiet = 0;
+    }
+    else if( open && ++quiet >= GATE_HOLD_FRAMES )
+    {
+        open  = false;
+        quiet = 0;
+    }
+
+    return open;
+}
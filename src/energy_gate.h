@@ -0,0 +1,65 @@
+#ifndef ENERGY_GATE_H
+#define ENERGY_GATE_H
+
+#include "fft.h"
+
+//------------------------------------------------------------------------------------------
+
+#define GATE_WINDOW        2048      /* newest samples of a frame the gate looks at */
+#define GATE_OPEN_DB       -50.0f    /* RMS, dBFS, at which analysis starts */
+#define GATE_CLOSE_DB      -56.0f    /* RMS below which it may stop again */
+#define GATE_PEAK_DB       -38.0f    /* a peak this loud opens it at once, for attacks */
+#define GATE_HOLD_FRAMES   4         /* frames below GATE_CLOSE_DB before it closes */
+
+struct SignalLevel
+{
+    float rms;      /* linear, 0..1 for full scale */
+    float peak;     /* largest |sample| */
+};
+
+/**
+ * RMS and peak of 'count' samples in one pass, with the SSE or AVX2 kernel when the
+ * CPU has it (the same choice as FFT_KERNEL).
+ */
+void measureLevel( const float* samples, unsigned count, SignalLevel* level, FFT_KERNEL kernel = FFT_KERNEL_AUTO );
+
+/**
+ * Decides per frame whether there is anything worth a pitch estimate.
+ *
+ * Looks only at raw PCM, before any FFT work. It opens when the RMS reaches the open
+ * threshold or a single peak reaches GATE_PEAK_DB, and closes only after
+ * GATE_HOLD_FRAMES frames in a row under the lower close threshold. So it does not
+ * chatter on a decaying note or on noise hovering near one threshold. Callers skip
+ * the analysis of a frame the gate rejects and report it unvoiced (fmodUnvoicedPitch).
+ */
+class EnergyGate
+{
+public:
+
+    explicit EnergyGate( float open_db = GATE_OPEN_DB, float close_db = GATE_CLOSE_DB, FFT_KERNEL kernel = FFT_KERNEL_AUTO );
+
+    /**
+     * Measures one frame and updates the state. True if the frame should be analysed.
+     */
+    bool process( const float* samples, unsigned count );
+
+    bool               isOpen( ) const { return open; }
+    const SignalLevel& level( ) const  { return last; }
+
+    void reset( );
+
+private:
+
+    float      openRms;
+    float      closeRms;
+    float      openPeak;
+    FFT_KERNEL kernel;
+
+    bool        open;
+    unsigned    quiet;      /* consecutive frames under closeRms */
+    SignalLevel last;
+};
+
+//------------------------------------------------------------------------------------------
+
+#endif // ENERGY_GATE_H
@@ -0,0 +1,377 @@
+#include "fft.h"
+
+#include <cmath>
+#include <cstring>
+#include <mutex>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+    #define FFT_X86 1
+    #include <immintrin.h>
+#endif
+
+//------------------------------------------------------------------------------------------
+// Butterfly stage kernels.
+//
+// A stage with span 'span' combines pairs (k, k + span) inside every block of
+// 2 * span values. The twiddles of a stage are contiguous, so once the span reaches
+// the vector width the inner loop is a straight run of loads, FMAs and stores.
+
+static void stageScalar( float* re, float* im, const float* twRe, const float* twIm, unsigned count, unsigned span )
+{
+    for( unsigned block = 0; block < count; block += span * 2 )
+    {
+        float* aRe = re + block;
+        float* aIm = im + block;
+        float* bRe = aRe + span;
+        float* bIm = aIm + span;
+
+        for( unsigned k = 0; k < span; k++ )
+        {
+            float vRe = bRe[ k ] * twRe[ k ] - bIm[ k ] * twIm[ k ];
+            float vIm = bRe[ k ] * twIm[ k ] + bIm[ k ] * twRe[ k ];
+
+            bRe[ k ] = aRe[ k ] - vRe;
+            bIm[ k ] = aIm[ k ] - vIm;
+            aRe[ k ] = aRe[ k ] + vRe;
+            aIm[ k ] = aIm[ k ] + vIm;
+        }
+    }
+}
+
+static void magnitudeScalar( const float* re, const float* im, float* out, unsigned count, float scale )
+{
+    for( unsigned i = 0; i < count; i++ )
+        out[ i ] = sqrtf( re[ i ] * re[ i ] + im[ i ] * im[ i ] ) * scale;
+}
+
+#ifdef FFT_X86
+
+__attribute__(( target( "sse2" ) ))
+static void stageSSE( float* re, float* im, const float* twRe, const float* twIm, unsigned count, unsigned span )
+{
+    if( span < 4 )
+    {
+        stageScalar( re, im, twRe, twIm, count, span );
+        return;
+    }
+
+    for( unsigned block = 0; block < count; block += span * 2 )
+    {
+        float* aRe = re + block;
+        float* aIm = im + block;
+        float* bRe = aRe + span;
+        float* bIm = aIm + span;
+
+        for( unsigned k = 0; k < span; k += 4 )
+        {
+            __m128 wr = _mm_loadu_ps( twRe + k );
+            __m128 wi = _mm_loadu_ps( twIm + k );
+            __m128 xr = _mm_loadu_ps( bRe + k );
+            __m128 xi = _mm_loadu_ps( bIm + k );
+            __m128 ur = _mm_loadu_ps( aRe + k );
+            __m128 ui = _mm_loadu_ps( aIm + k );
+
+            __m128 vr = _mm_sub_ps( _mm_mul_ps( xr, wr ), _mm_mul_ps( xi, wi ) );
+            __m128 vi = _mm_add_ps( _mm_mul_ps( xr, wi ), _mm_mul_ps( xi, wr ) );
+
+            _mm_storeu_ps( bRe + k, _mm_sub_ps( ur, vr ) );
+            _mm_storeu_ps( bIm + k, _mm_sub_ps( ui, vi ) );
+            _mm_storeu_ps( aRe + k, _mm_add_ps( ur, vr ) );
+            _mm_storeu_ps( aIm + k, _mm_add_ps( ui, vi ) );
+        }
+    }
+}
+
+__attribute__(( target( "sse2" ) ))
+static void magnitudeSSE( const float* re, const float* im, float* out, unsigned count, float scale )
+{
+    __m128   s = _mm_set1_ps( scale );
+    unsigned i = 0;
+
+    for( ; i + 4 <= count; i += 4 )
+    {
+        __m128 r = _mm_loadu_ps( re + i );
+        __m128 j = _mm_loadu_ps( im + i );
+
+        _mm_storeu_ps( out + i, _mm_mul_ps( _mm_sqrt_ps( _mm_add_ps( _mm_mul_ps( r, r ), _mm_mul_ps( j, j ) ) ), s ) );
+    }
+
+    magnitudeScalar( re + i, im + i, out + i, count - i, scale );
+}
+
+__attribute__(( target( "avx2,fma" ) ))
+static void stageAVX2( float* re, float* im, const float* twRe, const float* twIm, unsigned count, unsigned span )
+{
+    if( span < 8 )
+    {
+        stageSSE( re, im, twRe, twIm, count, span );
+        return;
+    }
+
+    for( unsigned block = 0; block < count; block += span * 2 )
+    {
+        float* aRe = re + block;
+        float* aIm = im + block;
+        float* bRe = aRe + span;
+        float* bIm = aIm + span;
+
+        for( unsigned k = 0; k < span; k += 8 )
+        {
+            __m256 wr = _mm256_loadu_ps( twRe + k );
+            __m256 wi = _mm256_loadu_ps( twIm + k );
+            __m256 xr = _mm256_loadu_ps( bRe + k );
+            __m256 xi = _mm256_loadu_ps( bIm + k );
+            __m256 ur = _mm256_loadu_ps( aRe + k );
+            __m256 ui = _mm256_loadu_ps( aIm + k );
+
+            __m256 vr = _mm256_fmsub_ps( xr, wr, _mm256_mul_ps( xi, wi ) );
+            __m256 vi = _mm256_fmadd_ps( xr, wi, _mm256_mul_ps( xi, wr ) );
+
+            _mm256_storeu_ps( bRe + k, _mm256_sub_ps( ur, vr ) );
+            _mm256_storeu_ps( bIm + k, _mm256_sub_ps( ui, vi ) );
+            _mm256_storeu_ps( aRe + k, _mm256_add_ps( ur, vr ) );
+            _mm256_storeu_ps( aIm + k, _mm256_add_ps( ui, vi ) );
+        }
+    }
+}
+
+__attribute__(( target( "avx2,fma" ) ))
+static void magnitudeAVX2( const float* re, const float* im, float* out, unsigned count, float scale )
+{
+    __m256   s = _mm256_set1_ps( scale );
+    unsigned i = 0;
+
+    for( ; i + 8 <= count; i += 8 )
+    {
+        __m256 r = _mm256_loadu_ps( re + i );
+        __m256 j = _mm256_loadu_ps( im + i );
+
+        _mm256_storeu_ps( out + i, _mm256_mul_ps( _mm256_sqrt_ps( _mm256_fmadd_ps( r, r, _mm256_mul_ps( j, j ) ) ), s ) );
+    }
+
+    magnitudeSSE( re + i, im + i, out + i, count - i, scale );
+}
+
+#endif
+
+//------------------------------------------------------------------------------------------
+
+FFT_KERNEL resolveKernel( FFT_KERNEL requested )
+{
+#ifdef FFT_X86
+    __builtin_cpu_init( );
+
+    bool avx2 = __builtin_cpu_supports( "avx2" ) && __builtin_cpu_supports( "fma" );
+    bool sse  = __builtin_cpu_supports( "sse2" );
+
+    if( requested == FFT_KERNEL_AUTO )
+        return ( avx2 ? FFT_KERNEL_AVX2 : ( sse ? FFT_KERNEL_SSE : FFT_KERNEL_SCALAR ) );
+
+    if( requested == FFT_KERNEL_AVX2 && !avx2 )
+        requested = FFT_KERNEL_SSE;
+
+    if( requested == FFT_KERNEL_SSE && !sse )
+        requested = FFT_KERNEL_SCALAR;
+
+    return requested;
+#else
+    ( void )requested;
+    return FFT_KERNEL_SCALAR;
+#endif
+}
+
+bool isPowerOfTwo( unsigned value )
+{
+    return value != 0 && ( value & ( value - 1 ) ) == 0;
+}
+
+//------------------------------------------------------------------------------------------
+
+std::shared_ptr< const FftPlan > FftPlan::shared( unsigned size, FFT_KERNEL kernel )
+{
+    static std::mutex                                      lock;
+    static std::vector< std::shared_ptr< const FftPlan > > plans;
+
+    FFT_KERNEL resolved = resolveKernel( kernel );
+
+    std::lock_guard< std::mutex > guard( lock );
+
+    for( unsigned i = 0; i < plans.size( ); i++ )
+    {
+        if( plans[ i ]->size( ) >= size && plans[ i ]->size( ) < 2 * std::max( size, 4u ) && plans[ i ]->kernel( ) == resolved )
+            return plans[ i ];
+    }
+
+    plans.push_back( std::make_shared< FftPlan >( size, resolved ) );
+
+    return plans.back( );
+}
+
+//------------------------------------------------------------------------------------------
+
+FftPlan::FftPlan( unsigned size, FFT_KERNEL kernel )
+{
+    // Anything that is not a power of two (or too small to split) is rounded up.
+    n = 4;
+
+    while( n < size )
+        n <<= 1;
+
+    half     = n / 2;
+    selected = resolveKernel( kernel );
+
+    //------------------------------------------------
+
+    unsigned bits = 0;
+
+    while( ( 1u << bits ) < half )
+        bits++;
+
+    reverse.resize( half );
+
+    for( unsigned i = 0; i < half; i++ )
+    {
+        unsigned r = 0;
+
+        for( unsigned b = 0; b < bits; b++ )
+            r |= ( ( i >> b ) & 1 ) << ( bits - 1 - b );
+
+        reverse[ i ] = r;
+    }
+
+    stageRe.resize( half );
+    stageIm.resize( half );
+
+    for( unsigned span = 1; span < half; span <<= 1 )
+    {
+        for( unsigned k = 0; k < span; k++ )
+        {
+            double angle = -M_PI * ( double )k / ( double )span;
+
+            stageRe[ span + k ] = ( float )cos( angle );
+            stageIm[ span + k ] = ( float )sin( angle );
+        }
+    }
+
+    splitRe.resize( half + 1 );
+    splitIm.resize( half + 1 );
+
+    for( unsigned k = 0; k <= half; k++ )
+    {
+        double angle = -2.0 * M_PI * ( double )k / ( double )n;
+
+        splitRe[ k ] = ( float )cos( angle );
+        splitIm[ k ] = ( float )sin( angle );
+    }
+}
+
+//------------------------------------------------------------------------------------------
+
+void FftPlan::complexForward( float* re, float* im ) const
+{
+    for( unsigned span = 1; span < half; span <<= 1 )
+    {
+        const float* twRe = &stageRe[ span ];
+        const float* twIm = &stageIm[ span ];
+
+        switch( selected )
+        {
+#ifdef FFT_X86
+        case FFT_KERNEL_AVX2:
+            stageAVX2( re, im, twRe, twIm, half, span );
+            break;
+        case FFT_KERNEL_SSE:
+            stageSSE( re, im, twRe, twIm, half, span );
+            break;
+#endif
+        default:
+            stageScalar( re, im, twRe, twIm, half, span );
+            break;
+        }
+    }
+}
+
+void FftPlan::forward( const float* input, float* re, float* im, float* scratch ) const
+{
+    float* zRe = scratch;
+    float* zIm = scratch + half;
+
+    // Pack even/odd samples as one complex sequence, bit reversed on the way in.
+    for( unsigned i = 0; i < half; i++ )
+    {
+        zRe[ reverse[ i ] ] = input[ 2 * i ];
+        zIm[ reverse[ i ] ] = input[ 2 * i + 1 ];
+    }
+
+    complexForward( zRe, zIm );
+
+    // Untangle the even and odd half-length spectra into the real spectrum.
+    for( unsigned k = 0; k <= half; k++ )
+    {
+        unsigned a = ( k == half ? 0 : k );
+        unsigned b = ( k == 0 ? 0 : half - k );
+
+        float eRe = 0.5f * ( zRe[ a ] + zRe[ b ] );
+        float eIm = 0.5f * ( zIm[ a ] - zIm[ b ] );
+        float oRe = 0.5f * ( zIm[ a ] + zIm[ b ] );
+        float oIm = 0.5f * ( zRe[ b ] - zRe[ a ] );
+
+        re[ k ] = eRe + oRe * splitRe[ k ] - oIm * splitIm[ k ];
+        im[ k ] = eIm + oRe * splitIm[ k ] + oIm * splitRe[ k ];
+    }
+}
+
+void FftPlan::inverse( const float* re, const float* im, float* output, float* scratch ) const
+{
+    float* zRe = scratch;
+    float* zIm = scratch + half;
+
+    // Rebuild the half-length complex spectrum, conjugated (swapping re/im) so the
+    // forward kernels compute the inverse transform.
+    for( unsigned k = 0; k < half; k++ )
+    {
+        unsigned m = half - k;
+
+        float eRe = 0.5f * ( re[ k ] + re[ m ] );
+        float eIm = 0.5f * ( im[ k ] - im[ m ] );
+        float dRe = 0.5f * ( re[ k ] - re[ m ] );
+        float dIm = 0.5f * ( im[ k ] + im[ m ] );
+
+        // o = d * conj( w^k )
+        float oRe = dRe * splitRe[ k ] + dIm * splitIm[ k ];
+        float oIm = dIm * splitRe[ k ] - dRe * splitIm[ k ];
+
+        // z = e + i o, stored swapped
+        zIm[ reverse[ k ] ] = eRe - oIm;
+        zRe[ reverse[ k ] ] = eIm + oRe;
+    }
+
+    complexForward( zRe, zIm );
+
+    float scale = 1.0f / ( float )half;
+
+    for( unsigned i = 0; i < half; i++ )
+    {
+        output[ 2 * i ]     = zIm[ i ] * scale;
+        output[ 2 * i + 1 ] = zRe[ i ] * scale;
+    }
+}
+
+void FftPlan::magnitude( const float* re, const float* im, float* out, unsigned count, float scale ) const
+{
+    switch( selected )
+    {
+#ifdef FFT_X86
+    case FFT_KERNEL_AVX2:
+        magnitudeAVX2( re, im, out, count, scale );
+        break;
+    case FFT_KERNEL_SSE:
+        magnitudeSSE( re, im, out, count, scale );
+        break;
+#endif
+    default:
+        magnitudeScalar( re, im, out, count, scale );
+        break;
+    }
+}
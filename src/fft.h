@@ -0,0 +1,82 @@
+#ifndef FFT_H
+#define FFT_H
+
+#include <memory>
+#include <vector>
+
+//------------------------------------------------------------------------------------------
+
+enum FFT_KERNEL
+{
+    FFT_KERNEL_AUTO = 0,    /* best kernel the CPU supports */
+    FFT_KERNEL_SCALAR,
+    FFT_KERNEL_SSE,
+    FFT_KERNEL_AVX2
+};
+
+/**
+ * Real-input FFT of a fixed power-of-two size.
+ *
+ * Internally a size/2 complex radix-2 transform on split re/im arrays, so every
+ * butterfly stage wider than the vector width runs through the SSE or AVX2/FMA
+ * kernels. A plan only holds read-only tables and may be shared between threads;
+ * all scratch memory is supplied by the caller.
+ */
+class FftPlan
+{
+public:
+
+    explicit FftPlan( unsigned size, FFT_KERNEL kernel = FFT_KERNEL_AUTO );
+
+    /**
+     * A process-wide plan for this size and kernel, built on first request. Analysers
+     * running the same size share one set of tables instead of one each.
+     */
+    static std::shared_ptr< const FftPlan > shared( unsigned size, FFT_KERNEL kernel = FFT_KERNEL_AUTO );
+
+    unsigned   size( ) const   { return n; }
+    unsigned   bins( ) const   { return n / 2 + 1; }
+    FFT_KERNEL kernel( ) const { return selected; }
+
+    /**
+     * size() real samples to bins() complex values.
+     * 're' and 'im' hold bins() floats, 'scratch' holds size() floats.
+     */
+    void forward( const float* input, float* re, float* im, float* scratch ) const;
+
+    /**
+     * Exact inverse of forward(): bins() complex values back to size() real samples.
+     */
+    void inverse( const float* re, const float* im, float* output, float* scratch ) const;
+
+    /**
+     * out[ i ] = |re[ i ] + j im[ i ]| * scale, using the plan's kernel.
+     */
+    void magnitude( const float* re, const float* im, float* out, unsigned count, float scale ) const;
+
+private:
+
+    void complexForward( float* re, float* im ) const;
+
+    unsigned   n;
+    unsigned   half;
+    FFT_KERNEL selected;
+
+    std::vector< unsigned > reverse;     /* bit reversal of 0..half-1 */
+    std::vector< float >    stageRe;     /* twiddles for stage 'span' live at [span, 2 * span) */
+    std::vector< float >    stageIm;
+    std::vector< float >    splitRe;     /* e^(-2 pi i k / n) for the real/complex split, k = 0..half */
+    std::vector< float >    splitIm;
+};
+
+bool isPowerOfTwo( unsigned value );
+
+/**
+ * 'requested', or the next best kernel if the CPU lacks it; the best one for AUTO.
+ * Also used by the other vector kernels (see energy_gate.h).
+ */
+FFT_KERNEL resolveKernel( FFT_KERNEL requested );
+
+//------------------------------------------------------------------------------------------
+
+#endif // FFT_H
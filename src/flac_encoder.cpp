@@ -0,0 +1,954 @@
+#include "flac_encoder.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cstdlib>
+
+//------------------------------------------------------------------------------------------
+// Bit packing and checksums
+
+static const uint32_t md5Sines[ 64 ] =
+{
+    0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+    0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+    0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+    0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+    0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+    0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+    0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+    0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+};
+
+static const unsigned md5Shifts[ 16 ] = { 7, 12, 17, 22, 5, 9, 14, 20, 4, 11, 16, 23, 6, 10, 15, 21 };
+
+static void md5Block( uint32_t state[ 4 ], const uint8_t* block )
+{
+    uint32_t m[ 16 ];
+
+    for( unsigned i = 0; i < 16; i++ )
+        m[ i ] = ( uint32_t )block[ 4 * i ] | ( uint32_t )block[ 4 * i + 1 ] << 8 | ( uint32_t )block[ 4 * i + 2 ] << 16 | ( uint32_t )block[ 4 * i + 3 ] << 24;
+
+    uint32_t a = state[ 0 ], b = state[ 1 ], c = state[ 2 ], d = state[ 3 ];
+
+    for( unsigned i = 0; i < 64; i++ )
+    {
+        uint32_t f;
+        unsigned g;
+
+        switch( i / 16 )
+        {
+        case 0:  f = ( b & c ) | ( ~b & d ); g = i;                break;
+        case 1:  f = ( d & b ) | ( ~d & c ); g = ( 5 * i + 1 ) % 16; break;
+        case 2:  f = b ^ c ^ d;              g = ( 3 * i + 5 ) % 16; break;
+        default: f = c ^ ( b | ~d );         g = ( 7 * i ) % 16;     break;
+        }
+
+        unsigned shift = md5Shifts[ ( i / 16 ) * 4 + i % 4 ];
+        uint32_t sum   = a + f + md5Sines[ i ] + m[ g ];
+
+        a = d;
+        d = c;
+        c = b;
+        b = b + ( sum << shift | sum >> ( 32 - shift ) );
+    }
+
+    state[ 0 ] += a;
+    state[ 1 ] += b;
+    state[ 2 ] += c;
+    state[ 3 ] += d;
+}
+
+void FlacMd5::reset( )
+{
+    state[ 0 ] = 0x67452301;
+    state[ 1 ] = 0xefcdab89;
+    state[ 2 ] = 0x98badcfe;
+    state[ 3 ] = 0x10325476;
+    length     = 0;
+}
+
+void FlacMd5::update( const uint8_t* data, size_t count )
+{
+    unsigned used = ( unsigned )( length % 64 );
+
+    length += count;
+
+    if( used > 0 )
+    {
+        size_t take = std::min( count, ( size_t )( 64 - used ) );
+
+        memcpy( buffer + used, data, take );
+        data  += take;
+        count -= take;
+
+        if( used + take < 64 )
+            return;
+
+        md5Block( state, buffer );
+    }
+
+    for( ; count >= 64; data += 64, count -= 64 )
+        md5Block( state, data );
+
+    memcpy( buffer, data, count );
+}
+
+void FlacMd5::digest( uint8_t out[ 16 ] ) const
+{
+    FlacMd5  tail = *this;
+    uint8_t  pad[ 72 ] = { 0x80 };
+    unsigned used      = ( unsigned )( length % 64 );
+    unsigned padding   = ( used < 56 ? 56 - used : 120 - used );
+
+    for( unsigned i = 0; i < 8; i++ )
+        pad[ padding + i ] = ( uint8_t )( ( length * 8 ) >> ( 8 * i ) );
+
+    tail.update( pad, padding + 8 );
+
+    for( unsigned i = 0; i < 16; i++ )
+        out[ i ] = ( uint8_t )( tail.state[ i / 4 ] >> ( 8 * ( i % 4 ) ) );
+}
+
+class BitWriter
+{
+public:
+
+    explicit BitWriter( std::vector< uint8_t >* out ) { this->out = out; acc = 0; count = 0; }
+
+    void put( uint32_t value, unsigned width )
+    {
+        if( width == 0 )
+            return;
+
+        uint64_t mask = ( width >= 32 ? 0xFFFFFFFFull : ( ( 1ull << width ) - 1 ) );
+
+        acc    = ( acc << width ) | ( value & mask );
+        count += width;
+
+        while( count >= 8 )
+        {
+            count -= 8;
+            out->push_back( ( uint8_t )( acc >> count ) );
+        }
+    }
+
+    void putSigned( int32_t value, unsigned width ) { put( ( uint32_t )value, width ); }
+
+    void putUnary( uint32_t zeros )
+    {
+        while( zeros >= 32 )
+        {
+            put( 0, 32 );
+            zeros -= 32;
+        }
+
+        put( 1, zeros + 1 );
+    }
+
+    void putRice( uint32_t value, unsigned k )
+    {
+        putUnary( value >> k );
+        put( value, k );
+    }
+
+    void align( )
+    {
+        if( count > 0 )
+            put( 0, 8 - count );
+    }
+
+private:
+
+    std::vector< uint8_t >* out;
+    uint64_t                acc;
+    unsigned                count;
+};
+
+struct CrcTables
+{
+    uint8_t  crc8[ 256 ];       /* x^8 + x^2 + x + 1 */
+    uint16_t crc16[ 256 ];      /* x^16 + x^15 + x^2 + 1 */
+
+    CrcTables( )
+    {
+        for( unsigned i = 0; i < 256; i++ )
+        {
+            unsigned c8  = i;
+            unsigned c16 = i << 8;
+
+            for( unsigned b = 0; b < 8; b++ )
+            {
+                c8  = ( c8 & 0x80 ? ( c8 << 1 ) ^ 0x07 : c8 << 1 ) & 0xFF;
+                c16 = ( c16 & 0x8000 ? ( c16 << 1 ) ^ 0x8005 : c16 << 1 ) & 0xFFFF;
+            }
+
+            crc8[ i ]  = ( uint8_t )c8;
+            crc16[ i ] = ( uint16_t )c16;
+        }
+    }
+};
+
+static const CrcTables crcTables;
+
+static uint8_t crc8( const uint8_t* data, size_t length )
+{
+    uint8_t crc = 0;
+
+    for( size_t i = 0; i < length; i++ )
+        crc = crcTables.crc8[ crc ^ data[ i ] ];
+
+    return crc;
+}
+
+static uint16_t crc16( const uint8_t* data, size_t length )
+{
+    uint16_t crc = 0;
+
+    for( size_t i = 0; i < length; i++ )
+        crc = ( uint16_t )( ( crc << 8 ) ^ crcTables.crc16[ ( crc >> 8 ) ^ data[ i ] ] );
+
+    return crc;
+}
+
+//------------------------------------------------------------------------------------------
+// Subframe coding
+
+/**
+ * residual[ i ] for i >= order, using the fixed polynomial predictor of that order.
+ */
+static void fixedResidual( const int32_t* x, unsigned n, unsigned order, int32_t* residual )
+{
+    switch( order )
+    {
+    case 0:
+        for( unsigned i = 0; i < n; i++ )
+            residual[ i ] = x[ i ];
+        break;
+    case 1:
+        for( unsigned i = 1; i < n; i++ )
+            residual[ i ] = x[ i ] - x[ i - 1 ];
+        break;
+    case 2:
+        for( unsigned i = 2; i < n; i++ )
+            residual[ i ] = x[ i ] - 2 * x[ i - 1 ] + x[ i - 2 ];
+        break;
+    case 3:
+        for( unsigned i = 3; i < n; i++ )
+            residual[ i ] = x[ i ] - 3 * x[ i - 1 ] + 3 * x[ i - 2 ] - x[ i - 3 ];
+        break;
+    default:
+        for( unsigned i = 4; i < n; i++ )
+            residual[ i ] = x[ i ] - 4 * x[ i - 1 ] + 6 * x[ i - 2 ] - 4 * x[ i - 3 ] + x[ i - 4 ];
+        break;
+    }
+}
+
+/**
+ * Best fixed order by total absolute residual, all five orders in one pass.
+ */
+static unsigned chooseOrder( const int32_t* x, unsigned n, uint64_t* cost )
+{
+    uint64_t total[ FLAC_MAX_FIXED_ORDER + 1 ] = { 0, 0, 0, 0, 0 };
+
+    if( n <= FLAC_MAX_FIXED_ORDER )
+    {
+        *cost = 0;
+        return 0;
+    }
+
+    int64_t e1 = ( int64_t )x[ 3 ] - x[ 2 ];
+    int64_t e2 = e1 - ( ( int64_t )x[ 2 ] - x[ 1 ] );
+    int64_t e3 = e2 - ( ( ( int64_t )x[ 2 ] - x[ 1 ] ) - ( ( int64_t )x[ 1 ] - x[ 0 ] ) );
+
+    for( unsigned i = FLAC_MAX_FIXED_ORDER; i < n; i++ )
+    {
+        int64_t e0  = x[ i ];
+        int64_t d1  = e0 - x[ i - 1 ];
+        int64_t d2  = d1 - e1;
+        int64_t d3  = d2 - e2;
+        int64_t d4  = d3 - e3;
+
+        total[ 0 ] += ( uint64_t )llabs( e0 );
+        total[ 1 ] += ( uint64_t )llabs( d1 );
+        total[ 2 ] += ( uint64_t )llabs( d2 );
+        total[ 3 ] += ( uint64_t )llabs( d3 );
+        total[ 4 ] += ( uint64_t )llabs( d4 );
+
+        e1 = d1;
+        e2 = d2;
+        e3 = d3;
+    }
+
+    unsigned best = 0;
+
+    for( unsigned o = 1; o <= FLAC_MAX_FIXED_ORDER; o++ )
+    {
+        if( total[ o ] < total[ best ] )
+            best = o;
+    }
+
+    *cost = total[ best ];
+    return best;
+}
+
+static unsigned riceParameter( uint64_t sum, unsigned count )
+{
+    unsigned k = 0;
+
+    while( k < 14 && ( ( uint64_t )count << ( k + 1 ) ) < sum )
+        k++;
+
+    return k;
+}
+
+static uint64_t riceCost( uint64_t sum, unsigned count, unsigned k )
+{
+    return 4 + ( uint64_t )count * ( k + 1 ) + ( sum >> k );
+}
+
+struct SubframeScratch
+{
+    std::vector< int32_t >  residual;
+    std::vector< uint32_t > folded;     /* zigzag residual, the unsigned Rice input */
+    std::vector< uint64_t > sums;       /* per partition, finest order first */
+};
+
+/**
+ * Writes one subframe of 'n' samples at 'bps' bits.
+ */
+static void writeSubframe( BitWriter* writer, const int32_t* x, unsigned n, unsigned bps, SubframeScratch* scratch )
+{
+    bool constant = true;
+
+    for( unsigned i = 1; i < n && constant; i++ )
+        constant = ( x[ i ] == x[ 0 ] );
+
+    if( constant )
+    {
+        writer->put( 0x00, 8 );             /* pad, SUBFRAME_CONSTANT, no wasted bits */
+        writer->putSigned( x[ 0 ], bps );
+        return;
+    }
+
+    uint64_t cost;
+    unsigned order = chooseOrder( x, n, &cost );
+
+    fixedResidual( x, n, order, &scratch->residual[ 0 ] );
+
+    for( unsigned i = order; i < n; i++ )
+    {
+        int32_t r = scratch->residual[ i ];
+        scratch->folded[ i ] = ( ( uint32_t )r << 1 ) ^ ( uint32_t )( r >> 31 );
+    }
+
+    //------------------------------------------------
+    // Partition order: finest sums first, then merge pairs upwards.
+
+    unsigned finest = 0;
+
+    while( finest < FLAC_MAX_PARTITION && ( n % ( 2u << finest ) ) == 0 && ( n >> ( finest + 1 ) ) > order )
+        finest++;
+
+    unsigned parts = 1u << finest;
+    unsigned size  = n >> finest;
+
+    for( unsigned p = 0; p < parts; p++ )
+    {
+        uint64_t sum = 0;
+
+        for( unsigned i = ( p == 0 ? order : p * size ); i < ( p + 1 ) * size; i++ )
+            sum += scratch->folded[ i ];
+
+        scratch->sums[ p ] = sum;
+    }
+
+    unsigned bestPartition = finest;
+    uint64_t bestBits      = ~0ull;
+
+    std::vector< uint64_t >& sums = scratch->sums;
+
+    for( int level = ( int )finest; level >= 0; level-- )
+    {
+        unsigned levelParts = 1u << level;
+        unsigned levelSize  = n >> level;
+        uint64_t bits       = 0;
+
+        for( unsigned p = 0; p < levelParts; p++ )
+        {
+            unsigned count = levelSize - ( p == 0 ? order : 0 );
+            bits += riceCost( sums[ p ], count, riceParameter( sums[ p ], count ) );
+        }
+
+        if( bits < bestBits )
+        {
+            bestBits      = bits;
+            bestPartition = level;
+        }
+
+        // Merge to the next coarser level in place.
+        for( unsigned p = 0; p < levelParts / 2; p++ )
+            sums[ p ] = sums[ 2 * p ] + sums[ 2 * p + 1 ];
+    }
+
+    // Rebuild the chosen level's sums (the merge above overwrote them).
+    unsigned chosenParts = 1u << bestPartition;
+    unsigned chosenSize  = n >> bestPartition;
+
+    for( unsigned p = 0; p < chosenParts; p++ )
+    {
+        uint64_t sum = 0;
+
+        for( unsigned i = ( p == 0 ? order : p * chosenSize ); i < ( p + 1 ) * chosenSize; i++ )
+            sum += scratch->folded[ i ];
+
+        sums[ p ] = sum;
+    }
+
+    //------------------------------------------------
+
+    if( 8 + order * bps + 6 + bestBits >= ( uint64_t )n * bps )
+    {
+        writer->put( 0x02, 8 );             /* SUBFRAME_VERBATIM */
+
+        for( unsigned i = 0; i < n; i++ )
+            writer->putSigned( x[ i ], bps );
+
+        return;
+    }
+
+    writer->put( ( 0x08 | order ) << 1, 8 );    /* SUBFRAME_FIXED */
+
+    for( unsigned i = 0; i < order; i++ )
+        writer->putSigned( x[ i ], bps );
+
+    writer->put( 0, 2 );                    /* RESIDUAL_CODING_METHOD_PARTITIONED_RICE */
+    writer->put( bestPartition, 4 );
+
+    for( unsigned p = 0; p < chosenParts; p++ )
+    {
+        unsigned begin = ( p == 0 ? order : p * chosenSize );
+        unsigned end   = ( p + 1 ) * chosenSize;
+        unsigned k     = riceParameter( sums[ p ], end - begin );
+
+        writer->put( k, 4 );
+
+        for( unsigned i = begin; i < end; i++ )
+            writer->putRice( scratch->folded[ i ], k );
+    }
+}
+
+//------------------------------------------------------------------------------------------
+// Frames
+
+static void writeUtf8( BitWriter* writer, unsigned long long value )
+{
+    if( value < 0x80 )
+    {
+        writer->put( ( uint32_t )value, 8 );
+        return;
+    }
+
+    unsigned extra = 1;
+
+    while( extra < 6 && value >= ( 1ull << ( 6 * extra + 6 - extra ) ) )
+        extra++;
+
+    unsigned lead = ( 0xFF00u >> ( extra + 1 ) ) & 0xFF;
+
+    writer->put( lead | ( uint32_t )( value >> ( 6 * extra ) ), 8 );
+
+    for( int i = ( int )extra - 1; i >= 0; i-- )
+        writer->put( 0x80 | ( uint32_t )( ( value >> ( 6 * i ) ) & 0x3F ), 8 );
+}
+
+static unsigned blockSizeCode( unsigned frames )
+{
+    for( unsigned code = 8; code <= 15; code++ )
+    {
+        if( frames == ( 256u << ( code - 8 ) ) )
+            return code;
+    }
+
+    return 7;                               /* 16 bit (size - 1) after the header */
+}
+
+static unsigned sampleRateCode( int rate )
+{
+    switch( rate )
+    {
+    case 88200:  return 1;
+    case 176400: return 2;
+    case 192000: return 3;
+    case 8000:   return 4;
+    case 16000:  return 5;
+    case 22050:  return 6;
+    case 24000:  return 7;
+    case 32000:  return 8;
+    case 44100:  return 9;
+    case 48000:  return 10;
+    case 96000:  return 11;
+    default:     return 0;                  /* from STREAMINFO */
+    }
+}
+
+static unsigned sampleSizeCode( int bits )
+{
+    switch( bits )
+    {
+    case 8:  return 1;
+    case 12: return 2;
+    case 16: return 4;
+    case 20: return 5;
+    case 24: return 6;
+    default: return 0;
+    }
+}
+
+/**
+ * One complete FLAC frame for 'frames' interleaved samples.
+ */
+static void encodeFrame( const int32_t* interleaved, unsigned frames, int channels, int bits, int rate,
+                         unsigned long long number, std::vector< uint8_t >* out )
+{
+    SubframeScratch        scratch;
+    std::vector< int32_t > planes( ( size_t )frames * ( channels + 1 ) );
+
+    scratch.residual.resize( frames );
+    scratch.folded.resize( frames );
+    scratch.sums.resize( 1u << FLAC_MAX_PARTITION );
+
+    for( int c = 0; c < channels; c++ )
+    {
+        int32_t* plane = &planes[ ( size_t )c * frames ];
+
+        for( unsigned i = 0; i < frames; i++ )
+            plane[ i ] = interleaved[ ( size_t )i * channels + c ];
+    }
+
+    //------------------------------------------------
+    // Stereo decorrelation: pick the cheapest pair by estimated residual.
+
+    unsigned assignment = channels - 1;     /* independent */
+    int32_t* side       = 0;
+
+    if( channels == 2 )
+    {
+        int32_t* left  = &planes[ 0 ];
+        int32_t* right = &planes[ frames ];
+        side           = &planes[ 2 * ( size_t )frames ];
+
+        std::vector< int32_t > mid( frames );
+
+        for( unsigned i = 0; i < frames; i++ )
+        {
+            side[ i ] = left[ i ] - right[ i ];
+            mid[ i ]  = ( left[ i ] + right[ i ] ) >> 1;
+        }
+
+        uint64_t l, r, s, m;
+
+        chooseOrder( left, frames, &l );
+        chooseOrder( right, frames, &r );
+        chooseOrder( side, frames, &s );
+        chooseOrder( &mid[ 0 ], frames, &m );
+
+        uint64_t best = l + r;
+
+        if( l + s < best ) { best = l + s; assignment = 8; }
+        if( r + s < best ) { best = r + s; assignment = 9; }
+        if( m + s < best ) { best = m + s; assignment = 10; }
+
+        if( assignment == 10 )
+            memcpy( left, &mid[ 0 ], frames * sizeof( int32_t ) );
+    }
+
+    //------------------------------------------------
+
+    out->clear( );
+    out->reserve( ( size_t )frames * channels * bits / 8 / 2 + 64 );
+
+    BitWriter writer( out );
+    unsigned  sizeCode = blockSizeCode( frames );
+
+    writer.put( 0xFFF8, 16 );               /* sync, reserved, fixed block size */
+    writer.put( sizeCode, 4 );
+    writer.put( sampleRateCode( rate ), 4 );
+    writer.put( assignment, 4 );
+    writer.put( sampleSizeCode( bits ), 3 );
+    writer.put( 0, 1 );
+    writeUtf8( &writer, number );
+
+    if( sizeCode == 7 )
+        writer.put( frames - 1, 16 );
+
+    writer.put( crc8( &( *out )[ 0 ], out->size( ) ), 8 );
+
+    switch( assignment )
+    {
+    case 8:     /* left, side */
+        writeSubframe( &writer, &planes[ 0 ], frames, bits, &scratch );
+        writeSubframe( &writer, side, frames, bits + 1, &scratch );
+        break;
+    case 9:     /* side, right */
+        writeSubframe( &writer, side, frames, bits + 1, &scratch );
+        writeSubframe( &writer, &planes[ frames ], frames, bits, &scratch );
+        break;
+    case 10:    /* mid, side */
+        writeSubframe( &writer, &planes[ 0 ], frames, bits, &scratch );
+        writeSubframe( &writer, side, frames, bits + 1, &scratch );
+        break;
+    default:
+        for( int c = 0; c < channels; c++ )
+            writeSubframe( &writer, &planes[ ( size_t )c * frames ], frames, bits, &scratch );
+        break;
+    }
+
+    writer.align( );
+
+    uint16_t crc = crc16( &( *out )[ 0 ], out->size( ) );
+    writer.put( crc, 16 );
+}
+
+//------------------------------------------------------------------------------------------
+
+FlacEncoder::FlacEncoder( unsigned threads )
+    : pool( threads )
+{
+    fp          = 0;
+    rate        = 0;
+    channels    = 0;
+    bits        = 0;
+    input       = FMOD_SOUND_FORMAT_NONE;
+    inputBytes  = 0;
+    fill        = 0;
+    frameNumber = 0;
+    samples     = 0;
+    bytes       = 0;
+    minFrame    = 0;
+    maxFrame    = 0;
+}
+
+FlacEncoder::~FlacEncoder( )
+{
+    close( );
+}
+
+//------------------------------------------------------------------------------------------
+
+STATUS FlacEncoder::open( const char* file_name, int rate, int channels, FMOD_SOUND_FORMAT format )
+{
+    if( file_name == 0 )
+    {
+        DEBUG_OUT( "file_name == NULL" );
+        return PARAM_NULL_PASSED;
+    }
+
+    close( );
+
+    if( channels < 1 || channels > 8 || rate <= 0 || rate >= ( 1 << 20 ) )
+    {
+        DEBUG_OUT( "FLAC supports 1-8 channels below 1 MHz" );
+        return PARAM_NULL_PASSED;
+    }
+
+    switch( format )
+    {
+    case FMOD_SOUND_FORMAT_PCM8:  bits = 8;  inputBytes = 1; break;
+    case FMOD_SOUND_FORMAT_PCM16: bits = 16; inputBytes = 2; break;
+    case FMOD_SOUND_FORMAT_PCM24: bits = 24; inputBytes = 3; break;
+    case FMOD_SOUND_FORMAT_PCM32: bits = 24; inputBytes = 4; break;
+    case FMOD_SOUND_FORMAT_PCMFLOAT: bits = 24; inputBytes = 4; break;
+    default:
+        DEBUG_OUT( "Unsupported sample format for FLAC" );
+        return PARAM_NULL_PASSED;
+    }
+
+    fp = fopen( file_name, "wb" );
+
+    if( fp == 0 )
+    {
+        DEBUG_OUT( "Unable to open FLAC file" );
+        DEBUG_OUT( file_name );
+        return FILE_OPEN_FAILED;
+    }
+
+    this->rate     = rate;
+    this->channels = channels;
+    this->input    = format;
+    inputBytes    *= channels;
+
+    unsigned blocks = pool.size( ) * FLAC_BLOCKS_PER_THREAD;
+
+    pending.assign( ( size_t )blocks * FLAC_BLOCK_SIZE * channels, 0 );
+    encoded.resize( blocks );
+    md5.reset( );
+
+    fill        = 0;
+    frameNumber = 0;
+    samples     = 0;
+    bytes       = 0;
+    minFrame    = 0;
+    maxFrame    = 0;
+
+    writeStreamInfo( );
+
+    return ( ferror( fp ) ? FILE_WRITE_FAILED : OK );
+}
+
+//------------------------------------------------------------------------------------------
+
+STATUS FlacEncoder::write( const void* data, unsigned frames )
+{
+    if( fp == 0 || data == 0 )
+    {
+        DEBUG_OUT( "FLAC encoder not open or data == NULL" );
+        return PARAM_NULL_PASSED;
+    }
+
+    const uint8_t* in       = ( const uint8_t* )data;
+    unsigned       capacity = ( unsigned )( pending.size( ) / channels );
+
+    while( frames > 0 )
+    {
+        unsigned take   = std::min( frames, capacity - fill );
+        unsigned values = take * channels;
+        int32_t* out    = &pending[ ( size_t )fill * channels ];
+
+        switch( input )
+        {
+        case FMOD_SOUND_FORMAT_PCM8:
+            for( unsigned i = 0; i < values; i++ )
+                out[ i ] = ( int8_t )in[ i ];       /* FMOD PCM8 is signed */
+            break;
+        case FMOD_SOUND_FORMAT_PCM16:
+            for( unsigned i = 0; i < values; i++ )
+            {
+                int16_t v;
+                memcpy( &v, in + 2 * i, sizeof( v ) );
+                out[ i ] = v;
+            }
+            break;
+        case FMOD_SOUND_FORMAT_PCM24:
+            for( unsigned i = 0; i < values; i++ )
+            {
+                const uint8_t* b = in + 3 * i;
+                out[ i ] = ( int32_t )( ( uint32_t )b[ 0 ] << 8 | ( uint32_t )b[ 1 ] << 16 | ( uint32_t )b[ 2 ] << 24 ) >> 8;
+            }
+            break;
+        case FMOD_SOUND_FORMAT_PCM32:
+            for( unsigned i = 0; i < values; i++ )
+            {
+                int32_t v;
+                memcpy( &v, in + 4 * i, sizeof( v ) );
+                out[ i ] = v >> 8;
+            }
+            break;
+        default:
+            for( unsigned i = 0; i < values; i++ )
+            {
+                float v;
+                memcpy( &v, in + 4 * i, sizeof( v ) );
+                out[ i ] = ( int32_t )lrintf( std::max( -1.0f, std::min( 1.0f, v ) ) * 8388607.0f );
+            }
+            break;
+        }
+
+        in     += ( size_t )take * inputBytes;
+        frames -= take;
+        fill   += take;
+
+        if( fill == capacity )
+        {
+            STATUS status = encode( fill );
+
+            if( status != OK )
+                return status;
+        }
+    }
+
+    return OK;
+}
+
+/**
+ * Encodes the first 'frames' buffered frames (whole blocks, except at close) on the
+ * pool and appends them to the file in order.
+ */
+STATUS FlacEncoder::encode( unsigned frames )
+{
+    if( frames == 0 )
+        return OK;
+
+    TRACE_SCOPE( TRACE_LEVEL_INFO, "FlacEncoder::encode" );
+
+    unsigned blocks = ( frames + FLAC_BLOCK_SIZE - 1 ) / FLAC_BLOCK_SIZE;
+
+    pool.parallelFor( blocks, [ & ]( unsigned b )
+    {
+        unsigned first = b * FLAC_BLOCK_SIZE;
+        unsigned count = std::min( ( unsigned )FLAC_BLOCK_SIZE, frames - first );
+
+        encodeFrame( &pending[ ( size_t )first * channels ], count, channels, bits, rate, frameNumber + b, &encoded[ b ] );
+    } );
+
+    for( unsigned b = 0; b < blocks; b++ )
+    {
+        unsigned size = ( unsigned )encoded[ b ].size( );
+
+        if( fwrite( &encoded[ b ][ 0 ], 1, size, fp ) != size )
+        {
+            DEBUG_OUT( "FLAC write failed" );
+            return FILE_WRITE_FAILED;
+        }
+
+        minFrame = ( minFrame == 0 ? size : std::min( minFrame, size ) );
+        maxFrame = std::max( maxFrame, size );
+        bytes   += size;
+    }
+
+    // The signature covers the samples as little-endian signed integers, bits / 8 bytes each.
+    const int32_t* values = &pending[ 0 ];
+    size_t         count  = ( size_t )frames * channels;
+    unsigned       width  = bits / 8;
+    uint8_t        chunk[ 3 * 1024 ];
+
+    for( size_t done = 0; done < count; )
+    {
+        size_t take = std::min( count - done, ( size_t )1024 );
+
+        for( size_t i = 0; i < take; i++ )
+        {
+            for( unsigned b = 0; b < width; b++ )
+                chunk[ i * width + b ] = ( uint8_t )( values[ done + i ] >> ( 8 * b ) );
+        }
+
+        md5.update( chunk, take * width );
+        done += take;
+    }
+
+    frameNumber += blocks;
+    samples     += frames;
+
+    // Keep any partial block for the next call.
+    unsigned rest = fill - frames;
+
+    if( rest > 0 )
+        memmove( &pending[ 0 ], &pending[ ( size_t )frames * channels ], ( size_t )rest * channels * sizeof( int32_t ) );
+
+    fill = rest;
+
+    return OK;
+}
+
+STATUS FlacEncoder::sync( )
+{
+    if( fp == 0 )
+        return OK;
+
+    STATUS status = encode( fill - fill % FLAC_BLOCK_SIZE );
+
+    writeStreamInfo( );
+    fflush( fp );
+
+    return status;
+}
+
+STATUS FlacEncoder::close( )
+{
+    if( fp == 0 )
+        return OK;
+
+    STATUS status = encode( fill );
+
+    writeStreamInfo( );
+
+    if( fclose( fp ) != 0 && status == OK )
+        status = FILE_WRITE_FAILED;
+
+    fp = 0;
+
+    return status;
+}
+
+//------------------------------------------------------------------------------------------
+
+/**
+ * "fLaC" and the STREAMINFO block, written at the start of the file and rewritten in
+ * place whenever the totals change.
+ */
+void FlacEncoder::writeStreamInfo( )
+{
+    std::vector< uint8_t > header;
+    BitWriter              writer( &header );
+
+    writer.put( 0x664C6143, 32 );           /* "fLaC" */
+    writer.put( 1, 1 );                     /* last metadata block */
+    writer.put( 0, 7 );                     /* STREAMINFO */
+    writer.put( 34, 24 );
+
+    writer.put( FLAC_BLOCK_SIZE, 16 );
+    writer.put( FLAC_BLOCK_SIZE, 16 );
+    writer.put( minFrame, 24 );
+    writer.put( maxFrame, 24 );
+    writer.put( rate, 20 );
+    writer.put( channels - 1, 3 );
+    writer.put( bits - 1, 5 );
+    writer.put( ( uint32_t )( samples >> 32 ), 4 );
+    writer.put( ( uint32_t )samples, 32 );
+
+    uint8_t digest[ 16 ];
+    md5.digest( digest );
+
+    for( unsigned i = 0; i < 16; i++ )
+        writer.put( digest[ i ], 8 );
+
+    off_t end = ftello( fp );
+
+    fseeko( fp, 0, SEEK_SET );
+    fwrite( &header[ 0 ], 1, header.size( ), fp );
+
+    if( end > ( off_t )header.size( ) )
+        fseeko( fp, end, SEEK_SET );
+}
+
+//------------------------------------------------------------------------------------------
+
+STATUS SaveToFlac( FMOD::Sound* sound, const char* file_name, unsigned threads )
+{
+    if( sound == 0 || file_name == 0 )
+    {
+        DEBUG_OUT( "sound or file_name == NULL" );
+        return PARAM_NULL_PASSED;
+    }
+
+    FMOD_SOUND_FORMAT format;
+    int               channels, bits;
+    float             rate;
+    unsigned          length;
+
+    sound->getFormat( 0, &format, &channels, &bits );
+    sound->getDefaults( &rate, 0, 0, 0 );
+    sound->getLength( &length, FMOD_TIMEUNIT_PCMBYTES );
+
+    FlacEncoder encoder( threads );
+    STATUS      status = encoder.open( file_name, ( int )rate, channels, format );
+
+    if( status != OK )
+        return status;
+
+    void     *ptr1, *ptr2;
+    unsigned  len1, len2;
+
+    if( sound->lock( 0, length, &ptr1, &ptr2, &len1, &len2 ) != FMOD_OK )
+        return SOUND_LOCK_FAILED;
+
+    unsigned frameBytes = channels * bits / 8;
+
+    status = encoder.write( ptr1, len1 / frameBytes );
+    sound->unlock( ptr1, ptr2, len1, len2 );
+
+    STATUS closed = encoder.close( );
+
+    return ( status != OK ? status : closed );
+}
@@ -0,0 +1,116 @@
+#ifndef FLAC_ENCODER_H
+#define FLAC_ENCODER_H
+
+#include "fmod_resources.h"
+#include "thread_pool.h"
+
+#include <cstdio>
+#include <stdint.h>
+#include <vector>
+
+//------------------------------------------------------------------------------------------
+
+#define FLAC_BLOCK_SIZE         4096    /* samples per channel per frame */
+#define FLAC_MAX_FIXED_ORDER    4
+#define FLAC_MAX_PARTITION      8       /* largest Rice partition order tried */
+#define FLAC_BLOCKS_PER_THREAD  4       /* frames buffered per pool thread before encoding */
+
+/**
+ * Running MD5, for the STREAMINFO signature of the unencoded samples.
+ */
+struct FlacMd5
+{
+    FlacMd5( ) { reset( ); }
+
+    void reset( );
+    void update( const uint8_t* data, size_t count );
+
+    /**
+     * Digest of everything so far; more data may still follow.
+     */
+    void digest( uint8_t out[ 16 ] ) const;
+
+    uint32_t           state[ 4 ];
+    unsigned long long length;
+    uint8_t            buffer[ 64 ];
+};
+
+/**
+ * Lossless FLAC writer for interleaved FMOD PCM.
+ *
+ * Each FLAC frame is independent, so buffered blocks are encoded side by side on a
+ * ThreadPool and then written in frame order. Frames use the fixed polynomial
+ * predictors (order 0-4, chosen per subframe), partitioned Rice coding of the
+ * residual, and for stereo whichever of left/right, left/side, right/side or mid/side
+ * is cheapest; constant and incompressible subframes fall back to CONSTANT/VERBATIM.
+ *
+ * PCM8 and PCM16 are stored exactly. PCM24 is exact as well; PCM32 and float are
+ * stored as 24 bit, the most common decoders accept. STREAMINFO (total samples and
+ * frame sizes and the MD5 of the samples encoded so far) is rewritten on sync( ) and
+ * close( ).
+ */
+class FlacEncoder
+{
+public:
+
+    /**
+     * 'threads' as for ThreadPool; 0 uses every hardware thread.
+     */
+    explicit FlacEncoder( unsigned threads = 0 );
+    ~FlacEncoder( );
+
+    STATUS open( const char* file_name, int rate, int channels, FMOD_SOUND_FORMAT format );
+
+    /**
+     * 'frames' interleaved frames in the format given to open( ).
+     */
+    STATUS write( const void* data, unsigned frames );
+
+    /**
+     * Encodes every complete block buffered so far, refreshes STREAMINFO and flushes,
+     * so a crash afterwards leaves a decodable file.
+     */
+    STATUS sync( );
+
+    STATUS close( );
+
+    bool               isOpen( ) const         { return fp != 0; }
+    unsigned long long samplesWritten( ) const { return samples; }
+    unsigned long long bytesWritten( ) const   { return bytes; }
+
+private:
+
+    FlacEncoder( const FlacEncoder& );
+    FlacEncoder& operator=( const FlacEncoder& );
+
+    STATUS encode( unsigned frames );
+    void   writeStreamInfo( );
+
+    FILE*             fp;
+    int               rate;
+    int               channels;
+    int               bits;             /* bits per sample in the stream */
+    FMOD_SOUND_FORMAT input;
+    unsigned          inputBytes;       /* bytes per interleaved input frame */
+
+    ThreadPool                              pool;
+    std::vector< int32_t >                  pending;    /* interleaved, converted */
+    unsigned                                fill;       /* frames in 'pending' */
+    std::vector< std::vector< uint8_t > >   encoded;    /* one FLAC frame per block */
+
+    unsigned long long frameNumber;
+    unsigned long long samples;
+    unsigned long long bytes;
+    unsigned           minFrame;
+    unsigned           maxFrame;
+    FlacMd5            md5;
+};
+
+/**
+ * SaveToWav's counterpart: writes a whole sound as FLAC.
+ */
+STATUS SaveToFlac( FMOD::Sound* sound, const char* file_name, unsigned threads = 0 );
+
+//------------------------------------------------------------------------------------------
+
+#endif // FLAC_ENCODER_H
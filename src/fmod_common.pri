@@ -0,0 +1,64 @@
+#-------------------------------------------------
+#
+# Settings shared by every target that links
+# against fmod_resources.
+#
+#-------------------------------------------------
+
+QMAKE_CXXFLAGS += -std=c++14 -pthread
+
+# 64-bit off_t for fseeko/ftello, so WAV and FLAC sizes past 2 GB
+# stay exact on 32-bit builds too.
+DEFINES += _FILE_OFFSET_BITS=64
+
+LIBS += -L/share/users/ssell/Desktop/fmodapi44203linux64/api/lib \
+        -lfmodex64 \
+        -lpthread
+
+INCLUDEPATH += /share/users/ssell/Desktop/fmodapi44203linux64/api/inc \
+               $$PWD
+
+#-------------------------------------------------
+#-------------------------------------------------
+
+SOURCES += $$PWD/fmod_resources.cpp \
+    $$PWD/fft.cpp \
+    $$PWD/stft.cpp \
+    $$PWD/pitch_estimator.cpp \
+    $$PWD/capture_writer.cpp \
+    $$PWD/mapped_file.cpp \
+    $$PWD/analysis_worker.cpp \
+    $$PWD/trace.cpp \
+    $$PWD/audio_engine.cpp \
+    $$PWD/driver_table.cpp \
+    $$PWD/thread_pool.cpp \
+    $$PWD/pitch_detector.cpp \
+    $$PWD/flac_encoder.cpp \
+    $$PWD/note_segmenter.cpp \
+    $$PWD/waveform_pyramid.cpp \
+    $$PWD/dsp_tap.cpp \
+    $$PWD/energy_gate.cpp \
+    $$PWD/resampler.cpp \
+    $$PWD/constant_q.cpp
+
+HEADERS += $$PWD/fmod_resources.h \
+    $$PWD/fft.h \
+    $$PWD/stft.h \
+    $$PWD/pitch_estimator.h \
+    $$PWD/capture_writer.h \
+    $$PWD/mapped_file.h \
+    $$PWD/analysis_worker.h \
+    $$PWD/spsc_ring.h \
+    $$PWD/trace.h \
+    $$PWD/tuning.h \
+    $$PWD/audio_engine.h \
+    $$PWD/driver_table.h \
+    $$PWD/thread_pool.h \
+    $$PWD/pitch_detector.h \
+    $$PWD/flac_encoder.h \
+    $$PWD/note_segmenter.h \
+    $$PWD/waveform_pyramid.h \
+    $$PWD/dsp_tap.h \
+    $$PWD/energy_gate.h \
+    $$PWD/resampler.h \
+    $$PWD/constant_q.h
@@ -1,43 +1,23 @@
 #include "fmod_resources.h"
+#include "tuning.h"
+#include "mapped_file.h"
+#include "trace.h"
 #include <iostream>
 #include <cstring>
 #include <cstdlib>
 #include <cstdio>
+#include <algorithm>
 #include <cmath>
 
-static const char *note[120] =
-{
-    "C 0", "C#0", "D 0", "D#0", "E 0", "F 0", "F#0", "G 0", "G#0", "A 0", "A#0", "B 0",
-    "C 1", "C#1", "D 1", "D#1", "E 1", "F 1", "F#1", "G 1", "G#1", "A 1", "A#1", "B 1",
-    "C 2", "C#2", "D 2", "D#2", "E 2", "F 2", "F#2", "G 2", "G#2", "A 2", "A#2", "B 2",
-    "C 3", "C#3", "D 3", "D#3", "E 3", "F 3", "F#3", "G 3", "G#3", "A 3", "A#3", "B 3",
-    "C 4", "C#4", "D 4", "D#4", "E 4", "F 4", "F#4", "G 4", "G#4", "A 4", "A#4", "B 4",
-    "C 5", "C#5", "D 5", "D#5", "E 5", "F 5", "F#5", "G 5", "G#5", "A 5", "A#5", "B 5",
-    "C 6", "C#6", "D 6", "D#6", "E 6", "F 6", "F#6", "G 6", "G#6", "A 6", "A#6", "B 6",
-    "C 7", "C#7", "D 7", "D#7", "E 7", "F 7", "F#7", "G 7", "G#7", "A 7", "A#7", "B 7",
-    "C 8", "C#8", "D 8", "D#8", "E 8", "F 8", "F#8", "G 8", "G#8", "A 8", "A#8", "B 8",
-    "C 9", "C#9", "D 9", "D#9", "E 9", "F 9", "F#9", "G 9", "G#9", "A 9", "A#9", "B 9"
-};
-
-static const float notefreq[120] =
-{
-      16.35f,   17.32f,   18.35f,   19.45f,    20.60f,    21.83f,    23.12f,    24.50f,    25.96f,    27.50f,    29.14f,    30.87f,
-      32.70f,   34.65f,   36.71f,   38.89f,    41.20f,    43.65f,    46.25f,    49.00f,    51.91f,    55.00f,    58.27f,    61.74f,
-      65.41f,   69.30f,   73.42f,   77.78f,    82.41f,    87.31f,    92.50f,    98.00f,   103.83f,   110.00f,   116.54f,   123.47f,
-     130.81f,  138.59f,  146.83f,  155.56f,   164.81f,   174.61f,   185.00f,   196.00f,   207.65f,   220.00f,   233.08f,   246.94f,
-     261.63f,  277.18f,  293.66f,  311.13f,   329.63f,   349.23f,   369.99f,   392.00f,   415.30f,   440.00f,   466.16f,   493.88f,
-     523.25f,  554.37f,  587.33f,  622.25f,   659.26f,   698.46f,   739.99f,   783.99f,   830.61f,   880.00f,   932.33f,   987.77f,
-    1046.50f, 1108.73f, 1174.66f, 1244.51f,  1318.51f,  1396.91f,  1479.98f,  1567.98f,  1661.22f,  1760.00f,  1864.66f,  1975.53f,
-    2093.00f, 2217.46f, 2349.32f, 2489.02f,  2637.02f,  2793.83f,  2959.96f,  3135.96f,  3322.44f,  3520.00f,  3729.31f,  3951.07f,
-    4186.01f, 4434.92f, 4698.64f, 4978.03f,  5274.04f,  5587.65f,  5919.91f,  6271.92f,  6644.87f,  7040.00f,  7458.62f,  7902.13f,
-    8372.01f, 8869.84f, 9397.27f, 9956.06f, 10548.08f, 11175.30f, 11839.82f, 12543.85f, 13289.75f, 14080.00f, 14917.24f, 15804.26f
-};
-
 //------------------------------------------------------------------------------------------
 
+/**
+ * Errors go to stderr without flushing stdout, and leave a marker in the trace.
+ */
 void DEBUG_OUT( const char* str )
 {
-    std::cout << "ERROR: " << str << std::endl;
+    TRACE_INSTANT( TRACE_LEVEL_ERROR, "error" );
+    fprintf( stderr, "ERROR: %s\n", str );
 }
 
 //------------------------------------------------------------------------------------------
@@ -67,7 +47,7 @@ STATUS fmodSetup( FMOD::System** system )
     return OK;
 }
 
-STATUS fmodSystemInit( FMOD::System* system )
+STATUS fmodSystemInit( FMOD::System* system, FMOD_INITFLAGS flags )
 {
     if( system == 0 )
     {
@@ -93,7 +73,7 @@ STATUS fmodSystemInit( FMOD::System* system )
     //------------------------------------------------
     // Initialize the System
 
-    result = system->init( MAX_NUM_CHANNELS, FMOD_INIT_NORMAL, 0 );
+    result = system->init( MAX_NUM_CHANNELS, flags, 0 );
 
     if( result != FMOD_OK )
     {
@@ -106,7 +86,7 @@ STATUS fmodSystemInit( FMOD::System* system )
 
 //------------------------------------------------------------------------------------------
 
-STATUS fmodCreateSound( FMOD::System* system, FMOD::Sound** sound, unsigned max_length )
+STATUS fmodCreateSound( FMOD::System* system, FMOD::Sound** sound, unsigned max_length, const CaptureFormat* format )
 {
     if( system == 0 )
     {
@@ -116,14 +96,22 @@ STATUS fmodCreateSound( FMOD::System* system, FMOD::Sound** sound, unsigned max_
 
     FMOD_RESULT result;
 
+    // Without a negotiated format, what the analysis uses: mono PCM16 at OUTPUTRATE.
+    CaptureFormat capture = { OUTPUTRATE, 1, FMOD_SOUND_FORMAT_PCM16 };
+
+    if( format != 0 )
+        capture = *format;
+
+    unsigned sampleBytes = ( capture.format == FMOD_SOUND_FORMAT_PCMFLOAT ? sizeof( float ) : sizeof( short ) );
+
     FMOD_CREATESOUNDEXINFO exInfo;
     memset( &exInfo, 0, sizeof( FMOD_CREATESOUNDEXINFO ) );
 
     exInfo.cbsize           = sizeof( FMOD_CREATESOUNDEXINFO );
-    exInfo.numchannels      = 3;
-    exInfo.format           = FMOD_SOUND_FORMAT_PCM16;
-    exInfo.defaultfrequency = 44100;
-    exInfo.length           = exInfo.defaultfrequency * sizeof( short ) * exInfo.numchannels * max_length;
+    exInfo.numchannels      = capture.channels;
+    exInfo.format           = capture.format;
+    exInfo.defaultfrequency = capture.rate;
+    exInfo.length           = exInfo.defaultfrequency * sampleBytes * exInfo.numchannels * max_length;
 
     result = system->createSound( 0, FMOD_2D | FMOD_SOFTWARE | FMOD_OPENUSER, &exInfo, sound );
 
@@ -140,15 +128,81 @@ STATUS fmodCreateSound( FMOD::System* system, FMOD::Sound** sound, unsigned max_
     return OK;
 }
 
+/**
+ * Picks a capture format the record driver supports. The rate is the software mixer's
+ * if the driver can record at it (so playback and analysis need no resampling),
+ * otherwise the nearest rate the driver reports. Samples are float when the driver
+ * delivers float, PCM16 otherwise. 'channels' is what the caller will analyse and is
+ * limited to stereo on drivers without multichannel support.
+ */
+STATUS fmodGetCaptureFormat( FMOD::System* system, int record_driver, CaptureFormat* format, int channels )
+{
+    if( system == 0 || format == 0 )
+    {
+        DEBUG_OUT( "system or format == NULL" );
+        return PARAM_NULL_PASSED;
+    }
+
+    format->rate     = OUTPUTRATE;
+    format->channels = std::max( 1, channels );
+    format->format   = FMOD_SOUND_FORMAT_PCM16;
+
+    int mixer = OUTPUTRATE;
+    system->getSoftwareFormat( &mixer, 0, 0, 0, 0, 0 );
+
+    FMOD_CAPS   caps     = FMOD_CAPS_NONE;
+    int         min_rate = 0;
+    int         max_rate = 0;
+    FMOD_RESULT result   = system->getRecordDriverCaps( record_driver, &caps, &min_rate, &max_rate );
+
+    if( result != FMOD_OK )
+    {
+        DEBUG_OUT( FMOD_ErrorString( result ) );
+        format->rate = mixer;
+        return DRIVER_FETCH_FAILED;
+    }
+
+    if( max_rate <= 0 )
+        format->rate = mixer;
+    else
+        format->rate = std::min( std::max( mixer, min_rate ), max_rate );
+
+    if( caps & FMOD_CAPS_OUTPUT_FORMAT_PCMFLOAT )
+        format->format = FMOD_SOUND_FORMAT_PCMFLOAT;
+
+    if( !( caps & FMOD_CAPS_OUTPUT_MULTICHANNEL ) )
+        format->channels = std::min( format->channels, 2 );
+
+    return OK;
+}
+
+/**
+ * Width in Hz of one Channel::getSpectrum bin, from the mixer's actual rate.
+ */
+float fmodSpectrumBinSize( FMOD::System* system, unsigned bins )
+{
+    int rate = OUTPUTRATE;
+
+    if( system != 0 )
+        system->getSoftwareFormat( &rate, 0, 0, 0, 0, 0 );
+
+    return ( ( float )rate / 2.0f ) / ( float )std::max( 1u, bins );
+}
+
 //------------------------------------------------------------------------------------------
 
+/**
+ * Opens a sound file as a sample. The file is mmap'd and handed to FMOD with
+ * FMOD_OPENMEMORY_POINT, so neither we nor FMOD copy it; the mapping lives in the
+ * sound's user data until fmodReleaseSound. If the file cannot be mapped, or FMOD
+ * cannot use it in place (compressed formats, PCM8), FMOD opens and reads it itself.
+ */
 STATUS fmodCreateSoundFromFile( FMOD::System* system, FMOD::Sound** sound, const char* file )
 {
     FMOD_RESULT result;
     FMOD_CREATESOUNDEXINFO exInfo;
-
-    void* buff;
-    int   length;
+    FMOD_MODE mode = FMOD_SOFTWARE | FMOD_CREATESAMPLE;
+    WavInfo   wav;
 
     //------------------------------------------------
 
@@ -164,34 +218,108 @@ STATUS fmodCreateSoundFromFile( FMOD::System* system, FMOD::Sound** sound, const
         return PARAM_NULL_PASSED;
     }
 
-    if( !LoadFileIntoMemory( file, &buff, &length ) )
+    memset( &exInfo, 0, sizeof( FMOD_CREATESOUNDEXINFO ) );
+    exInfo.cbsize = sizeof( FMOD_CREATESOUNDEXINFO );
+
+    //------------------------------------------------
+    // Zero-copy: point FMOD at the mapped pages
+
+    MappedFile* mapping = MappedFile::open( file );
+
+    if( mapping != 0 )
     {
-        DEBUG_OUT( "LoadFileIntoMemory failed!" );
-        DEBUG_OUT( file );
-        return SOUND_FROM_FILE_FAILED;
+        const char* data = ( const char* )mapping->data( );
+
+        exInfo.length = ( unsigned )std::min< size_t >( mapping->length( ), 0xFFFFFFFF );
+
+        if( ParseWavHeader( data, mapping->length( ), &wav ) && wav.rf64 )
+        {
+            if( !WavRawExInfo( wav, &exInfo ) )
+            {
+                delete mapping;
+                return SOUND_FROM_FILE_FAILED;
+            }
+
+            // Point straight at the samples rather than relying on fileoffset in memory.
+            data             += exInfo.fileoffset;
+            exInfo.fileoffset = 0;
+            mode             |= FMOD_OPENRAW;
+        }
+
+        result = system->createSound( data, mode | FMOD_OPENMEMORY_POINT, &exInfo, sound );
+
+        if( result == FMOD_OK && *sound != 0 )
+        {
+            ( *sound )->setUserData( mapping );
+            return OK;
+        }
+
+        // FMOD only points at samples it can play as stored; compressed files and PCM8
+        // WAVs fail with FMOD_ERR_MEMORY_CANTPOINT and are opened by path below.
+        if( result != FMOD_OK && result != FMOD_ERR_MEMORY_CANTPOINT )
+            DEBUG_OUT( FMOD_ErrorString( result ) );
+
+        delete mapping;
+
+        *sound = 0;
+        mode   = FMOD_SOFTWARE | FMOD_CREATESAMPLE;
+
+        memset( &exInfo, 0, sizeof( FMOD_CREATESOUNDEXINFO ) );
+        exInfo.cbsize = sizeof( FMOD_CREATESOUNDEXINFO );
     }
 
-    memset( &exInfo, 0, sizeof( FMOD_CREATESOUNDEXINFO ) );
-    exInfo.cbsize = sizeof( FMOD_CREATESOUNDEXINFO );
-    exInfo.length = length;
+    //------------------------------------------------
+    // Fallback: let FMOD read the file itself, in its own chunks
 
-    result = system->createSound( ( const char* )buff, FMOD_HARDWARE | FMOD_OPENMEMORY, &exInfo, sound );
+    FILE* fp = fopen( file, "rb" );
 
-    if( result != FMOD_OK || sound == 0 )
+    if( fp != 0 && ReadWavHeader( fp, &wav ) && wav.rf64 )
+    {
+        if( !WavRawExInfo( wav, &exInfo ) )
+        {
+            fclose( fp );
+            return SOUND_FROM_FILE_FAILED;
+        }
+
+        mode |= FMOD_OPENRAW;
+    }
+
+    if( fp != 0 )
+        fclose( fp );
+
+    result = system->createSound( file, mode, ( mode & FMOD_OPENRAW ) ? &exInfo : 0, sound );
+
+    if( result != FMOD_OK || *sound == 0 )
     {
         if( result != FMOD_OK )
             DEBUG_OUT( FMOD_ErrorString( result ) );
         else
             DEBUG_OUT( "Sound object creation failed!" );
 
-        free( buff );
-        return SOUND_CREATION_FAILED;
+        DEBUG_OUT( file );
+        return SOUND_FROM_FILE_FAILED;
     }
 
-    free( buff );
     return OK;
 }
 
+/**
+ * Releases a sound and, for sounds from fmodCreateSoundFromFile, the file mapping
+ * behind it. Use instead of Sound::release for any sound that may be mapped.
+ */
+void fmodReleaseSound( FMOD::Sound* sound )
+{
+    if( sound == 0 )
+        return;
+
+    void* mapping = 0;
+
+    sound->getUserData( &mapping );
+    sound->release( );
+
+    delete ( MappedFile* )mapping;
+}
+
 //------------------------------------------------------------------------------------------
 
 /**
@@ -218,6 +346,12 @@ STATUS fmodSetOutputType( FMOD::System* system, OUTPUT_TYPE output )
     case ESD:
         result = system->setOutput( FMOD_OUTPUTTYPE_ESD );
         break;
+    case NOSOUND:
+        result = system->setOutput( FMOD_OUTPUTTYPE_NOSOUND );
+        break;
+    case NOSOUND_NRT:
+        result = system->setOutput( FMOD_OUTPUTTYPE_NOSOUND_NRT );
+        break;
     default:
         result = system->setOutput( FMOD_OUTPUTTYPE_OSS );
         break;
@@ -257,23 +391,63 @@ STATUS fmodSetPlaybackDriver( FMOD::System* system, unsigned playback_driver )
 
 //------------------------------------------------------------------------------------------
 
-STATUS fmodDetectPitch( FMOD::System* system, FMOD::Channel* channel, Pitch* pitch )
+// One buffer per thread, so concurrent callers (workers, batch threads) do not collide.
+static thread_local float spectrum[ SPECTRUMSIZE ];
+static thread_local float gatePCM[ GATE_WINDOW ];
+
+/**
+ * Reads SPECTRUMSIZE bins of 'channel' into this thread's spectrum buffer, the one
+ * fmodDetectPitch and fmodDetectPitches analyse. fmodLastSpectrum returns it.
+ */
+STATUS fmodReadSpectrum( FMOD::Channel* channel )
 {
-    if( system == 0 )
+    if( channel == 0 )
     {
-        DEBUG_OUT( "system == NULL" );
+        DEBUG_OUT( "channel == NULL" );
         return PARAM_NULL_PASSED;
     }
 
-    if( channel == 0 )
+    FMOD_RESULT result;
+
     {
-        DEBUG_OUT( "channel == NULL" );
+        TRACE_SCOPE( TRACE_LEVEL_DEBUG, "getSpectrum" );
+        result = channel->getSpectrum( spectrum, SPECTRUMSIZE, 0, FMOD_DSP_FFT_WINDOW_TRIANGLE );
+    }
+
+    if( result != FMOD_OK )
+    {
+        DEBUG_OUT( FMOD_ErrorString( result ) );
+        return CHANNEL_SPECTRUM_READ_FAILED;
+    }
+
+    return OK;
+}
+
+/**
+ * The SPECTRUMSIZE bins read by this thread's last fmodReadSpectrum, fmodDetectPitch or
+ * fmodDetectPitches call, so a caller that also wants to display them need not read again.
+ */
+const float* fmodLastSpectrum( )
+{
+    return spectrum;
+}
+
+/**
+ * With a 'gate', the newest GATE_WINDOW samples are read with Channel::getWaveData
+ * first, and a frame the gate rejects skips getSpectrum and the peak search: the pitch
+ * is unvoiced and the spectrum buffer is left at zero.
+ */
+STATUS fmodDetectPitch( FMOD::System* system, FMOD::Channel* channel, Pitch* pitch, EnergyGate* gate )
+{
+    if( system == 0 )
+    {
+        DEBUG_OUT( "system == NULL" );
         return PARAM_NULL_PASSED;
     }
 
-    if( note == 0 )
+    if( channel == 0 )
     {
-        DEBUG_OUT( "note == NULL" );
+        DEBUG_OUT( "channel == NULL" );
         return PARAM_NULL_PASSED;
     }
 
@@ -285,223 +459,1118 @@ STATUS fmodDetectPitch( FMOD::System* system, FMOD::Channel* channel, Pitch* pit
 
     //--------------------------------------------------------------------------------------
 
-    static float spectrum[ SPECTRUMSIZE ];
-    float        dominantHz = 0;
-    float        max;
-    float        bin;
-    float        binSize = BINSIZE;
-    int          dominantNote = 0;
+    STATUS status;
 
-    FMOD_RESULT result;
+    TRACE_SCOPE( TRACE_LEVEL_INFO, "fmodDetectPitch" );
 
     //------------------------------------------------
 
-    result = channel->getSpectrum( spectrum, SPECTRUMSIZE, 0, FMOD_DSP_FFT_WINDOW_TRIANGLE );
+    bool analyse = true;
 
-    if( result != FMOD_OK )
+    if( gate != 0 && channel->getWaveData( gatePCM, GATE_WINDOW, 0 ) == FMOD_OK )
     {
-        DEBUG_OUT( FMOD_ErrorString( result ) );
-        return CHANNEL_SPECTRUM_READ_FAILED;
+        TRACE_SCOPE( TRACE_LEVEL_DEBUG, "energy gate" );
+        analyse = gate->process( gatePCM, GATE_WINDOW );
     }
 
-    max = 0;
-    std::cout << "a" << std::endl;
+    if( analyse )
+    {
+        status = fmodReadSpectrum( channel );
+
+        if( status != OK )
+            return status;
 
-    for( int i = 0; i < SPECTRUMSIZE; i++ )
+        status = fmodDetectPitchFromSpectrum( spectrum, SPECTRUMSIZE, fmodSpectrumBinSize( system ), pitch );
+    }
+    else
     {
-        if( spectrum[ i ] > 0.01f && spectrum[ i ] > max )
-        {
-            max = spectrum[ i ];
-            bin = i;
-        }
+        memset( spectrum, 0, sizeof( spectrum ) );
+        fmodUnvoicedPitch( pitch );
+        status = OK;
+    }
+
+    {
+        TRACE_SCOPE( TRACE_LEVEL_DEBUG, "System::update" );
+        system->update( );
+    }
+
+    return status;
+}
+
+//------------------------------------------------------------------------------------------
+
+/**
+ * A frame with no pitch: gated as silence, no spectral peak, or an estimator that found
+ * no period. 'confidence' keeps whatever the estimator reported.
+ */
+void fmodUnvoicedPitch( Pitch* pitch, float confidence )
+{
+    pitch->hz         = 0.0f;
+    pitch->noteHz     = 0.0f;
+    pitch->cents      = 0.0f;
+    pitch->confidence = confidence;
+    pitch->salience   = 0.0f;
+    pitch->note       = "-";
+    pitch->unvoiced   = true;
+}
+
+static void fillPitch( float hz, float confidence, Pitch* pitch )
+{
+    if( hz <= 0.0f )
+    {
+        fmodUnvoicedPitch( pitch, confidence );
+        return;
+    }
+
+    NoteMatch match = Tuning::nearest( hz );
+
+    if( match.index < 0 )
+        match = Tuning::nearest( Tuning::tables.hz[ 0 ] );
+
+    pitch->hz         = hz;
+    pitch->noteHz     = match.hz;
+    pitch->cents      = match.cents;
+    pitch->confidence = confidence;
+    pitch->salience   = confidence;
+    pitch->note       = Tuning::name( match.index );
+    pitch->unvoiced   = false;
+}
+
+/**
+ * Picks the strongest bin of a magnitude spectrum and maps it to the nearest note.
+ * Shared by the Channel::getSpectrum path and the Stft path over raw PCM. The
+ * confidence is simply the peak magnitude (1.0 for a full scale sine). A spectrum with
+ * nothing above 0.01 is unvoiced.
+ */
+STATUS fmodDetectPitchFromSpectrum( const float* spectrum, unsigned bins, float bin_size, Pitch* pitch )
+{
+    if( spectrum == 0 )
+    {
+        DEBUG_OUT( "spectrum == NULL" );
+        return PARAM_NULL_PASSED;
+    }
+
+    if( pitch == 0 )
+    {
+        DEBUG_OUT( "pitch == NULL" );
+        return PARAM_NULL_PASSED;
     }
-    std::cout << "b" << std::endl;
 
-    dominantHz   = bin * BINSIZE;
-    dominantNote = 0;
+    float    dominantHz = 0;
+    float    max        = 0;
+    unsigned bin        = 0;
 
-    for( int i = 0; i < 120; i++ )
     {
-        if( dominantHz >= notefreq[ i ] && dominantHz < notefreq[ i + 1 ] )
+        TRACE_SCOPE( TRACE_LEVEL_DEBUG, "peak search" );
+
+        for( unsigned i = 0; i < bins; i++ )
         {
-            // Which is it closer to? This note or the next
-            if( fabs( dominantHz - notefreq[ i ] ) < fabs( dominantHz - notefreq[ i + 1 ] ) )
-            {
-                dominantNote = i;
-            }
-            else
+            if( spectrum[ i ] > 0.01f && spectrum[ i ] > max )
             {
-                dominantNote = i + 1;
+                max = spectrum[ i ];
+                bin = i;
             }
-
-            break;
         }
     }
-    std::cout << "c\t" << dominantNote << "\t" << dominantHz << std::endl;
 
-    pitch->hz     = dominantHz;
-    pitch->noteHz = notefreq[ dominantNote ];
-    pitch->note   = note[ dominantNote ];
+    if( max == 0 )
+    {
+        fmodUnvoicedPitch( pitch );
+        return OK;
+    }
 
-    std::cout << "d" << std::endl;
+    dominantHz = bin * bin_size;
 
-    system->update( );
-    std::cout << "e" << std::endl;
+    {
+        TRACE_SCOPE( TRACE_LEVEL_DEBUG, "note mapping" );
+        fillPitch( dominantHz, std::min( max, 1.0f ), pitch );
+    }
 
     return OK;
 }
 
-//------------------------------------------------------------------------------------------
-
-std::vector< std::string > getDrivers( FMOD::System* system, STATUS* error, bool record_drivers )
+/**
+ * Reads the pitch straight off note-aligned ConstantQ magnitudes. Every bin above 0.01
+ * is scored by the weighted magnitudes of its first five harmonics, which sit a fixed
+ * 0, 12, 19, 24 and 28 semitones up, so no peak search per harmonic is needed. A
+ * parabola through the best bin and its neighbours gives the cents. The confidence is
+ * the magnitude at that bin, as for fmodDetectPitchFromSpectrum; the salience is the
+ * harmonic score.
+ */
+STATUS fmodDetectPitchFromConstantQ( const float* magnitudes, const ConstantQ& cqt, Pitch* pitch )
 {
-    FMOD_RESULT result;
-    int num_drivers;
+    if( magnitudes == 0 )
+    {
+        DEBUG_OUT( "magnitudes == NULL" );
+        return PARAM_NULL_PASSED;
+    }
 
-    std::vector< std::string > drivers;
+    if( pitch == 0 )
+    {
+        DEBUG_OUT( "pitch == NULL" );
+        return PARAM_NULL_PASSED;
+    }
 
-    *error = OK;
+    static const unsigned offsets[ 5 ] = { 0, 12, 19, 24, 28 };
+    static const float    weights[ 5 ] = { 1.0f, 0.8f, 0.64f, 0.51f, 0.41f };
 
-    //------------------------------------------------
+    unsigned perNote = cqt.binsPerNote( );
+    unsigned bins    = cqt.bins( );
+    float    best    = 0.0f;
+    unsigned bin     = 0;
 
-    if( system == 0 )
     {
-        DEBUG_OUT( "system == NULL" );
-        *error = PARAM_NULL_PASSED;
-        return drivers;
-    }
+        TRACE_SCOPE( TRACE_LEVEL_DEBUG, "harmonic sum" );
 
-    result = ( record_drivers ? system->getRecordNumDrivers( &num_drivers ) : system->getNumDrivers( &num_drivers ) );
+        for( unsigned i = 0; i < bins; i++ )
+        {
+            if( magnitudes[ i ] <= 0.01f )
+                continue;
 
-    if( result != FMOD_OK )
-    {
-        DEBUG_OUT( FMOD_ErrorString( result ) );
-        *error = DRIVER_COUNT_RETRIEVE_FAILED;
-        return drivers;
+            float score = 0.0f;
+
+            for( unsigned h = 0; h < 5 && i + offsets[ h ] * perNote < bins; h++ )
+                score += weights[ h ] * magnitudes[ i + offsets[ h ] * perNote ];
+
+            if( score > best )
+            {
+                best = score;
+                bin  = i;
+            }
+        }
     }
 
-    for( int i = 0; i < num_drivers; i++ )
+    if( best == 0.0f )
     {
-        char info[ 256 ];
+        fmodUnvoicedPitch( pitch );
+        return OK;
+    }
 
-        result = ( record_drivers ? system->getRecordDriverInfo( i, info, 256, 0 ) : system->getDriverInfo( i, info, 256, 0 ) );
+    float delta = 0.0f;
 
-        if( result != FMOD_OK )
-        {
-            *error = DRIVER_FETCH_FAILED;
-            return drivers;
-        }
+    if( bin > 0 && bin + 1 < bins )
+    {
+        float left   = magnitudes[ bin - 1 ];
+        float centre = magnitudes[ bin ];
+        float right  = magnitudes[ bin + 1 ];
+        float denom  = left - 2.0f * centre + right;
 
-        drivers.push_back( info );
+        if( denom < 0.0f )
+            delta = std::max( -0.5f, std::min( 0.5f, 0.5f * ( left - right ) / denom ) );
     }
 
-    return drivers;
+    {
+        TRACE_SCOPE( TRACE_LEVEL_DEBUG, "note mapping" );
+        fillPitch( cqt.binHz( bin ) * exp2f( delta / ( 12.0f * perNote ) ), std::min( magnitudes[ bin ], 1.0f ), pitch );
+    }
+
+    pitch->salience = best;
+
+    return OK;
 }
 
 //------------------------------------------------------------------------------------------
 
-bool LoadFileIntoMemory( const char *name, void **buff, int *length )
+/**
+ * Multi-pitch version of fmodDetectPitch: up to 'max_pitches' voices from the same
+ * Channel::getSpectrum read, strongest first.
+ */
+STATUS fmodDetectPitches( FMOD::System* system, FMOD::Channel* channel, Pitch* pitches, unsigned max_pitches, unsigned* count )
 {
-    FILE *fp = fopen(name, "rb");
-
-    if( fp == 0 )
-        return false;
-
-    fseek(fp, 0, SEEK_END);
-    *length = ftell(fp);
-    fseek(fp, 0, SEEK_SET);
+    if( system == 0 || channel == 0 )
+    {
+        DEBUG_OUT( "system or channel == NULL" );
+        return PARAM_NULL_PASSED;
+    }
 
-    *buff = malloc(*length);
-    fread(*buff, *length, 1, fp);
+    STATUS status;
 
-    fclose(fp);
+    TRACE_SCOPE( TRACE_LEVEL_INFO, "fmodDetectPitches" );
 
-    return true;
-}
+    status = fmodReadSpectrum( channel );
 
-//------------------------------------------------------------------------------------------
+    if( status != OK )
+        return status;
 
-void SaveToWav(FMOD::Sound *sound, const char* file_name )
-{
-    FILE *fp;
-    int             channels, bits;
-    float           rate;
-    void           *ptr1, *ptr2;
-    unsigned int    lenbytes, len1, len2;
+    status = fmodDetectPitchesFromSpectrum( spectrum, SPECTRUMSIZE, fmodSpectrumBinSize( system ), pitches, max_pitches, count );
 
-    if (!sound)
     {
-        return;
+        TRACE_SCOPE( TRACE_LEVEL_DEBUG, "System::update" );
+        system->update( );
     }
 
-    sound->getFormat  (0, 0, &channels, &bits);
-    sound->getDefaults(&rate, 0, 0, 0);
-    sound->getLength  (&lenbytes, FMOD_TIMEUNIT_PCMBYTES);
+    return status;
+}
+
+struct SpectralPeak
+{
+    float hz;
+    float magnitude;
+};
+
+/**
+ * Sum of the partials of 'f0' found among the peaks (sorted by frequency), weighted
+ * 1/h so a subharmonic cannot win just by collecting every other partial.
+ */
+static float harmonicSum( const SpectralPeak* peaks, unsigned count, float f0, float min_width )
+{
+    float sum = 0.0f;
 
+    for( unsigned h = 1; h <= POLY_HARMONICS; h++ )
     {
-        #if defined(WIN32) || defined(_WIN64) || defined(__WATCOMC__) || defined(_WIN32) || defined(__WIN32__)
-        #pragma pack(1)
-        #endif
+        float target = f0 * h;
+        float width  = std::max( target * POLY_TOLERANCE, min_width );
 
-        /*
-            WAV Structures
-        */
-        typedef struct
-        {
-            signed char id[4];
-            int 		size;
-        } RiffChunk;
+        // First peak at or above target - width, then the closest one inside the window.
+        unsigned lo = 0, hi = count;
 
-        struct
-        {
-            RiffChunk       chunk           __PACKED;
-            unsigned short	wFormatTag      __PACKED;    /* format type  */
-            unsigned short	nChannels       __PACKED;    /* number of channels (i.e. mono, stereo...)  */
-            unsigned int	nSamplesPerSec  __PACKED;    /* sample rate  */
-            unsigned int	nAvgBytesPerSec __PACKED;    /* for buffer estimation  */
-            unsigned short	nBlockAlign     __PACKED;    /* block size of data  */
-            unsigned short	wBitsPerSample  __PACKED;    /* number of bits per sample of mono data */
-        } __PACKED FmtChunk  = { {{'f','m','t',' '}, sizeof(FmtChunk) - sizeof(RiffChunk) }, 1, channels, (int)rate, (int)rate * channels * bits / 8, 1 * channels * bits / 8, bits };
-
-        struct
+        while( lo < hi )
         {
-            RiffChunk   chunk;
-        } DataChunk = { {{'d','a','t','a'}, lenbytes } };
+            unsigned mid = ( lo + hi ) / 2;
 
-        struct
+            if( peaks[ mid ].hz < target - width )
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+
+        float best = 0.0f;
+
+        for( unsigned i = lo; i < count && peaks[ i ].hz <= target + width; i++ )
+            best = std::max( best, peaks[ i ].magnitude );
+
+        sum += best / ( float )h;
+    }
+
+    return sum;
+}
+
+/**
+ * Top-K fundamentals of a magnitude spectrum by peak picking and harmonic summation.
+ *
+ * One pass finds the global maximum, a second collects local maxima above a floor
+ * (refined with parabolic interpolation), so the spectrum is read about as often as
+ * the single-peak search does. Every peak in the note range is then a candidate f0
+ * scored by harmonicSum; the best is taken, its share of the peaks is removed, and
+ * the rest are rescored, until 'max_pitches' voices are found or the salience drops
+ * below POLY_MIN_SALIENCE of the first voice. The work after the two passes is
+ * bounded by POLY_MAX_PEAKS and POLY_HARMONICS, not by the spectrum size.
+ */
+STATUS fmodDetectPitchesFromSpectrum( const float* spectrum, unsigned bins, float bin_size, Pitch* pitches, unsigned max_pitches, unsigned* count )
+{
+    if( spectrum == 0 || pitches == 0 || count == 0 )
+    {
+        DEBUG_OUT( "spectrum, pitches or count == NULL" );
+        return PARAM_NULL_PASSED;
+    }
+
+    *count = 0;
+
+    if( bins < 3 || max_pitches == 0 )
+        return OK;
+
+    TRACE_SCOPE( TRACE_LEVEL_DEBUG, "polyphonic search" );
+
+    //------------------------------------------------
+    // Peak picking
+
+    float max = 0.0f;
+
+    for( unsigned i = 0; i < bins; i++ )
+        max = std::max( max, spectrum[ i ] );
+
+    float floor = std::max( 0.01f, max * 0.02f );
+
+    SpectralPeak peaks[ POLY_MAX_PEAKS ];
+    unsigned     found = 0;
+
+    for( unsigned i = 1; i + 1 < bins; i++ )
+    {
+        float m = spectrum[ i ];
+
+        if( m <= floor || m < spectrum[ i - 1 ] || m <= spectrum[ i + 1 ] )
+            continue;
+
+        float a     = spectrum[ i - 1 ];
+        float c     = spectrum[ i + 1 ];
+        float denom = a - 2.0f * m + c;
+        float shift = ( denom < 0.0f ? 0.5f * ( a - c ) / denom : 0.0f );
+
+        SpectralPeak peak = { ( ( float )i + shift ) * bin_size, m };
+
+        if( found < POLY_MAX_PEAKS )
+        {
+            peaks[ found++ ] = peak;
+        }
+        else
+        {
+            // Full: replace the weakest, keeping frequency order by shifting down.
+            unsigned weakest = 0;
+
+            for( unsigned k = 1; k < found; k++ )
+            {
+                if( peaks[ k ].magnitude < peaks[ weakest ].magnitude )
+                    weakest = k;
+            }
+
+            if( peaks[ weakest ].magnitude >= m )
+                continue;
+
+            for( unsigned k = weakest; k + 1 < found; k++ )
+                peaks[ k ] = peaks[ k + 1 ];
+
+            peaks[ found - 1 ] = peak;
+        }
+    }
+
+    //------------------------------------------------
+    // Harmonic summation, one voice at a time
+
+    float    first = 0.0f;
+    unsigned voices = 0;
+
+    while( voices < max_pitches )
+    {
+        float    best      = 0.0f;
+        unsigned candidate = 0;
+
+        for( unsigned i = 0; i < found; i++ )
+        {
+            if( peaks[ i ].magnitude <= 0.0f || peaks[ i ].hz < POLY_MIN_HZ || peaks[ i ].hz > POLY_MAX_HZ )
+                continue;
+
+            float salience = harmonicSum( peaks, found, peaks[ i ].hz, bin_size );
+
+            if( salience > best )
+            {
+                best      = salience;
+                candidate = i;
+            }
+        }
+
+        if( best <= 0.0f || ( voices > 0 && best < first * POLY_MIN_SALIENCE ) )
+            break;
+
+        if( voices == 0 )
+            first = best;
+
+        float f0 = peaks[ candidate ].hz;
+
+        fillPitch( f0, std::min( peaks[ candidate ].magnitude, 1.0f ), &pitches[ voices ] );
+        pitches[ voices ].salience = best;
+        voices++;
+
+        // Take this voice's share out of its partials, modelled as a 1/h roll-off from
+        // its fundamental, so a note sitting on another's harmonic keeps the rest.
+        float fundamental = peaks[ candidate ].magnitude;
+
+        for( unsigned h = 1; h <= POLY_HARMONICS; h++ )
+        {
+            float target = f0 * h;
+            float width  = std::max( target * POLY_TOLERANCE, bin_size );
+
+            for( unsigned i = 0; i < found; i++ )
+            {
+                if( fabsf( peaks[ i ].hz - target ) <= width )
+                    peaks[ i ].magnitude = ( h == 1 ? 0.0f : std::max( 0.0f, peaks[ i ].magnitude - fundamental / ( float )h ) );
+            }
+        }
+    }
+
+    *count = voices;
+
+    return OK;
+}
+
+//------------------------------------------------------------------------------------------
+
+/**
+ * Estimates the pitch of the channel's most recent output with a time-domain
+ * PitchEstimator (YIN or McLeod), using Channel::getWaveData rather than a full
+ * spectrum. Only estimator->windowSize() samples of latency are involved.
+ */
+STATUS fmodDetectPitchTimeDomain( FMOD::System* system, FMOD::Channel* channel, PitchEstimator* estimator, Pitch* pitch, EnergyGate* gate )
+{
+    if( system == 0 )
+    {
+        DEBUG_OUT( "system == NULL" );
+        return PARAM_NULL_PASSED;
+    }
+
+    if( channel == 0 )
+    {
+        DEBUG_OUT( "channel == NULL" );
+        return PARAM_NULL_PASSED;
+    }
+
+    if( estimator == 0 )
+    {
+        DEBUG_OUT( "estimator == NULL" );
+        return PARAM_NULL_PASSED;
+    }
+
+    FMOD_RESULT result;
+    STATUS      status;
+
+    TRACE_SCOPE( TRACE_LEVEL_INFO, "fmodDetectPitchTimeDomain" );
+
+    {
+        TRACE_SCOPE( TRACE_LEVEL_DEBUG, "getWaveData" );
+        result = channel->getWaveData( estimator->buffer( ), estimator->windowSize( ), 0 );
+    }
+
+    if( result != FMOD_OK )
+    {
+        DEBUG_OUT( FMOD_ErrorString( result ) );
+        return CHANNEL_WAVEDATA_READ_FAILED;
+    }
+
+    status = fmodDetectPitchFromPCM( estimator, estimator->buffer( ), pitch, gate );
+
+    {
+        TRACE_SCOPE( TRACE_LEVEL_DEBUG, "System::update" );
+        system->update( );
+    }
+
+    return status;
+}
+
+/**
+ * With a 'gate', the newest GATE_WINDOW samples of the window decide first whether the
+ * estimator runs at all. A window the estimator finds nothing periodic in is unvoiced.
+ */
+STATUS fmodDetectPitchFromPCM( PitchEstimator* estimator, const float* samples, Pitch* pitch, EnergyGate* gate )
+{
+    if( estimator == 0 || samples == 0 || pitch == 0 )
+    {
+        DEBUG_OUT( "estimator, samples or pitch == NULL" );
+        return PARAM_NULL_PASSED;
+    }
+
+    if( gate != 0 )
+    {
+        unsigned window = estimator->windowSize( );
+        unsigned newest = std::min( window, ( unsigned )GATE_WINDOW );
+        bool     open;
+
+        {
+            TRACE_SCOPE( TRACE_LEVEL_DEBUG, "energy gate" );
+            open = gate->process( samples + window - newest, newest );
+        }
+
+        if( !open )
+        {
+            fmodUnvoicedPitch( pitch );
+            return OK;
+        }
+    }
+
+    float hz, confidence;
+    bool  found;
+
+    {
+        TRACE_SCOPE( TRACE_LEVEL_DEBUG, "pitch estimate" );
+        found = estimator->estimate( samples, &hz, &confidence );
+    }
+
+    if( !found )
+    {
+        fmodUnvoicedPitch( pitch, confidence );
+        return OK;
+    }
+
+    {
+        TRACE_SCOPE( TRACE_LEVEL_DEBUG, "note mapping" );
+        fillPitch( hz, confidence, pitch );
+    }
+
+    return OK;
+}
+
+//------------------------------------------------------------------------------------------
+
+/**
+ * Converts interleaved PCM of any FMOD sample format into mono floats in [-1, 1].
+ */
+void fmodConvertToMono( const void* data, unsigned frames, FMOD_SOUND_FORMAT format, int channels, float* mono )
+{
+    const unsigned char* bytes = ( const unsigned char* )data;
+    float                gain  = 1.0f / ( float )( channels > 0 ? channels : 1 );
+
+    for( unsigned i = 0; i < frames; i++ )
+    {
+        float sum = 0.0f;
+
+        for( int c = 0; c < channels; c++ )
+        {
+            unsigned index = i * channels + c;
+
+            switch( format )
+            {
+            case FMOD_SOUND_FORMAT_PCM8:
+                sum += ( signed char )bytes[ index ] / 128.0f;       /* FMOD PCM8 is signed */
+                break;
+            case FMOD_SOUND_FORMAT_PCM16:
+                sum += ( ( const short* )data )[ index ] / 32768.0f;
+                break;
+            case FMOD_SOUND_FORMAT_PCM24:
+            {
+                const unsigned char* s = bytes + index * 3;
+                int value = ( int )( ( ( unsigned )s[ 0 ] << 8 ) | ( ( unsigned )s[ 1 ] << 16 ) | ( ( unsigned )s[ 2 ] << 24 ) ) >> 8;
+                sum += value / 8388608.0f;
+                break;
+            }
+            case FMOD_SOUND_FORMAT_PCM32:
+                sum += ( ( const int* )data )[ index ] / 2147483648.0f;
+                break;
+            case FMOD_SOUND_FORMAT_PCMFLOAT:
+                sum += ( ( const float* )data )[ index ];
+                break;
+            default:
+                break;
+            }
+        }
+
+        mono[ i ] = sum * gain;
+    }
+}
+
+/**
+ * Copies 'frames' PCM frames starting at frame 'offset' out of a sample (not a stream)
+ * via Sound::lock, downmixed to mono floats. 'read' receives the frames actually copied.
+ */
+STATUS fmodReadPCM( FMOD::Sound* sound, unsigned offset, unsigned frames, float* mono, unsigned* read )
+{
+    if( sound == 0 || mono == 0 || read == 0 )
+    {
+        DEBUG_OUT( "sound, mono or read == NULL" );
+        return PARAM_NULL_PASSED;
+    }
+
+    FMOD_RESULT       result;
+    FMOD_SOUND_FORMAT format;
+    int               channels, bits;
+    unsigned          lenbytes, frameBytes;
+    void             *ptr1, *ptr2;
+    unsigned          len1, len2;
+
+    *read = 0;
+
+    sound->getFormat( 0, &format, &channels, &bits );
+    sound->getLength( &lenbytes, FMOD_TIMEUNIT_PCMBYTES );
+
+    frameBytes = channels * bits / 8;
+
+    if( frameBytes == 0 || offset * frameBytes >= lenbytes )
+        return OK;
+
+    if( ( offset + frames ) * frameBytes > lenbytes )
+        frames = lenbytes / frameBytes - offset;
+
+    result = sound->lock( offset * frameBytes, frames * frameBytes, &ptr1, &ptr2, &len1, &len2 );
+
+    if( result != FMOD_OK )
+    {
+        DEBUG_OUT( FMOD_ErrorString( result ) );
+        return SOUND_LOCK_FAILED;
+    }
+
+    fmodConvertToMono( ptr1, len1 / frameBytes, format, channels, mono );
+
+    if( ptr2 != 0 )
+        fmodConvertToMono( ptr2, len2 / frameBytes, format, channels, mono + len1 / frameBytes );
+
+    *read = ( len1 + len2 ) / frameBytes;
+
+    sound->unlock( ptr1, ptr2, len1, len2 );
+
+    return OK;
+}
+
+//------------------------------------------------------------------------------------------
+
+std::vector< std::string > getDrivers( FMOD::System* system, STATUS* error, bool record_drivers )
+{
+    FMOD_RESULT result;
+    int num_drivers;
+
+    std::vector< std::string > drivers;
+
+    *error = OK;
+
+    //------------------------------------------------
+
+    if( system == 0 )
+    {
+        DEBUG_OUT( "system == NULL" );
+        *error = PARAM_NULL_PASSED;
+        return drivers;
+    }
+
+    result = ( record_drivers ? system->getRecordNumDrivers( &num_drivers ) : system->getNumDrivers( &num_drivers ) );
+
+    if( result != FMOD_OK )
+    {
+        DEBUG_OUT( FMOD_ErrorString( result ) );
+        *error = DRIVER_COUNT_RETRIEVE_FAILED;
+        return drivers;
+    }
+
+    for( int i = 0; i < num_drivers; i++ )
+    {
+        char info[ 256 ];
+
+        result = ( record_drivers ? system->getRecordDriverInfo( i, info, 256, 0 ) : system->getDriverInfo( i, info, 256, 0 ) );
+
+        if( result != FMOD_OK )
+        {
+            *error = DRIVER_FETCH_FAILED;
+            return drivers;
+        }
+
+        drivers.push_back( info );
+    }
+
+    return drivers;
+}
+
+//------------------------------------------------------------------------------------------
+
+/**
+ * Name and GUID of a playback or record driver. Cheap; see fmodGetDriverCaps for the rest.
+ */
+STATUS fmodGetDriverInfo( FMOD::System* system, int index, bool record_driver, DriverInfo* info )
+{
+    if( system == 0 || info == 0 )
+    {
+        DEBUG_OUT( "system == NULL || info == NULL" );
+        return PARAM_NULL_PASSED;
+    }
+
+    FMOD_RESULT result;
+    char        name[ 256 ];
+
+    memset( &info->guid, 0, sizeof( FMOD_GUID ) );
+
+    result = ( record_driver ? system->getRecordDriverInfo( index, name, sizeof( name ), &info->guid )
+                             : system->getDriverInfo( index, name, sizeof( name ), &info->guid ) );
+
+    if( result != FMOD_OK )
+    {
+        DEBUG_OUT( FMOD_ErrorString( result ) );
+        return DRIVER_FETCH_FAILED;
+    }
+
+    name[ sizeof( name ) - 1 ] = 0;
+
+    info->name     = name;
+    info->rate     = 0;
+    info->channels = 0;
+    info->caps     = FMOD_CAPS_NONE;
+
+    return OK;
+}
+
+/**
+ * Rate, channel count and caps of a driver. This opens the device on some outputs
+ * (ALSA/OSS probing), so it can take a while.
+ */
+STATUS fmodGetDriverCaps( FMOD::System* system, int index, bool record_driver, DriverInfo* info )
+{
+    if( system == 0 || info == 0 )
+    {
+        DEBUG_OUT( "system == NULL || info == NULL" );
+        return PARAM_NULL_PASSED;
+    }
+
+    FMOD_RESULT result;
+
+    if( record_driver )
+    {
+        int min_rate = 0;
+
+        result         = system->getRecordDriverCaps( index, &info->caps, &min_rate, &info->rate );
+        info->channels = 0;
+    }
+    else
+    {
+        FMOD_SPEAKERMODE mode = FMOD_SPEAKERMODE_STEREO;
+
+        result = system->getDriverCaps( index, &info->caps, &info->rate, &mode );
+
+        switch( mode )
         {
-            RiffChunk   chunk;
-            signed char rifftype[4];
-        } WavHeader = { {{'R','I','F','F'}, sizeof(FmtChunk) + sizeof(RiffChunk) + lenbytes }, {'W','A','V','E'} };
-
-        #if defined(WIN32) || defined(_WIN64) || defined(__WATCOMC__) || defined(_WIN32) || defined(__WIN32__)
-        #pragma pack()
-        #endif
-
-        fp = fopen( file_name, "wb");
-
-        /*
-            Write out the WAV header.
-        */
-        fwrite(&WavHeader, sizeof(WavHeader), 1, fp);
-        fwrite(&FmtChunk, sizeof(FmtChunk), 1, fp);
-        fwrite(&DataChunk, sizeof(DataChunk), 1, fp);
-
-        /*
-            Lock the sound to get access to the raw data.
-        */
-        sound->lock(0, lenbytes, &ptr1, &ptr2, &len1, &len2);
-
-        /*
-            Write it to disk.
-        */
-        fwrite(ptr1, len1, 1, fp);
-
-        /*
-            Unlock the sound to allow FMOD to use it again.
-        */
-        sound->unlock(ptr1, ptr2, len1, len2);
+        case FMOD_SPEAKERMODE_MONO:     info->channels = 1; break;
+        case FMOD_SPEAKERMODE_STEREO:   info->channels = 2; break;
+        case FMOD_SPEAKERMODE_QUAD:     info->channels = 4; break;
+        case FMOD_SPEAKERMODE_SURROUND: info->channels = 5; break;
+        case FMOD_SPEAKERMODE_5POINT1:  info->channels = 6; break;
+        case FMOD_SPEAKERMODE_7POINT1:  info->channels = 8; break;
+        default:                        info->channels = 0; break;
+        }
+    }
+
+    if( result != FMOD_OK )
+    {
+        DEBUG_OUT( FMOD_ErrorString( result ) );
+        return DRIVER_FETCH_FAILED;
+    }
+
+    return OK;
+}
 
+//------------------------------------------------------------------------------------------
+
+/**
+ * Reads the whole file, WAV_READ_CHUNK bytes per fread so no single call has to move
+ * gigabytes. The length is 64-bit; ftello keeps it exact past 2 GB.
+ *
+ * The caller owns '*buff' and frees it, so this stays one allocation of the whole file.
+ * Nothing on the sample path uses it: fmodCreateSoundFromFile maps files with
+ * MappedFile (or lets FMOD read them itself), and capture and export write in blocks.
+ */
+bool LoadFileIntoMemory( const char *name, void **buff, unsigned long long *length )
+{
+    FILE *fp = fopen(name, "rb");
+
+    if( fp == 0 )
+        return false;
+
+    fseeko(fp, 0, SEEK_END);
+    off_t size = ftello(fp);
+    fseeko(fp, 0, SEEK_SET);
+
+    if( size <= 0 || ( unsigned long long )size > ( size_t )-1 )
+    {
         fclose(fp);
+        return false;
+    }
+
+    *length = size;
+    *buff   = malloc(( size_t )*length);
+
+    unsigned long long done = 0;
+
+    while( *buff != 0 && done < *length )
+    {
+        size_t bytes = ( size_t )std::min< unsigned long long >( *length - done, WAV_READ_CHUNK );
+
+        if( fread(( char* )*buff + done, 1, bytes, fp) != bytes )
+            break;
+
+        done += bytes;
+    }
+
+    if( done != *length )
+    {
+        free(*buff);
+        *buff = 0;
+        fclose(fp);
+        return false;
+    }
+
+    fclose(fp);
+
+    return true;
+}
+
+//------------------------------------------------------------------------------------------
+
+static void putTag( unsigned char* p, const char* tag ) { memcpy( p, tag, 4 ); }
+static void put16( unsigned char* p, unsigned v )       { p[ 0 ] = v; p[ 1 ] = v >> 8; }
+static void put32( unsigned char* p, unsigned v )       { put16( p, v & 0xFFFF ); put16( p + 2, v >> 16 ); }
+static void put64( unsigned char* p, unsigned long long v ) { put32( p, ( unsigned )v ); put32( p + 4, ( unsigned )( v >> 32 ) ); }
+
+static unsigned           get16( const unsigned char* p ) { return p[ 0 ] | ( p[ 1 ] << 8 ); }
+static unsigned           get32( const unsigned char* p ) { return get16( p ) | ( get16( p + 2 ) << 16 ); }
+static unsigned long long get64( const unsigned char* p ) { return get32( p ) | ( ( unsigned long long )get32( p + 4 ) << 32 ); }
+
+/**
+ * Writes a WAV_HEADER_SIZE byte header for 'data_length' bytes of PCM.
+ *
+ * The layout never changes size: RIFF, a 28 byte JUNK chunk, fmt and data. When the file
+ * outgrows the 32-bit RIFF sizes the same bytes are rewritten as RF64, with the JUNK chunk
+ * turned into ds64 holding the real 64-bit sizes (EBU Tech 3306). That lets CaptureWriter
+ * call this again at offset 0 to fix the sizes up however long the capture runs.
+ */
+bool WriteWavHeader( FILE* fp, int channels, int bits, float rate, unsigned long long data_length, bool float_samples )
+{
+    unsigned char      header[ WAV_HEADER_SIZE ];
+    unsigned           align     = channels * bits / 8;
+    unsigned long long riff_size = WAV_HEADER_SIZE - 8 + data_length;
+    bool               rf64      = riff_size > 0xFFFFFFFFull;
+
+    putTag( header, rf64 ? "RF64" : "RIFF" );
+    put32( header + 4, rf64 ? 0xFFFFFFFF : ( unsigned )riff_size );
+    putTag( header + 8, "WAVE" );
+
+    putTag( header + 12, rf64 ? "ds64" : "JUNK" );
+    put32( header + 16, 28 );
+    put64( header + 20, rf64 ? riff_size : 0 );
+    put64( header + 28, rf64 ? data_length : 0 );
+    put64( header + 36, rf64 && align != 0 ? data_length / align : 0 );
+    put32( header + 44, 0 );                                    /* no table entries */
+
+    putTag( header + 48, "fmt " );
+    put32( header + 52, 16 );
+    put16( header + 56, float_samples ? 3 : 1 );
+    put16( header + 58, channels );
+    put32( header + 60, ( unsigned )rate );
+    put32( header + 64, ( unsigned )rate * align );
+    put16( header + 68, align );
+    put16( header + 70, bits );
+
+    putTag( header + 72, "data" );
+    put32( header + 76, rf64 ? 0xFFFFFFFF : ( unsigned )data_length );
+
+    return fwrite( header, sizeof( header ), 1, fp ) == 1;
+}
+
+/**
+ * Walks the chunks of a RIFF, RF64 or BW64 file through 'read( offset, dest, bytes )'
+ * until both fmt and data have been seen. 32-bit sizes of 0xFFFFFFFF are replaced by the
+ * ds64 values; the data length is clamped to what the file actually holds, so a capture
+ * whose header was never fixed up still opens.
+ */
+template< typename Read >
+static bool parseWav( Read read, unsigned long long file_length, WavInfo* info )
+{
+    unsigned char      head[ 12 ];
+    unsigned char      body[ 40 ];
+    unsigned long long ds64Data = 0;
+    unsigned long long pos      = 12;
+    bool               haveFmt  = false;
+    bool               haveData = false;
+
+    if( info == 0 || !read( 0, head, 12 ) || memcmp( head + 8, "WAVE", 4 ) != 0 )
+        return false;
+
+    info->rf64 = memcmp( head, "RF64", 4 ) == 0 || memcmp( head, "BW64", 4 ) == 0;
+
+    if( !info->rf64 && memcmp( head, "RIFF", 4 ) != 0 )
+        return false;
+
+    while( !( haveFmt && haveData ) && pos + 8 <= file_length && read( pos, head, 8 ) )
+    {
+        unsigned long long size = get32( head + 4 );
+
+        if( memcmp( head, "ds64", 4 ) == 0 && size >= 24 )
+        {
+            if( !read( pos + 8, body, 24 ) )
+                return false;
+
+            ds64Data = get64( body + 8 );
+        }
+        else if( memcmp( head, "fmt ", 4 ) == 0 && size >= 16 )
+        {
+            if( !read( pos + 8, body, size >= 40 ? 40 : 16 ) )
+                return false;
+
+            unsigned tag = get16( body );
+
+            if( tag == 0xFFFE && size >= 40 )                    /* WAVE_FORMAT_EXTENSIBLE */
+                tag = get16( body + 24 );
+
+            if( tag != 1 && tag != 3 )
+                return false;
+
+            info->channels     = get16( body + 2 );
+            info->rate         = ( float )get32( body + 4 );
+            info->bits         = get16( body + 14 );
+            info->floatSamples = ( tag == 3 );
+            haveFmt            = true;
+        }
+        else if( memcmp( head, "data", 4 ) == 0 )
+        {
+            if( info->rf64 && size == 0xFFFFFFFF )
+                size = ds64Data;
+
+            info->dataOffset = pos + 8;
+            info->dataLength = std::min( size, file_length - info->dataOffset );
+            haveData         = true;
+        }
+        else if( info->rf64 && size == 0xFFFFFFFF )
+        {
+            return false;                                        /* ds64 table entries are not supported */
+        }
+
+        pos += 8 + size + ( size & 1 );
+    }
+
+    return haveFmt && haveData;
+}
+
+/**
+ * Reads the header of an open WAV file and leaves 'fp' at the first sample.
+ */
+bool ReadWavHeader( FILE* fp, WavInfo* info )
+{
+    if( fp == 0 || fseeko( fp, 0, SEEK_END ) != 0 )
+        return false;
+
+    unsigned long long length = ftello( fp );
+
+    bool ok = parseWav( [ fp ]( unsigned long long offset, void* dest, size_t bytes )
+    {
+        return fseeko( fp, ( off_t )offset, SEEK_SET ) == 0 && fread( dest, 1, bytes, fp ) == bytes;
+    }, length, info );
+
+    return ok && fseeko( fp, ( off_t )info->dataOffset, SEEK_SET ) == 0;
+}
+
+/**
+ * As ReadWavHeader, for a file that is already in memory or mapped.
+ */
+bool ParseWavHeader( const void* data, unsigned long long length, WavInfo* info )
+{
+    const unsigned char* bytes = ( const unsigned char* )data;
+
+    if( data == 0 )
+        return false;
+
+    return parseWav( [ bytes, length ]( unsigned long long offset, void* dest, size_t count )
+    {
+        if( offset > length || count > length - offset )
+            return false;
+
+        memcpy( dest, bytes + offset, count );
+        return true;
+    }, length, info );
+}
+
+/**
+ * Fills 'exinfo' so FMOD_OPENRAW plays the data chunk described by 'info'. FMOD Ex does
+ * not parse RF64/BW64 itself, and its offsets and lengths are 32-bit, so anything past
+ * the first 4 GB of the file cannot be reached through FMOD; that is reported and cut.
+ */
+bool WavRawExInfo( const WavInfo& info, FMOD_CREATESOUNDEXINFO* exinfo )
+{
+    FMOD_SOUND_FORMAT format;
+
+    if( info.floatSamples )
+        format = ( info.bits == 32 ? FMOD_SOUND_FORMAT_PCMFLOAT : FMOD_SOUND_FORMAT_NONE );
+    else if( info.bits == 16 )
+        format = FMOD_SOUND_FORMAT_PCM16;
+    else if( info.bits == 24 )
+        format = FMOD_SOUND_FORMAT_PCM24;
+    else if( info.bits == 32 )
+        format = FMOD_SOUND_FORMAT_PCM32;
+    else
+        format = FMOD_SOUND_FORMAT_NONE;    /* 8-bit WAV is unsigned, FMOD's raw PCM8 is not */
+
+    if( exinfo == 0 || format == FMOD_SOUND_FORMAT_NONE || info.channels <= 0 )
+    {
+        DEBUG_OUT( "Unsupported WAV sample format" );
+        return false;
     }
+
+    if( info.dataOffset + info.dataLength > 0xFFFFFFFFull )
+        DEBUG_OUT( "WAV data extends past 4 GB; FMOD Ex will only see the first 4 GB" );
+
+    unsigned long long limit = 0xFFFFFFFFull - std::min( info.dataOffset, 0xFFFFFFFFull );
+    unsigned           align = info.channels * info.bits / 8;
+
+    exinfo->fileoffset       = ( unsigned )info.dataOffset;
+    exinfo->length           = ( unsigned )( std::min( info.dataLength, limit ) / align * align );
+    exinfo->numchannels      = info.channels;
+    exinfo->defaultfrequency = ( int )info.rate;
+    exinfo->format           = format;
+
+    return true;
+}
+
+//------------------------------------------------------------------------------------------
+
+/**
+ * Writes a whole sound as WAV, WAV_WRITE_CHUNK bytes per lock and fwrite. If a lock or
+ * write fails the header is rewritten with the bytes that did reach the file, so it
+ * never claims more data than there is.
+ */
+STATUS SaveToWav( FMOD::Sound* sound, const char* file_name )
+{
+    if( sound == 0 || file_name == 0 )
+    {
+        DEBUG_OUT( "sound or file_name == NULL" );
+        return PARAM_NULL_PASSED;
+    }
+
+    FMOD_SOUND_FORMAT format;
+    int               channels, bits;
+    float             rate;
+    unsigned          length = 0;
+
+    sound->getFormat( 0, &format, &channels, &bits );
+    sound->getDefaults( &rate, 0, 0, 0 );
+    sound->getLength( &length, FMOD_TIMEUNIT_PCMBYTES );
+
+    FILE* fp = fopen( file_name, "wb" );
+
+    if( fp == 0 )
+    {
+        DEBUG_OUT( "Unable to open output file" );
+        DEBUG_OUT( file_name );
+        return FILE_OPEN_FAILED;
+    }
+
+    bool floatSamples = ( format == FMOD_SOUND_FORMAT_PCMFLOAT );
+
+    if( !WriteWavHeader( fp, channels, bits, rate, length, floatSamples ) )
+    {
+        DEBUG_OUT( "Unable to write WAV header" );
+        fclose( fp );
+        return FILE_WRITE_FAILED;
+    }
+
+    //------------------------------------------------
+    // Whole frames per lock, so a chunk never splits a sample
+
+    unsigned           frameBytes = std::max( 1, channels * bits / 8 );
+    unsigned           chunk      = std::max( frameBytes, WAV_WRITE_CHUNK / frameBytes * frameBytes );
+    unsigned long long written    = 0;
+    STATUS             status     = OK;
+
+    while( status == OK && written < length )
+    {
+        void     *ptr1, *ptr2;
+        unsigned  len1, len2;
+        unsigned  bytes = ( unsigned )std::min< unsigned long long >( length - written, chunk );
+
+        if( sound->lock( ( unsigned )written, bytes, &ptr1, &ptr2, &len1, &len2 ) != FMOD_OK )
+        {
+            status = SOUND_LOCK_FAILED;
+            break;
+        }
+
+        size_t expected = len1 + ( ptr2 != 0 ? len2 : 0 );
+        size_t out      = fwrite( ptr1, 1, len1, fp );
+
+        if( out == len1 && ptr2 != 0 )
+            out += fwrite( ptr2, 1, len2, fp );
+
+        sound->unlock( ptr1, ptr2, len1, len2 );
+
+        written += out;
+
+        if( expected == 0 )
+            status = SOUND_LOCK_FAILED;
+        else if( out != expected )
+            status = FILE_WRITE_FAILED;
+    }
+
+    if( status != OK )
+    {
+        DEBUG_OUT( status == SOUND_LOCK_FAILED ? "Sound::lock failed while saving WAV" : "Short write while saving WAV" );
+        DEBUG_OUT( file_name );
+
+        fseeko( fp, 0, SEEK_SET );
+        WriteWavHeader( fp, channels, bits, rate, written, floatSamples );
+    }
+
+    if( fclose( fp ) != 0 && status == OK )
+    {
+        DEBUG_OUT( "Unable to close output file" );
+        status = FILE_WRITE_FAILED;
+    }
+
+    return status;
 }
@@ -3,10 +3,14 @@
 
 #include "fmod.hpp"
 #include "fmod_errors.h"
+#include "pitch_estimator.h"
+#include "energy_gate.h"
+#include "constant_q.h"
 
 #include <string>
 #include <vector>
 #include <iostream>
+#include <cstdio>
 
 //------------------------------------------------------------------------------------------
 
@@ -16,11 +20,24 @@
     #define __PACKED __attribute__((packed)) /* gcc packed */
 #endif
 
-#define MAX_NUM_CHANNELS  1
-#define OUTPUTRATE        48000
+#ifndef MAX_NUM_CHANNELS
+#define MAX_NUM_CHANNELS  64        /* System::init channel count; override with DEFINES */
+#endif
+
+#define OUTPUTRATE        48000     /* fallback when a device or mixer does not report its rate */
 #define SPECTRUMSIZE      8192
-#define SPECTRUMRANGE     ((float)OUTPUTRATE / 2.0f)      /* 0 to nyquist */
-#define BINSIZE           (SPECTRUMRANGE / (float)SPECTRUMSIZE)
+
+#define WAV_HEADER_SIZE   80        /* RIFF + JUNK/ds64 + fmt + data headers, see WriteWavHeader */
+#define WAV_READ_CHUNK    ( 16u << 20 )  /* LoadFileIntoMemory fread size */
+#define WAV_WRITE_CHUNK   ( 1u << 20 )   /* SaveToWav lock and fwrite size */
+
+#define POLY_MAX_PEAKS    64        /* spectral peaks considered per frame */
+#define POLY_HARMONICS    8         /* partials summed per candidate fundamental */
+#define POLY_MIN_HZ       27.5f     /* A0 */
+#define POLY_MAX_HZ       4200.0f   /* just above C8 */
+#define POLY_TOLERANCE    0.03f     /* relative distance a partial may be from h * f0 */
+#define POLY_MIN_SALIENCE 0.1f      /* voices weaker than this fraction of the first are dropped */
+
 
 //------------------------------------------------------------------------------------------
 
@@ -37,14 +54,22 @@ enum STATUS
     DRIVER_FETCH_FAILED,
     SOUND_CREATION_FAILED,
     SOUND_FROM_FILE_FAILED,
-    CHANNEL_SPECTRUM_READ_FAILED
+    SOUND_PLAY_FAILED,
+    CHANNEL_SPECTRUM_READ_FAILED,
+    CHANNEL_WAVEDATA_READ_FAILED,
+    SOUND_LOCK_FAILED,
+    FILE_OPEN_FAILED,
+    FILE_WRITE_FAILED,
+    DSP_CREATION_FAILED
 };
 
 enum OUTPUT_TYPE
 {
     OSS = 0,
     ALSA,
-    ESD
+    ESD,
+    NOSOUND,
+    NOSOUND_NRT     /* no device, mixer advances one block per System::update */
 };
 
 enum FMOD_STATE
@@ -58,22 +83,76 @@ struct Pitch
 {
     float hz;
     float noteHz;
+    float cents;            /* hz relative to noteHz */
+    float confidence;       /* 0..1, see fmodDetectPitch* */
+    float salience;         /* harmonic sum, for ranking the voices of fmodDetectPitches* */
     const char* note;
+    bool  unvoiced;         /* gated as silence or nothing found; hz, noteHz and cents are 0 */
+};
+
+struct CaptureFormat
+{
+    int               rate;
+    int               channels;
+    FMOD_SOUND_FORMAT format;       /* FMOD_SOUND_FORMAT_PCM16 or FMOD_SOUND_FORMAT_PCMFLOAT */
+};
+
+struct WavInfo
+{
+    int                channels;
+    int                bits;
+    float              rate;
+    bool               floatSamples;
+    bool               rf64;          /* RF64 or BW64: sizes came from the ds64 chunk */
+    unsigned long long dataOffset;    /* byte offset of the first sample */
+    unsigned long long dataLength;    /* bytes of sample data, clamped to the file */
+};
+
+struct DriverInfo
+{
+    std::string name;
+    FMOD_GUID   guid;
+    int         rate;       /* playback: control panel rate; record: highest supported rate */
+    int         channels;   /* playback: from the speaker mode; record: 0, FMOD Ex does not say */
+    FMOD_CAPS   caps;
 };
 
 void   DEBUG_OUT( const char* );
 STATUS fmodSetup( FMOD::System** system );
-STATUS fmodSystemInit( FMOD::System* system );
-STATUS fmodCreateSound( FMOD::System* system, FMOD::Sound** sound, unsigned max_length );
+STATUS fmodSystemInit( FMOD::System* system, FMOD_INITFLAGS flags = FMOD_INIT_NORMAL );
+STATUS fmodCreateSound( FMOD::System* system, FMOD::Sound** sound, unsigned max_length, const CaptureFormat* format = 0 );
+STATUS fmodGetCaptureFormat( FMOD::System* system, int record_driver, CaptureFormat* format, int channels = 1 );
+float  fmodSpectrumBinSize( FMOD::System* system, unsigned bins = SPECTRUMSIZE );
 STATUS fmodCreateSoundFromFile( FMOD::System* system, FMOD::Sound** sound, const char* file );
+void   fmodReleaseSound( FMOD::Sound* sound );
 STATUS fmodSetOutputType( FMOD::System* system, OUTPUT_TYPE output = OSS );
 STATUS fmodSetPlaybackDriver( FMOD::System* system, unsigned playback_driver );
-STATUS fmodDetectPitch( FMOD::System* system, FMOD::Channel* channel, Pitch* pitch );
+// fmodReadSpectrum, fmodDetectPitch and fmodDetectPitches share one spectrum buffer per
+// thread; fmodLastSpectrum returns the calling thread's.
+STATUS fmodReadSpectrum( FMOD::Channel* channel );
+const float* fmodLastSpectrum( );
+STATUS fmodDetectPitch( FMOD::System* system, FMOD::Channel* channel, Pitch* pitch, EnergyGate* gate = 0 );
+STATUS fmodDetectPitchFromSpectrum( const float* spectrum, unsigned bins, float bin_size, Pitch* pitch );
+STATUS fmodDetectPitchFromConstantQ( const float* magnitudes, const ConstantQ& cqt, Pitch* pitch );
+STATUS fmodDetectPitches( FMOD::System* system, FMOD::Channel* channel, Pitch* pitches, unsigned max_pitches, unsigned* count );
+STATUS fmodDetectPitchesFromSpectrum( const float* spectrum, unsigned bins, float bin_size, Pitch* pitches, unsigned max_pitches, unsigned* count );
+STATUS fmodDetectPitchTimeDomain( FMOD::System* system, FMOD::Channel* channel, PitchEstimator* estimator, Pitch* pitch, EnergyGate* gate = 0 );
+STATUS fmodDetectPitchFromPCM( PitchEstimator* estimator, const float* samples, Pitch* pitch, EnergyGate* gate = 0 );
+void   fmodUnvoicedPitch( Pitch* pitch, float confidence = 0.0f );
+STATUS fmodReadPCM( FMOD::Sound* sound, unsigned offset, unsigned frames, float* mono, unsigned* read );
+
+void fmodConvertToMono( const void* data, unsigned frames, FMOD_SOUND_FORMAT format, int channels, float* mono );
 
-void SaveToWav(FMOD::Sound *sound, const char* file_name );
-bool LoadFileIntoMemory( const char *name, void **buff, int *length );
+STATUS SaveToWav( FMOD::Sound* sound, const char* file_name );
+bool WriteWavHeader( FILE* fp, int channels, int bits, float rate, unsigned long long data_length, bool float_samples = false );
+bool ReadWavHeader( FILE* fp, WavInfo* info );
+bool ParseWavHeader( const void* data, unsigned long long length, WavInfo* info );
+bool WavRawExInfo( const WavInfo& info, FMOD_CREATESOUNDEXINFO* exinfo );
+bool LoadFileIntoMemory( const char *name, void **buff, unsigned long long *length );
 
 std::vector< std::string > getDrivers( FMOD::System* system, STATUS* error, bool record_drivers = true );
+STATUS fmodGetDriverInfo( FMOD::System* system, int index, bool record_driver, DriverInfo* info );
+STATUS fmodGetDriverCaps( FMOD::System* system, int index, bool record_driver, DriverInfo* info );
 
 //------------------------------------------------------------------------------------------
 
@@ -0,0 +1,21 @@
+#-------------------------------------------------
+#
+# Headless batch pitch analysis. No Qt.
+#
+#-------------------------------------------------
+
+TARGET = fmodbatch
+TEMPLATE = app
+
+CONFIG += console
+CONFIG -= qt app_bundle
+
+#-------------------------------------------------
+#-------------------------------------------------
+
+include( ../fmod_common.pri )
+
+#-------------------------------------------------
+#-------------------------------------------------
+
+SOURCES += main.cpp
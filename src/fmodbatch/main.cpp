@@ -0,0 +1,838 @@
+/**
+ * Headless batch pitch analysis.
+ *
+ * By default every WAV file is played through its own FMOD::System using the
+ * non-realtime no-sound output, so each System::update mixes one DSP block as fast as
+ * the CPU allows instead of waiting on a sound card. With '-m stft' the mixer is
+ * skipped altogether: the file is decoded with Sound::readData and analysed by an
+ * Stft over the raw PCM ('-m cqt' reads note-aligned ConstantQ bins instead). Files
+ * are shared out between one worker thread (and one System) per core, and results are
+ * written per frame to a CSV or JSON file alongside each input. With '-s' a
+ * NoteSegmenter also turns the same frames into a note timeline, written next to the
+ * per-frame results. Frames an EnergyGate finds silent are written unvoiced without
+ * being analysed ('-g'). The decoded modes first resample every file to one analysis
+ * rate ('-a'), so a corpus of mixed rates is analysed with the same frame length in
+ * seconds and the same bin size throughout. '-m poly' reports up to '-v' voices per
+ * frame from the same Stft spectrum, one row each with its rank.
+ */
+
+#include "fmod_resources.h"
+#include "stft.h"
+#include "note_segmenter.h"
+#include "resampler.h"
+#include "trace.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <dirent.h>
+#include <strings.h>
+#include <sys/stat.h>
+
+//------------------------------------------------------------------------------------------
+
+enum OUTPUT_FORMAT
+{
+    CSV = 0,
+    JSON
+};
+
+enum ANALYSIS_MODE
+{
+    MODE_SPECTRUM = 0,      /* Channel::getSpectrum on a playing NRT channel */
+    MODE_STFT,              /* Stft over PCM from Sound::readData, no mixer */
+    MODE_YIN,               /* PitchEstimator over the same decoded PCM */
+    MODE_MCLEOD,
+    MODE_CQT,               /* ConstantQ note bins over the same decoded PCM */
+    MODE_POLY               /* up to BatchOptions::voices pitches per Stft frame */
+};
+
+struct BatchOptions
+{
+    unsigned      threads;
+    unsigned      blockSize;
+    unsigned      frameSize;
+    bool          recursive;
+    bool          notes;
+    bool          gate;         /* skip analysis of frames an EnergyGate finds silent */
+    float         gateDb;       /* its open threshold, dBFS RMS */
+    unsigned      analysisRate; /* decoded modes resample to this; 0 keeps each file's rate */
+    unsigned      voices;       /* most pitches per frame for '-m poly' */
+    OUTPUT_FORMAT format;
+    ANALYSIS_MODE mode;
+    WINDOW_TYPE   window;
+    std::string   outputDir;
+    std::string   traceFile;
+};
+
+struct BatchJob
+{
+    std::string path;
+    STATUS      status;
+    unsigned    lengthMs;
+    unsigned    frames;
+    unsigned    notes;
+};
+
+//------------------------------------------------------------------------------------------
+
+static void printUsage( const char* name )
+{
+    fprintf( stderr,
+             "usage: %s [options] <file.wav | directory>...\n"
+             "\n"
+             "  -j <threads>   worker threads (default: one per core)\n"
+             "  -m spectrum|stft|yin|mcleod|cqt|poly\n"
+             "                 analyse through the mixer, or straight from the decoded PCM with an\n"
+             "                 stft spectrum peak, a time-domain estimator, constant-Q note bins or\n"
+             "                 several stft voices per frame (default: spectrum)\n"
+             "  -v <voices>    most voices per frame for poly, one row each (default: 4)\n"
+             "  -b <samples>   DSP block size, i.e. the analysis hop (default: 1024)\n"
+             "  -n <samples>   stft frame / estimator window size (default: 8192, 2048 for yin and mcleod)\n"
+             "  -w hann|blackman  stft window (default: hann)\n"
+             "  -f csv|json    output format (default: csv)\n"
+             "  -o <dir>       write results into <dir> instead of next to each input\n"
+             "  -r             recurse into sub-directories\n"
+             "  -s             also write a note timeline (onsets, durations, pitch) per file\n"
+             "  -g <dB>|off    energy gate: frames quieter than <dB> RMS are not analysed and are\n"
+             "                 written unvoiced (default: -50)\n"
+             "  -a <Hz>|native resample decoded PCM to <Hz> before analysis, or keep each file's\n"
+             "                 own rate; decoded modes only (default: 48000)\n"
+             "  -t <file>      write a Chrome trace of the run and print per-stage timings\n",
+             name );
+}
+
+static bool isWavFile( const std::string& path )
+{
+    return path.size( ) > 4 && strcasecmp( path.c_str( ) + path.size( ) - 4, ".wav" ) == 0;
+}
+
+static void collectFiles( const std::string& path, bool recursive, std::vector< std::string >& files )
+{
+    struct stat info;
+
+    if( stat( path.c_str( ), &info ) != 0 )
+    {
+        DEBUG_OUT( "Unable to stat input path" );
+        DEBUG_OUT( path.c_str( ) );
+        return;
+    }
+
+    if( !S_ISDIR( info.st_mode ) )
+    {
+        files.push_back( path );
+        return;
+    }
+
+    DIR* dir = opendir( path.c_str( ) );
+
+    if( dir == 0 )
+    {
+        DEBUG_OUT( "Unable to open directory" );
+        DEBUG_OUT( path.c_str( ) );
+        return;
+    }
+
+    struct dirent* entry;
+
+    while( ( entry = readdir( dir ) ) != 0 )
+    {
+        if( entry->d_name[ 0 ] == '.' )
+            continue;
+
+        std::string child = path + "/" + entry->d_name;
+
+        if( stat( child.c_str( ), &info ) != 0 )
+            continue;
+
+        if( S_ISDIR( info.st_mode ) )
+        {
+            if( recursive )
+                collectFiles( child, recursive, files );
+        }
+        else if( isWavFile( child ) )
+        {
+            files.push_back( child );
+        }
+    }
+
+    closedir( dir );
+}
+
+static std::string outputPathFor( const std::string& input, const BatchOptions& options, const char* kind = "pitch" )
+{
+    std::string extension = std::string( "." ) + kind + ( options.format == JSON ? ".json" : ".csv" );
+
+    if( options.outputDir.empty( ) )
+        return input + extension;
+
+    size_t slash = input.find_last_of( '/' );
+    std::string base = ( slash == std::string::npos ? input : input.substr( slash + 1 ) );
+
+    return options.outputDir + "/" + base + extension;
+}
+
+static void writeJsonString( FILE* fp, const char* str )
+{
+    fputc( '"', fp );
+
+    for( ; *str; str++ )
+    {
+        if( *str == '"' || *str == '\\' )
+            fputc( '\\', fp );
+
+        if( ( unsigned char )*str < 0x20 )
+            fprintf( fp, "\\u%04x", ( unsigned char )*str );
+        else
+            fputc( *str, fp );
+    }
+
+    fputc( '"', fp );
+}
+
+//------------------------------------------------------------------------------------------
+
+static void writeHeader( FILE* fp, const BatchJob* job, const BatchOptions& options )
+{
+    if( options.format == JSON )
+    {
+        fputs( "{\n  \"file\": ", fp );
+        writeJsonString( fp, job->path.c_str( ) );
+        fputs( ",\n  \"frames\": [", fp );
+    }
+    else
+    {
+        fputs( ( options.mode == MODE_POLY ? "time_ms,voice,hz,note_hz,cents,note\n" : "time_ms,hz,note_hz,cents,note\n" ), fp );
+    }
+}
+
+/**
+ * One result row; '-m poly' writes one per voice, strongest first, with its rank.
+ */
+static void writeFrame( FILE* fp, BatchJob* job, const BatchOptions& options, unsigned position, const Pitch& pitch, unsigned voice = 0 )
+{
+    bool poly = ( options.mode == MODE_POLY );
+
+    if( options.format == JSON )
+    {
+        fprintf( fp, "%s\n    { \"time_ms\": %u, ", ( job->frames == 0 ? "" : "," ), position );
+
+        if( poly )
+            fprintf( fp, "\"voice\": %u, ", voice );
+
+        fprintf( fp, "\"hz\": %.2f, \"note_hz\": %.2f, \"cents\": %.1f, \"note\": ", pitch.hz, pitch.noteHz, pitch.cents );
+        writeJsonString( fp, pitch.note );
+        fputs( " }", fp );
+    }
+    else if( poly )
+    {
+        fprintf( fp, "%u,%u,%.2f,%.2f,%.1f,%s\n", position, voice, pitch.hz, pitch.noteHz, pitch.cents, pitch.note );
+    }
+    else
+    {
+        fprintf( fp, "%u,%.2f,%.2f,%.1f,%s\n", position, pitch.hz, pitch.noteHz, pitch.cents, pitch.note );
+    }
+
+    job->frames++;
+}
+
+static void writeFooter( FILE* fp, const BatchOptions& options )
+{
+    if( options.format == JSON )
+        fputs( "\n  ]\n}\n", fp );
+}
+
+static void writeNotesHeader( FILE* fp, const BatchJob* job, const BatchOptions& options )
+{
+    if( options.format == JSON )
+    {
+        fputs( "{\n  \"file\": ", fp );
+        writeJsonString( fp, job->path.c_str( ) );
+        fputs( ",\n  \"notes\": [", fp );
+    }
+    else
+    {
+        fputs( "start_ms,duration_ms,hz,cents,confidence,note\n", fp );
+    }
+}
+
+static void writeNote( FILE* fp, BatchJob* job, const BatchOptions& options, const NoteEvent& note )
+{
+    unsigned start    = ( unsigned )( note.start * 1000.0 + 0.5 );
+    unsigned duration = ( unsigned )( note.duration * 1000.0 + 0.5 );
+
+    if( options.format == JSON )
+    {
+        fprintf( fp, "%s\n    { \"start_ms\": %u, \"duration_ms\": %u, \"hz\": %.2f, \"cents\": %.1f, \"confidence\": %.2f, \"note\": ",
+                 ( job->notes == 0 ? "" : "," ), start, duration, note.hz, note.cents, note.confidence );
+        writeJsonString( fp, note.note );
+        fputs( " }", fp );
+    }
+    else
+    {
+        fprintf( fp, "%u,%u,%.2f,%.1f,%.2f,%s\n", start, duration, note.hz, note.cents, note.confidence, note.note );
+    }
+
+    job->notes++;
+}
+
+/**
+ * A NoteSegmenter that writes each note to 'fp', or null when '-s' is off.
+ */
+static NoteSegmenter* createSegmenter( FILE* fp, BatchJob* job, const BatchOptions& options, unsigned bins, float bin_size, PITCH_METHOD method )
+{
+    if( fp == 0 )
+        return 0;
+
+    return new NoteSegmenter( bins, bin_size, [ fp, job, &options ]( const NoteEvent& note )
+    {
+        writeNote( fp, job, options, note );
+    }, NoteSegmenter::minConfidenceFor( method ) );
+}
+
+//------------------------------------------------------------------------------------------
+
+/**
+ * Plays the sound through the (NRT) system and records one Pitch per mixed block.
+ */
+static STATUS analyseThroughMixer( FMOD::System* system, FMOD::Sound* sound, FILE* fp, FILE* notesFp, BatchJob* job, const BatchOptions& options )
+{
+    FMOD_RESULT    result;
+    FMOD::Channel* channel = 0;
+    NoteSegmenter* notes   = createSegmenter( notesFp, job, options, SPECTRUMSIZE, fmodSpectrumBinSize( system ), PITCH_SPECTRUM_PEAK );
+    EnergyGate     gate( options.gateDb, options.gateDb - ( GATE_OPEN_DB - GATE_CLOSE_DB ) );
+
+    result = system->playSound( FMOD_CHANNEL_FREE, sound, false, &channel );
+
+    if( result != FMOD_OK )
+    {
+        DEBUG_OUT( FMOD_ErrorString( result ) );
+        return SOUND_PLAY_FAILED;
+    }
+
+    STATUS   status   = OK;
+    bool     playing  = true;
+    unsigned position = 0;
+
+    while( playing )
+    {
+        Pitch pitch;
+
+        channel->getPosition( &position, FMOD_TIMEUNIT_MS );
+
+        // fmodDetectPitch also calls System::update, which under NRT output mixes the next block.
+        status = fmodDetectPitch( system, channel, &pitch, ( options.gate ? &gate : 0 ) );
+
+        if( status != OK )
+            break;
+
+        writeFrame( fp, job, options, position, pitch );
+
+        // The spectrum fmodDetectPitch just analysed.
+        if( notes != 0 )
+            notes->process( position / 1000.0, fmodLastSpectrum( ), pitch );
+
+        if( channel->isPlaying( &playing ) != FMOD_OK )
+            playing = false;
+    }
+
+    if( notes != 0 )
+        notes->finish( job->lengthMs / 1000.0 );
+
+    delete notes;
+
+    return status;
+}
+
+/**
+ * Decodes the sound with Sound::readData and analyses the raw PCM frame by frame,
+ * with an Stft spectrum peak or its top voices, a time-domain PitchEstimator or a
+ * ConstantQ. The ConstantQ keeps its own history, so it is only handed each new hop.
+ */
+static STATUS analyseDecoded( FMOD::Sound* sound, FILE* fp, FILE* notesFp, BatchJob* job, const BatchOptions& options )
+{
+    FMOD_RESULT       result;
+    FMOD_SOUND_FORMAT format;
+    int               channels, bits;
+    float             rate;
+
+    sound->getFormat( 0, &format, &channels, &bits );
+    sound->getDefaults( &rate, 0, 0, 0 );
+
+    unsigned frameBytes = channels * bits / 8;
+
+    if( frameBytes == 0 || rate <= 0.0f )
+        return SOUND_FROM_FILE_FAILED;
+
+    Resampler* resampler = 0;
+
+    if( options.analysisRate != 0 && ( unsigned )( rate + 0.5f ) != options.analysisRate )
+    {
+        resampler = new Resampler( ( unsigned )( rate + 0.5f ), options.analysisRate );
+        rate      = ( float )options.analysisRate;
+    }
+
+    Stft*           stft      = 0;
+    PitchEstimator* estimator = 0;
+    ConstantQ*      cqt       = 0;
+    unsigned        size;
+
+    if( options.mode == MODE_STFT || options.mode == MODE_POLY )
+    {
+        stft = new Stft( options.frameSize, options.blockSize, options.window );
+        size = stft->frameSize( );
+    }
+    else if( options.mode == MODE_CQT )
+    {
+        cqt  = new ConstantQ( rate );
+        size = options.frameSize;
+    }
+    else
+    {
+        estimator = new PitchEstimator( ( options.mode == MODE_MCLEOD ? PITCH_MCLEOD : PITCH_YIN ), options.frameSize, rate );
+        size      = estimator->windowSize( );
+    }
+
+    unsigned hop = std::min( options.blockSize, size );
+
+    // Time-domain estimators have no spectrum of their own; onsets need one.
+    Stft* onsets = ( notesFp != 0 && stft == 0 ? new Stft( size, hop, WINDOW_HANN ) : 0 );
+    Stft* source = ( stft != 0 ? stft : onsets );
+
+    NoteSegmenter* notes = createSegmenter( notesFp, job, options, ( source != 0 ? source->bins( ) : 0 ), rate / ( float )size,
+                                            ( options.mode == MODE_MCLEOD ? PITCH_MCLEOD : options.mode == MODE_YIN ? PITCH_YIN : PITCH_SPECTRUM_PEAK ) );
+
+    std::vector< unsigned char > raw( 4096 * frameBytes );
+    std::vector< float >         mono( 4096 );
+    std::vector< float >         resampled( resampler != 0 ? resampler->maxOutput( 4096 ) + resampler->maxOutput( resampler->taps( ) ) : 0 );
+    std::vector< float >         frame( size );
+    std::vector< float >         spectrum( source != 0 ? source->bins( ) : 0 );
+    std::vector< float >         noteBins( cqt != 0 ? cqt->bins( ) : 0 );
+    std::vector< Pitch >         voices( std::max( 1u, options.voices ) );
+    EnergyGate                   gate( options.gateDb, options.gateDb - ( GATE_OPEN_DB - GATE_CLOSE_DB ) );
+
+    unsigned fill  = 0;
+    unsigned index = 0;
+
+    for( bool done = false; !done; )
+    {
+        unsigned bytes = 0;
+
+        result = sound->readData( &raw[ 0 ], ( unsigned )raw.size( ), &bytes );
+        done   = ( bytes == 0 || result != FMOD_OK );
+
+        unsigned     frames = bytes / frameBytes;
+        const float* input  = &mono[ 0 ];
+
+        fmodConvertToMono( &raw[ 0 ], frames, format, channels, &mono[ 0 ] );
+
+        if( resampler != 0 )
+        {
+            TRACE_SCOPE( TRACE_LEVEL_DEBUG, "resample" );
+
+            frames = resampler->process( &mono[ 0 ], frames, &resampled[ 0 ] );
+
+            if( done )
+                frames += resampler->flush( &resampled[ frames ] );
+
+            input = &resampled[ 0 ];
+        }
+
+        for( unsigned used = 0; used < frames; )
+        {
+            unsigned take = std::min( frames - used, size - fill );
+
+            memcpy( &frame[ fill ], &input[ used ], take * sizeof( float ) );
+            fill += take;
+            used += take;
+
+            if( fill < size )
+                break;
+
+            Pitch    pitch;
+            unsigned count = 0;
+
+            if( cqt != 0 )
+            {
+                TRACE_SCOPE( TRACE_LEVEL_DEBUG, "cqt push" );
+                cqt->push( &frame[ index == 0 ? 0 : size - hop ], ( index == 0 ? size : hop ) );
+            }
+
+            if( options.gate && !gate.process( &frame[ size - std::min( size, ( unsigned )GATE_WINDOW ) ], std::min( size, ( unsigned )GATE_WINDOW ) ) )
+            {
+                std::fill( spectrum.begin( ), spectrum.end( ), 0.0f );
+                fmodUnvoicedPitch( &pitch );
+            }
+            else if( stft != 0 )
+            {
+                {
+                    TRACE_SCOPE( TRACE_LEVEL_DEBUG, "stft" );
+                    stft->analyse( &frame[ 0 ], &spectrum[ 0 ] );
+                }
+
+                if( options.mode == MODE_POLY )
+                {
+                    fmodDetectPitchesFromSpectrum( &spectrum[ 0 ], stft->bins( ), rate / ( float )size, &voices[ 0 ], ( unsigned )voices.size( ), &count );
+
+                    if( count > 0 )
+                        pitch = voices[ 0 ];
+                    else
+                        fmodUnvoicedPitch( &pitch );
+                }
+                else
+                    fmodDetectPitchFromSpectrum( &spectrum[ 0 ], stft->bins( ), rate / ( float )size, &pitch );
+            }
+            else if( cqt != 0 )
+            {
+                {
+                    TRACE_SCOPE( TRACE_LEVEL_DEBUG, "cqt" );
+                    cqt->analyse( &noteBins[ 0 ] );
+                }
+
+                fmodDetectPitchFromConstantQ( &noteBins[ 0 ], *cqt, &pitch );
+
+                if( onsets != 0 )
+                    onsets->analyse( &frame[ 0 ], &spectrum[ 0 ] );
+            }
+            else
+            {
+                fmodDetectPitchFromPCM( estimator, &frame[ 0 ], &pitch );
+
+                if( onsets != 0 )
+                    onsets->analyse( &frame[ 0 ], &spectrum[ 0 ] );
+            }
+
+            unsigned position = ( unsigned )( ( double )index * hop * 1000.0 / rate );
+
+            if( count > 1 )
+            {
+                for( unsigned v = 0; v < count; v++ )
+                    writeFrame( fp, job, options, position, voices[ v ], v );
+            }
+            else
+                writeFrame( fp, job, options, position, pitch );
+
+            if( notes != 0 )
+                notes->process( ( double )index * hop / rate, &spectrum[ 0 ], pitch );
+
+            index++;
+
+            memmove( &frame[ 0 ], &frame[ hop ], ( size - hop ) * sizeof( float ) );
+            fill = size - hop;
+        }
+    }
+
+    if( notes != 0 )
+        notes->finish( ( double )index * hop / rate );
+
+    delete notes;
+    delete resampler;
+    delete onsets;
+    delete stft;
+    delete cqt;
+    delete estimator;
+
+    return OK;
+}
+
+/**
+ * Opens a single file and writes one Pitch per analysis frame to its result file.
+ */
+static STATUS analyseFile( FMOD::System* system, BatchJob* job, const BatchOptions& options )
+{
+    FMOD_RESULT  result;
+    FMOD::Sound* sound = 0;
+    FMOD_MODE    mode  = FMOD_SOFTWARE | FMOD_2D | FMOD_LOOP_OFF | FMOD_ACCURATETIME;
+
+    //------------------------------------------------
+
+    if( options.mode != MODE_SPECTRUM )
+        mode |= FMOD_OPENONLY;
+
+    // FMOD Ex cannot parse RF64/BW64, so long captures are streamed as raw PCM.
+    FMOD_CREATESOUNDEXINFO exInfo;
+    WavInfo                wav;
+    FILE*                  probe = fopen( job->path.c_str( ), "rb" );
+    bool                   raw   = probe != 0 && ReadWavHeader( probe, &wav ) && wav.rf64;
+
+    if( probe != 0 )
+        fclose( probe );
+
+    memset( &exInfo, 0, sizeof( FMOD_CREATESOUNDEXINFO ) );
+    exInfo.cbsize = sizeof( FMOD_CREATESOUNDEXINFO );
+
+    if( raw )
+    {
+        if( !WavRawExInfo( wav, &exInfo ) )
+            return SOUND_FROM_FILE_FAILED;
+
+        mode |= FMOD_OPENRAW;
+    }
+
+    result = system->createStream( job->path.c_str( ), mode, raw ? &exInfo : 0, &sound );
+
+    if( result != FMOD_OK || sound == 0 )
+    {
+        DEBUG_OUT( FMOD_ErrorString( result ) );
+        DEBUG_OUT( job->path.c_str( ) );
+        return SOUND_FROM_FILE_FAILED;
+    }
+
+    sound->getLength( &job->lengthMs, FMOD_TIMEUNIT_MS );
+
+    std::string outPath = outputPathFor( job->path, options );
+    FILE* fp = fopen( outPath.c_str( ), "w" );
+
+    if( fp == 0 )
+    {
+        DEBUG_OUT( "Unable to open output file" );
+        DEBUG_OUT( outPath.c_str( ) );
+        sound->release( );
+        return FILE_OPEN_FAILED;
+    }
+
+    FILE* notesFp = 0;
+
+    if( options.notes )
+    {
+        std::string notesPath = outputPathFor( job->path, options, "notes" );
+        notesFp = fopen( notesPath.c_str( ), "w" );
+
+        if( notesFp == 0 )
+        {
+            DEBUG_OUT( "Unable to open notes file" );
+            DEBUG_OUT( notesPath.c_str( ) );
+            fclose( fp );
+            sound->release( );
+            return FILE_OPEN_FAILED;
+        }
+
+        writeNotesHeader( notesFp, job, options );
+    }
+
+    //------------------------------------------------
+
+    STATUS status;
+
+    writeHeader( fp, job, options );
+
+    if( options.mode == MODE_SPECTRUM )
+        status = analyseThroughMixer( system, sound, fp, notesFp, job, options );
+    else
+        status = analyseDecoded( sound, fp, notesFp, job, options );
+
+    writeFooter( fp, options );
+
+    fclose( fp );
+
+    if( notesFp != 0 )
+    {
+        writeFooter( notesFp, options );
+        fclose( notesFp );
+    }
+
+    sound->release( );
+
+    return status;
+}
+
+//------------------------------------------------------------------------------------------
+
+/**
+ * Each worker owns its System and every analysis buffer it fills, so workers share
+ * nothing but the job counter. The spectrum fmodDetectPitch reads is per thread too.
+ */
+static void worker( std::vector< BatchJob >* jobs, std::atomic< unsigned >* next, const BatchOptions* options )
+{
+    FMOD::System* system = 0;
+    STATUS        status;
+
+    status = fmodSetup( &system );
+
+    if( status == OK )
+        status = fmodSetOutputType( system, NOSOUND_NRT );
+
+    if( status == OK && system->setDSPBufferSize( options->blockSize, 4 ) != FMOD_OK )
+        DEBUG_OUT( "setDSPBufferSize failed, using the default block size" );
+
+    // Streams must decode from System::update, otherwise the NRT mixer outruns the stream thread.
+    if( status == OK )
+        status = fmodSystemInit( system, FMOD_INIT_STREAM_FROM_UPDATE );
+
+    for( unsigned i = ( *next )++; i < jobs->size( ); i = ( *next )++ )
+    {
+        BatchJob& job = ( *jobs )[ i ];
+
+        {
+            TRACE_SCOPE( TRACE_LEVEL_INFO, "file" );
+            job.status = ( status == OK ? analyseFile( system, &job, *options ) : status );
+        }
+
+        fprintf( stderr, "[%u/%u] %s %s (%u frames, %u notes, %.1f s)\n",
+                 i + 1, ( unsigned )jobs->size( ), ( job.status == OK ? "done" : "FAILED" ),
+                 job.path.c_str( ), job.frames, job.notes, job.lengthMs / 1000.0 );
+    }
+
+    if( system != 0 )
+        system->release( );
+}
+
+//------------------------------------------------------------------------------------------
+
+int main( int argc, char* argv[ ] )
+{
+    BatchOptions options;
+    std::vector< std::string > inputs;
+    unsigned frameSizeArg = 0;
+
+    options.threads      = std::max( 1u, std::thread::hardware_concurrency( ) );
+    options.blockSize    = 1024;
+    options.frameSize    = SPECTRUMSIZE;
+    options.recursive    = false;
+    options.notes        = false;
+    options.gate         = true;
+    options.gateDb       = GATE_OPEN_DB;
+    options.analysisRate = OUTPUTRATE;
+    options.voices       = 4;
+    options.format       = CSV;
+    options.mode         = MODE_SPECTRUM;
+    options.window       = WINDOW_HANN;
+
+    //------------------------------------------------
+
+    for( int i = 1; i < argc; i++ )
+    {
+        std::string arg = argv[ i ];
+
+        if( arg == "-j" && i + 1 < argc )
+            options.threads = std::max( 1, atoi( argv[ ++i ] ) );
+        else if( arg == "-b" && i + 1 < argc )
+            options.blockSize = std::max( 64, atoi( argv[ ++i ] ) );
+        else if( arg == "-n" && i + 1 < argc )
+            options.frameSize = frameSizeArg = std::max( 64, atoi( argv[ ++i ] ) );
+        else if( arg == "-m" && i + 1 < argc )
+        {
+            std::string mode = argv[ ++i ];
+
+            if( mode == "stft" )
+                options.mode = MODE_STFT;
+            else if( mode == "yin" )
+                options.mode = MODE_YIN;
+            else if( mode == "mcleod" )
+                options.mode = MODE_MCLEOD;
+            else if( mode == "cqt" )
+                options.mode = MODE_CQT;
+            else if( mode == "poly" )
+                options.mode = MODE_POLY;
+            else
+                options.mode = MODE_SPECTRUM;
+        }
+        else if( arg == "-w" && i + 1 < argc )
+            options.window = ( strcmp( argv[ ++i ], "blackman" ) == 0 ? WINDOW_BLACKMAN_HARRIS : WINDOW_HANN );
+        else if( arg == "-f" && i + 1 < argc )
+            options.format = ( strcmp( argv[ ++i ], "json" ) == 0 ? JSON : CSV );
+        else if( arg == "-o" && i + 1 < argc )
+            options.outputDir = argv[ ++i ];
+        else if( arg == "-t" && i + 1 < argc )
+            options.traceFile = argv[ ++i ];
+        else if( arg == "-r" )
+            options.recursive = true;
+        else if( arg == "-s" )
+            options.notes = true;
+        else if( arg == "-g" && i + 1 < argc )
+        {
+            options.gate = ( strcmp( argv[ ++i ], "off" ) != 0 );
+
+            if( options.gate )
+                options.gateDb = ( float )atof( argv[ i ] );
+        }
+        else if( arg == "-v" && i + 1 < argc )
+            options.voices = std::max( 1, atoi( argv[ ++i ] ) );
+        else if( arg == "-a" && i + 1 < argc )
+        {
+            ++i;
+            options.analysisRate = ( strcmp( argv[ i ], "native" ) == 0 ? 0 : ( unsigned )std::max( 1000, atoi( argv[ i ] ) ) );
+        }
+        else if( arg[ 0 ] == '-' )
+        {
+            printUsage( argv[ 0 ] );
+            return 1;
+        }
+        else
+            inputs.push_back( arg );
+    }
+
+    if( frameSizeArg == 0 && ( options.mode == MODE_YIN || options.mode == MODE_MCLEOD ) )
+        options.frameSize = 2048;
+
+    if( inputs.empty( ) )
+    {
+        printUsage( argv[ 0 ] );
+        return 1;
+    }
+
+    std::vector< std::string > files;
+
+    for( unsigned i = 0; i < inputs.size( ); i++ )
+        collectFiles( inputs[ i ], options.recursive, files );
+
+    std::sort( files.begin( ), files.end( ) );
+
+    std::vector< BatchJob > jobs( files.size( ) );
+
+    for( unsigned i = 0; i < files.size( ); i++ )
+    {
+        jobs[ i ].path     = files[ i ];
+        jobs[ i ].status   = OK;
+        jobs[ i ].lengthMs = 0;
+        jobs[ i ].frames   = 0;
+        jobs[ i ].notes    = 0;
+    }
+
+    //------------------------------------------------
+
+    std::atomic< unsigned >    next( 0 );
+    std::vector< std::thread > threads;
+    unsigned                   count = std::min( options.threads, std::max( 1u, ( unsigned )jobs.size( ) ) );
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now( );
+
+    for( unsigned i = 0; i < count; i++ )
+        threads.push_back( std::thread( worker, &jobs, &next, &options ) );
+
+    for( unsigned i = 0; i < threads.size( ); i++ )
+        threads[ i ].join( );
+
+    double wallSeconds  = std::chrono::duration< double >( std::chrono::steady_clock::now( ) - start ).count( );
+    double audioSeconds = 0.0;
+    unsigned failed     = 0;
+
+    for( unsigned i = 0; i < jobs.size( ); i++ )
+    {
+        audioSeconds += jobs[ i ].lengthMs / 1000.0;
+
+        if( jobs[ i ].status != OK )
+            failed++;
+    }
+
+    fprintf( stderr, "%u files, %u failed, %.1f s of audio in %.1f s (%.1fx real time, %u threads)\n",
+             ( unsigned )jobs.size( ), failed, audioSeconds, wallSeconds,
+             ( wallSeconds > 0.0 ? audioSeconds / wallSeconds : 0.0 ), count );
+
+    if( !options.traceFile.empty( ) )
+    {
+        traceSummary( stderr );
+
+        if( !traceDumpChrome( options.traceFile.c_str( ) ) )
+            DEBUG_OUT( "Unable to write trace file" );
+    }
+
+    return ( failed == 0 ? 0 : 2 );
+}
@@ -0,0 +1,22 @@
+#-------------------------------------------------
+#
+# Microbenchmarks for the fmod_resources hot
+# paths. No Qt.
+#
+#-------------------------------------------------
+
+TARGET = fmodbench
+TEMPLATE = app
+
+CONFIG += console
+CONFIG -= qt app_bundle
+
+#-------------------------------------------------
+#-------------------------------------------------
+
+include( ../fmod_common.pri )
+
+#-------------------------------------------------
+#-------------------------------------------------
+
+SOURCES += main.cpp
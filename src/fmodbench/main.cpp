@@ -0,0 +1,719 @@
+/**
+ * Microbenchmarks for the fmod_resources hot paths.
+ *
+ * Drives fmodDetectPitch, the Stft, PitchEstimator and ConstantQ paths, the top-K
+ * voice search, a multi-stream PitchDetectorBatch, the energy gate, the resampler,
+ * the note lookup, LoadFileIntoMemory, fmodCreateSoundFromFile, SaveToWav and
+ * SaveToFlac with synthetic sine, chord and noise signals of several lengths. FMOD
+ * runs on the non-realtime no-sound output, so nothing waits on a device. Every
+ * result is printed as a table row on stderr and as one JSON object per line on
+ * stdout (or the -o file), with ns per frame, MB/s and heap allocations per call.
+ * Checks run alongside: a two-note mix must come out of fmodDetectPitchesFromSpectrum
+ * as its first two voices, every stream of a PitchDetectorBatch must get its own note
+ * back, and each FLAC file written is decoded again by FMOD and compared sample by
+ * sample. A failed check makes the exit code 2.
+ */
+
+#include "fmod_resources.h"
+#include "flac_encoder.h"
+#include "stft.h"
+#include "tuning.h"
+#include "pitch_estimator.h"
+#include "resampler.h"
+#include "constant_q.h"
+#include "pitch_detector.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+//------------------------------------------------------------------------------------------
+// Allocation counting.
+//
+// malloc and friends are interposed on glibc's implementation, which also catches
+// operator new; FMOD is pointed at the same functions through Memory_Initialize.
+
+static std::atomic< unsigned long long > allocations( 0 );
+static unsigned                          failedChecks = 0;
+
+extern "C"
+{
+    void* __libc_malloc( size_t size );
+    void* __libc_calloc( size_t count, size_t size );
+    void* __libc_realloc( void* ptr, size_t size );
+    void  __libc_free( void* ptr );
+
+    void* malloc( size_t size )
+    {
+        allocations.fetch_add( 1, std::memory_order_relaxed );
+        return __libc_malloc( size );
+    }
+
+    void* calloc( size_t count, size_t size )
+    {
+        allocations.fetch_add( 1, std::memory_order_relaxed );
+        return __libc_calloc( count, size );
+    }
+
+    void* realloc( void* ptr, size_t size )
+    {
+        allocations.fetch_add( 1, std::memory_order_relaxed );
+        return __libc_realloc( ptr, size );
+    }
+
+    void free( void* ptr )
+    {
+        __libc_free( ptr );
+    }
+}
+
+static void* F_CALLBACK fmodAlloc( unsigned int size, FMOD_MEMORY_TYPE, const char* )
+{
+    return malloc( size );
+}
+
+static void* F_CALLBACK fmodRealloc( void* ptr, unsigned int size, FMOD_MEMORY_TYPE, const char* )
+{
+    return realloc( ptr, size );
+}
+
+static void F_CALLBACK fmodFree( void* ptr, FMOD_MEMORY_TYPE, const char* )
+{
+    free( ptr );
+}
+
+//------------------------------------------------------------------------------------------
+
+enum SIGNAL
+{
+    SIGNAL_SINE = 0,        /* A4 */
+    SIGNAL_CHORD,           /* C4 E4 G4 */
+    SIGNAL_NOISE,
+    SIGNAL_COUNT
+};
+
+static const char* signalNames[ SIGNAL_COUNT ] = { "sine", "chord", "noise" };
+
+struct BenchOptions
+{
+    bool        quick;
+    std::string filter;
+    FILE*       json;
+};
+
+static void makeSignal( SIGNAL type, unsigned frames, float* out )
+{
+    unsigned seed = 12345;
+
+    for( unsigned i = 0; i < frames; i++ )
+    {
+        double t = ( double )i / ( double )OUTPUTRATE;
+
+        switch( type )
+        {
+        case SIGNAL_SINE:
+            out[ i ] = ( float )( 0.5 * sin( 2.0 * M_PI * 440.0 * t ) );
+            break;
+        case SIGNAL_CHORD:
+            out[ i ] = ( float )( 0.3 * sin( 2.0 * M_PI * 261.63 * t ) + 0.3 * sin( 2.0 * M_PI * 329.63 * t ) + 0.3 * sin( 2.0 * M_PI * 392.00 * t ) );
+            break;
+        default:
+            seed   = seed * 1664525u + 1013904223u;
+            out[ i ] = ( float )( ( seed >> 8 ) / 16777216.0 - 0.5 );
+            break;
+        }
+    }
+}
+
+static void toPCM16( const float* in, unsigned frames, short* out )
+{
+    for( unsigned i = 0; i < frames; i++ )
+        out[ i ] = ( short )( std::max( -1.0f, std::min( 1.0f, in[ i ] ) ) * 32767.0f );
+}
+
+//------------------------------------------------------------------------------------------
+
+struct BenchResult
+{
+    std::string name;
+    std::string signal;
+    double      seconds;            /* length of the signal involved */
+    unsigned    iterations;
+    double      nsPerFrame;
+    double      mbPerSecond;
+    double      allocsPerCall;
+};
+
+static void report( const BenchOptions& options, const BenchResult& r )
+{
+    fprintf( stderr, "%-34s %-6s %6.1fs %8u %14.1f %10.1f %10.2f\n",
+             r.name.c_str( ), r.signal.c_str( ), r.seconds, r.iterations, r.nsPerFrame, r.mbPerSecond, r.allocsPerCall );
+
+    fprintf( options.json,
+             "{\"name\":\"%s\",\"signal\":\"%s\",\"length_s\":%.3f,\"iterations\":%u,\"ns_per_frame\":%.3f,\"mb_per_s\":%.3f,\"allocs_per_call\":%.3f}\n",
+             r.name.c_str( ), r.signal.c_str( ), r.seconds, r.iterations, r.nsPerFrame, r.mbPerSecond, r.allocsPerCall );
+    fflush( options.json );
+}
+
+/**
+ * Times 'iterations' calls of body( ) after one warm-up call. Each call processes
+ * 'frames' analysis frames (or items) and 'bytes' bytes of audio.
+ */
+template< typename BODY >
+static void measure( const BenchOptions& options, const char* name, const char* signal, double seconds,
+                     unsigned iterations, double frames, double bytes, BODY body )
+{
+    if( !options.filter.empty( ) && std::string( name ).find( options.filter ) == std::string::npos )
+        return;
+
+    body( );
+
+    unsigned long long before = allocations.load( );
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now( );
+
+    for( unsigned i = 0; i < iterations; i++ )
+        body( );
+
+    double elapsed = std::chrono::duration< double >( std::chrono::steady_clock::now( ) - start ).count( );
+
+    BenchResult r;
+
+    r.name          = name;
+    r.signal        = signal;
+    r.seconds       = seconds;
+    r.iterations    = iterations;
+    r.nsPerFrame    = elapsed * 1e9 / ( ( double )iterations * std::max( frames, 1.0 ) );
+    r.mbPerSecond   = ( bytes > 0.0 && elapsed > 0.0 ? bytes * iterations / elapsed / 1e6 : 0.0 );
+    r.allocsPerCall = ( double )( allocations.load( ) - before ) / ( double )iterations;
+
+    report( options, r );
+}
+
+//------------------------------------------------------------------------------------------
+
+/**
+ * A looping mono PCM16 sample holding the signal, filled through Sound::lock.
+ */
+static STATUS createSignalSound( FMOD::System* system, const std::vector< float >& signal, FMOD::Sound** sound )
+{
+    FMOD_CREATESOUNDEXINFO exInfo;
+    memset( &exInfo, 0, sizeof( FMOD_CREATESOUNDEXINFO ) );
+
+    exInfo.cbsize           = sizeof( FMOD_CREATESOUNDEXINFO );
+    exInfo.numchannels      = 1;
+    exInfo.format           = FMOD_SOUND_FORMAT_PCM16;
+    exInfo.defaultfrequency = OUTPUTRATE;
+    exInfo.length           = ( unsigned )signal.size( ) * sizeof( short );
+
+    FMOD_RESULT result = system->createSound( 0, FMOD_2D | FMOD_SOFTWARE | FMOD_OPENUSER | FMOD_LOOP_NORMAL, &exInfo, sound );
+
+    if( result != FMOD_OK )
+    {
+        DEBUG_OUT( FMOD_ErrorString( result ) );
+        return SOUND_CREATION_FAILED;
+    }
+
+    void     *ptr1, *ptr2;
+    unsigned  len1, len2;
+
+    if( ( *sound )->lock( 0, exInfo.length, &ptr1, &ptr2, &len1, &len2 ) != FMOD_OK )
+        return SOUND_LOCK_FAILED;
+
+    toPCM16( &signal[ 0 ], len1 / sizeof( short ), ( short* )ptr1 );
+    ( *sound )->unlock( ptr1, ptr2, len1, len2 );
+
+    return OK;
+}
+
+static bool writeSignalWav( const char* path, const std::vector< float >& signal )
+{
+    FILE* fp = fopen( path, "wb" );
+
+    if( fp == 0 )
+        return false;
+
+    std::vector< short > pcm( signal.size( ) );
+    toPCM16( &signal[ 0 ], ( unsigned )signal.size( ), &pcm[ 0 ] );
+
+    bool ok = WriteWavHeader( fp, 1, 16, OUTPUTRATE, pcm.size( ) * sizeof( short ) ) &&
+              fwrite( &pcm[ 0 ], sizeof( short ), pcm.size( ), fp ) == pcm.size( );
+
+    return fclose( fp ) == 0 && ok;
+}
+
+//------------------------------------------------------------------------------------------
+
+static void benchNoteLookup( const BenchOptions& options )
+{
+    const unsigned count = 1 << 16;
+
+    std::vector< float > hz( count );
+    std::vector< int >   index( count );
+    std::vector< float > cents( count );
+
+    for( unsigned i = 0; i < count; i++ )
+        hz[ i ] = 20.0f * powf( 2.0f, 10.0f * ( float )i / ( float )count );
+
+    volatile int sink = 0;
+
+    measure( options, "note lookup (single)", "-", 0.0, options.quick ? 20 : 200, count, 0.0, [ & ]( )
+    {
+        for( unsigned i = 0; i < count; i++ )
+            sink += Tuning::nearest( hz[ i ] ).index;
+    } );
+
+    measure( options, "note lookup (batch)", "-", 0.0, options.quick ? 20 : 200, count, 0.0, [ & ]( )
+    {
+        Tuning::nearest( &hz[ 0 ], count, &index[ 0 ], &cents[ 0 ] );
+    } );
+}
+
+/**
+ * A3 and E4, four partials each, through an 8192 point Stft: both must come out of
+ * fmodDetectPitchesFromSpectrum as the first two voices.
+ */
+static void checkTwoNoteMix( )
+{
+    const int            notes[ 2 ] = { 45, 52 };
+    std::vector< float > mix( 8192, 0.0f );
+
+    for( unsigned n = 0; n < 2; n++ )
+    {
+        double hz = Tuning::tables.hz[ notes[ n ] ];
+
+        for( int h = 1; h <= 4; h++ )
+        {
+            for( unsigned i = 0; i < mix.size( ); i++ )
+                mix[ i ] += ( float )( 0.25 / h * sin( 2.0 * M_PI * hz * h * i / OUTPUTRATE + h ) );
+        }
+    }
+
+    Stft                 stft( 8192, 1024 );
+    std::vector< float > spectrum( stft.bins( ) );
+    Pitch                voices[ 4 ];
+    unsigned             count = 0;
+
+    stft.analyse( &mix[ 0 ], &spectrum[ 0 ] );
+    fmodDetectPitchesFromSpectrum( &spectrum[ 0 ], stft.bins( ), ( float )OUTPUTRATE / 8192.0f, voices, 4, &count );
+
+    bool found[ 2 ] = { false, false };
+
+    for( unsigned v = 0; v < std::min( count, 2u ); v++ )
+    {
+        for( unsigned n = 0; n < 2; n++ )
+            found[ n ] = found[ n ] || Tuning::nearest( voices[ v ].hz ).index == notes[ n ];
+    }
+
+    bool ok = found[ 0 ] && found[ 1 ];
+
+    fprintf( stderr, "%-34s %-6s %s (%u voices: %s %s)\n", "poly two-note mix", "A3+E4", ( ok ? "ok" : "FAILED" ), count,
+             ( count > 0 ? voices[ 0 ].note : "-" ), ( count > 1 ? voices[ 1 ].note : "-" ) );
+
+    if( !ok )
+        failedChecks++;
+}
+
+/**
+ * PitchDetectorBatch over an interleaved multichannel buffer, one stream per note from
+ * E3 up. Times the whole bank per call, then checks that every stream's Pitch landed
+ * in its own slot, whichever pool thread analysed it.
+ */
+static void benchBatch( const BenchOptions& options )
+{
+    const unsigned     counts[ ]  = { 8, 32 };
+    const PITCH_METHOD methods[ ] = { PITCH_SPECTRUM_PEAK, PITCH_YIN };
+
+    for( unsigned m = 0; m < 2; m++ )
+    {
+        for( unsigned c = 0; c < 2; c++ )
+        {
+            unsigned             streams = counts[ c ];
+            PitchDetectorBatch   batch( streams, methods[ m ], OUTPUTRATE );
+            unsigned             frames  = batch.windowSize( );
+            std::vector< float > interleaved( ( size_t )frames * streams );
+            std::vector< Pitch > pitches( streams );
+
+            for( unsigned st = 0; st < streams; st++ )
+            {
+                double hz = Tuning::tables.hz[ 40 + st ];
+
+                for( unsigned i = 0; i < frames; i++ )
+                    interleaved[ ( size_t )i * streams + st ] = ( float )( 0.5 * sin( 2.0 * M_PI * hz * i / OUTPUTRATE ) );
+            }
+
+            char label[ 64 ];
+            snprintf( label, sizeof( label ), "batch %ux %s %u", streams, ( methods[ m ] == PITCH_YIN ? "yin" : "spectrum" ), frames );
+
+            measure( options, label, "notes", frames / ( double )OUTPUTRATE, options.quick ? 5 : 50, streams, interleaved.size( ) * sizeof( float ), [ & ]( )
+            {
+                batch.detectInterleaved( &interleaved[ 0 ], &pitches[ 0 ] );
+            } );
+
+            unsigned wrong = 0;
+
+            batch.detectInterleaved( &interleaved[ 0 ], &pitches[ 0 ] );
+
+            for( unsigned st = 0; st < streams; st++ )
+                wrong += ( strcmp( pitches[ st ].note, Tuning::name( 40 + st ) ) != 0 );
+
+            if( wrong > 0 )
+            {
+                fprintf( stderr, "%-34s %-6s FAILED (%u of %u streams wrong)\n", label, "notes", wrong, streams );
+                failedChecks++;
+            }
+        }
+    }
+}
+
+static void benchOffline( const BenchOptions& options, SIGNAL type, const std::vector< float >& signal, double seconds )
+{
+    const char* name = signalNames[ type ];
+
+    for( int kernel = FFT_KERNEL_SCALAR; kernel <= FFT_KERNEL_AVX2; kernel++ )
+    {
+        static const char* labels[ ] = { "", "stft 8192/1024 (scalar)", "stft 8192/1024 (sse)", "stft 8192/1024 (avx2)" };
+
+        Stft                 stft( 8192, 1024, WINDOW_HANN, ( FFT_KERNEL )kernel );
+        std::vector< float > spectrum( stft.bins( ) );
+        Pitch                pitch;
+        unsigned             frames = ( unsigned )( ( signal.size( ) - 8192 ) / 1024 + 1 );
+
+        measure( options, labels[ kernel ], name, seconds, options.quick ? 1 : 5, frames, signal.size( ) * sizeof( float ), [ & ]( )
+        {
+            for( unsigned f = 0; f < frames; f++ )
+            {
+                stft.analyse( &signal[ f * 1024 ], &spectrum[ 0 ] );
+                fmodDetectPitchFromSpectrum( &spectrum[ 0 ], stft.bins( ), ( float )OUTPUTRATE / 8192.0f, &pitch );
+            }
+        } );
+    }
+
+    {
+        Stft                 stft( 8192, 1024 );
+        std::vector< float > spectrum( stft.bins( ) );
+        Pitch                voices[ 4 ];
+        unsigned             count  = 0;
+        unsigned             frames = ( unsigned )( ( signal.size( ) - 8192 ) / 1024 + 1 );
+
+        measure( options, "poly top-4 8192/1024", name, seconds, options.quick ? 1 : 5, frames, signal.size( ) * sizeof( float ), [ & ]( )
+        {
+            for( unsigned f = 0; f < frames; f++ )
+            {
+                stft.analyse( &signal[ f * 1024 ], &spectrum[ 0 ] );
+                fmodDetectPitchesFromSpectrum( &spectrum[ 0 ], stft.bins( ), ( float )OUTPUTRATE / 8192.0f, voices, 4, &count );
+            }
+        } );
+    }
+
+    for( int kernel = FFT_KERNEL_SCALAR; kernel <= FFT_KERNEL_AVX2; kernel++ )
+    {
+        static const char* labels[ ] = { "", "energy gate 2048 (scalar)", "energy gate 2048 (sse)", "energy gate 2048 (avx2)" };
+
+        SignalLevel level;
+        unsigned    frames = ( unsigned )( ( signal.size( ) - GATE_WINDOW ) / 512 + 1 );
+
+        measure( options, labels[ kernel ], name, seconds, options.quick ? 5 : 50, frames, signal.size( ) * sizeof( float ), [ & ]( )
+        {
+            for( unsigned f = 0; f < frames; f++ )
+                measureLevel( &signal[ f * 512 ], GATE_WINDOW, &level, ( FFT_KERNEL )kernel );
+        } );
+    }
+
+    for( int kernel = FFT_KERNEL_SCALAR; kernel <= FFT_KERNEL_AVX2; kernel++ )
+    {
+        static const char* labels[ ] = { "", "cqt C0-A9 /512 (scalar)", "cqt C0-A9 /512 (sse)", "cqt C0-A9 /512 (avx2)" };
+
+        ConstantQ            cqt( OUTPUTRATE, 1, 0, TUNING_NOTES - 1, ( FFT_KERNEL )kernel );
+        std::vector< float > magnitudes( cqt.bins( ) );
+        Pitch                pitch;
+        unsigned             frames = ( unsigned )( signal.size( ) / 512 );
+
+        measure( options, labels[ kernel ], name, seconds, options.quick ? 1 : 5, frames, signal.size( ) * sizeof( float ), [ & ]( )
+        {
+            for( unsigned f = 0; f < frames; f++ )
+            {
+                cqt.push( &signal[ f * 512 ], 512 );
+                cqt.analyse( &magnitudes[ 0 ] );
+                fmodDetectPitchFromConstantQ( &magnitudes[ 0 ], cqt, &pitch );
+            }
+        } );
+    }
+
+    {
+        // What a linear spectrum needs to split C0 from C#0 (0.97 Hz) at 48 kHz, per frame.
+        Stft                 stft( 131072, 512 );
+        std::vector< float > frame( stft.frameSize( ) );
+        std::vector< float > spectrum( stft.bins( ) );
+        Pitch                pitch;
+
+        for( unsigned i = 0; i < frame.size( ); i++ )
+            frame[ i ] = signal[ i % signal.size( ) ];
+
+        measure( options, "stft 131072 frame", name, seconds, options.quick ? 2 : 10, 1, frame.size( ) * sizeof( float ), [ & ]( )
+        {
+            stft.analyse( &frame[ 0 ], &spectrum[ 0 ] );
+            fmodDetectPitchFromSpectrum( &spectrum[ 0 ], stft.bins( ), ( float )OUTPUTRATE / 131072.0f, &pitch );
+        } );
+    }
+
+    for( int pair = 0; pair < 2; pair++ )
+    {
+        static const unsigned rates[ ] = { 44100, 96000 };
+
+        for( int kernel = FFT_KERNEL_SCALAR; kernel <= FFT_KERNEL_AVX2; kernel++ )
+        {
+            static const char* labels[ 2 ][ 4 ] = { { "", "resample 44100>48000 (scalar)", "resample 44100>48000 (sse)", "resample 44100>48000 (avx2)" },
+                                                    { "", "resample 96000>48000 (scalar)", "resample 96000>48000 (sse)", "resample 96000>48000 (avx2)" } };
+
+            // The signal stands in for input at the source rate; ns per frame is per input sample.
+            Resampler            resampler( rates[ pair ], OUTPUTRATE, ( FFT_KERNEL )kernel );
+            std::vector< float > out( resampler.maxOutput( ( unsigned )signal.size( ) ) );
+
+            measure( options, labels[ pair ][ kernel ], name, seconds, options.quick ? 1 : 5, signal.size( ), signal.size( ) * sizeof( float ), [ & ]( )
+            {
+                resampler.reset( );
+                resampler.process( &signal[ 0 ], ( unsigned )signal.size( ), &out[ 0 ] );
+            } );
+        }
+    }
+
+    for( int method = PITCH_YIN; method <= PITCH_MCLEOD; method++ )
+    {
+        PitchEstimator estimator( ( PITCH_METHOD )method, 2048, OUTPUTRATE );
+        Pitch          pitch;
+        unsigned       frames = ( unsigned )( ( signal.size( ) - 2048 ) / 512 + 1 );
+
+        measure( options, method == PITCH_YIN ? "yin 2048/512" : "mcleod 2048/512", name, seconds,
+                 options.quick ? 1 : 5, frames, signal.size( ) * sizeof( float ), [ & ]( )
+        {
+            for( unsigned f = 0; f < frames; f++ )
+                fmodDetectPitchFromPCM( &estimator, &signal[ f * 512 ], &pitch );
+        } );
+    }
+}
+
+static void benchLive( const BenchOptions& options, FMOD::System* system, SIGNAL type, const std::vector< float >& signal, double seconds )
+{
+    const char*    name    = signalNames[ type ];
+    FMOD::Sound*   sound   = 0;
+    FMOD::Channel* channel = 0;
+
+    if( createSignalSound( system, signal, &sound ) != OK )
+        return;
+
+    system->playSound( FMOD_CHANNEL_FREE, sound, false, &channel );
+
+    // Each call also runs System::update, i.e. mixes one NRT block.
+    Pitch pitch;
+
+    measure( options, "fmodDetectPitch (getSpectrum)", name, seconds, options.quick ? 200 : 2000, 1, 0.0, [ & ]( )
+    {
+        fmodDetectPitch( system, channel, &pitch );
+    } );
+
+    PitchEstimator estimator( PITCH_YIN, 2048, OUTPUTRATE );
+
+    measure( options, "fmodDetectPitchTimeDomain (yin)", name, seconds, options.quick ? 200 : 2000, 1, 0.0, [ & ]( )
+    {
+        fmodDetectPitchTimeDomain( system, channel, &estimator, &pitch );
+    } );
+
+    channel->stop( );
+    fmodReleaseSound( sound );
+}
+
+/**
+ * Decodes a file written by SaveToFlac with FMOD's own FLAC codec and compares every
+ * sample with the PCM16 it was made from. A mismatch fails the run.
+ */
+static void checkFlacRoundTrip( FMOD::System* system, const char* path, const std::vector< float >& signal, const char* name )
+{
+    std::vector< short > expected( signal.size( ) );
+    toPCM16( &signal[ 0 ], ( unsigned )signal.size( ), &expected[ 0 ] );
+
+    FMOD::Sound* sound   = 0;
+    unsigned     matched = 0;
+    bool         ok      = false;
+
+    // FMOD's own FLAC codec decodes the file; there is nothing to map.
+    if( system->createSound( path, FMOD_SOFTWARE | FMOD_CREATESAMPLE, 0, &sound ) == FMOD_OK && sound != 0 )
+    {
+        void     *ptr1, *ptr2;
+        unsigned  len1, len2, length = 0;
+
+        sound->getLength( &length, FMOD_TIMEUNIT_PCMBYTES );
+
+        if( length == expected.size( ) * sizeof( short ) && sound->lock( 0, length, &ptr1, &ptr2, &len1, &len2 ) == FMOD_OK )
+        {
+            const short* decoded = ( const short* )ptr1;
+
+            while( matched < len1 / sizeof( short ) && decoded[ matched ] == expected[ matched ] )
+                matched++;
+
+            ok = ( matched == expected.size( ) );
+            sound->unlock( ptr1, ptr2, len1, len2 );
+        }
+
+        sound->release( );
+    }
+
+    fprintf( stderr, "%-34s %-6s %s (%u of %u samples exact)\n", "flac round trip", name, ( ok ? "ok" : "FAILED" ),
+             matched, ( unsigned )expected.size( ) );
+
+    if( !ok )
+        failedChecks++;
+}
+
+static void benchFiles( const BenchOptions& options, FMOD::System* system, SIGNAL type, const std::vector< float >& signal, double seconds )
+{
+    const char* name = signalNames[ type ];
+    const char* tmp  = getenv( "TMPDIR" );
+    std::string path = std::string( tmp != 0 ? tmp : "/tmp" ) + "/fmodbench_" + name + ".wav";
+    double      size = WAV_HEADER_SIZE + signal.size( ) * sizeof( short );
+    unsigned    runs = ( options.quick ? 3 : ( seconds > 10.0 ? 5 : 20 ) );
+
+    if( !writeSignalWav( path.c_str( ), signal ) )
+    {
+        DEBUG_OUT( "Unable to write benchmark WAV" );
+        return;
+    }
+
+    measure( options, "LoadFileIntoMemory", name, seconds, runs, signal.size( ), size, [ & ]( )
+    {
+        void*              buff   = 0;
+        unsigned long long length = 0;
+
+        if( LoadFileIntoMemory( path.c_str( ), &buff, &length ) )
+            free( buff );
+    } );
+
+    measure( options, "fmodCreateSoundFromFile", name, seconds, runs, signal.size( ), size, [ & ]( )
+    {
+        FMOD::Sound* sound = 0;
+
+        if( fmodCreateSoundFromFile( system, &sound, path.c_str( ) ) == OK )
+            fmodReleaseSound( sound );
+    } );
+
+    FMOD::Sound* sound = 0;
+
+    if( createSignalSound( system, signal, &sound ) == OK )
+    {
+        std::string out = path + ".out.wav";
+
+        measure( options, "SaveToWav", name, seconds, runs, signal.size( ), size, [ & ]( )
+        {
+            SaveToWav( sound, out.c_str( ) );
+        } );
+
+        std::string flac = path + ".out.flac";
+
+        measure( options, "SaveToFlac", name, seconds, runs, signal.size( ), size, [ & ]( )
+        {
+            SaveToFlac( sound, flac.c_str( ) );
+        } );
+
+        checkFlacRoundTrip( system, flac.c_str( ), signal, name );
+
+        fmodReleaseSound( sound );
+        remove( out.c_str( ) );
+        remove( flac.c_str( ) );
+    }
+
+    remove( path.c_str( ) );
+}
+
+//------------------------------------------------------------------------------------------
+
+int main( int argc, char* argv[ ] )
+{
+    BenchOptions options;
+
+    options.quick = false;
+    options.json  = stdout;
+
+    for( int i = 1; i < argc; i++ )
+    {
+        std::string arg = argv[ i ];
+
+        if( arg == "-q" )
+            options.quick = true;
+        else if( arg == "-f" && i + 1 < argc )
+            options.filter = argv[ ++i ];
+        else if( arg == "-o" && i + 1 < argc )
+        {
+            options.json = fopen( argv[ ++i ], "w" );
+
+            if( options.json == 0 )
+            {
+                DEBUG_OUT( "Unable to open results file" );
+                return 1;
+            }
+        }
+        else
+        {
+            fprintf( stderr, "usage: %s [-q] [-f <name filter>] [-o <results.jsonl>]\n", argv[ 0 ] );
+            return 1;
+        }
+    }
+
+    //------------------------------------------------
+
+    FMOD::Memory_Initialize( 0, 0, fmodAlloc, fmodRealloc, fmodFree );
+
+    FMOD::System* system = 0;
+    STATUS        status = fmodSetup( &system );
+
+    if( status == OK )
+        status = fmodSetOutputType( system, NOSOUND_NRT );
+
+    if( status == OK )
+        status = fmodSystemInit( system );
+
+    if( status != OK )
+    {
+        fprintf( stderr, "ERROR: FMOD setup failed! [%d]\n", status );
+        return 1;
+    }
+
+    fprintf( stderr, "%-34s %-6s %7s %8s %14s %10s %10s\n", "benchmark", "signal", "length", "calls", "ns/frame", "MB/s", "allocs" );
+
+    benchNoteLookup( options );
+    checkTwoNoteMix( );
+    benchBatch( options );
+
+    const double lengths[ ] = { 1.0, 10.0, 60.0 };
+
+    for( int type = SIGNAL_SINE; type < SIGNAL_COUNT; type++ )
+    {
+        for( unsigned l = 0; l < sizeof( lengths ) / sizeof( lengths[ 0 ] ); l++ )
+        {
+            if( options.quick && l > 0 )
+                break;
+
+            std::vector< float > signal( ( size_t )( lengths[ l ] * OUTPUTRATE ) );
+            makeSignal( ( SIGNAL )type, ( unsigned )signal.size( ), &signal[ 0 ] );
+
+            if( l == 0 )
+            {
+                benchOffline( options, ( SIGNAL )type, signal, lengths[ l ] );
+                benchLive( options, system, ( SIGNAL )type, signal, lengths[ l ] );
+            }
+
+            benchFiles( options, system, ( SIGNAL )type, signal, lengths[ l ] );
+        }
+    }
+
+    system->release( );
+
+    if( options.json != stdout )
+        fclose( options.json );
+
+    return ( failedChecks == 0 ? 0 : 2 );
+}
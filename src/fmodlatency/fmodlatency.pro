@@ -0,0 +1,22 @@
+#-------------------------------------------------
+#
+# Onset-to-result latency of the pitch
+# analysis paths. No Qt.
+#
+#-------------------------------------------------
+
+TARGET = fmodlatency
+TEMPLATE = app
+
+CONFIG += console
+CONFIG -= qt app_bundle
+
+#-------------------------------------------------
+#-------------------------------------------------
+
+include( ../fmod_common.pri )
+
+#-------------------------------------------------
+#-------------------------------------------------
+
+SOURCES += main.cpp
@@ -0,0 +1,602 @@
+/**
+ * Onset-to-result latency of the pitch analysis paths.
+ *
+ * Generates a sequence of tones with known onsets and frequencies (some separated by
+ * silence, some legato), loads it into a user-created FMOD sound and plays that as a
+ * virtual input through the non-realtime no-sound output, so the mixer advances one
+ * DSP block per System::update and every run is repeatable. Each configuration reads
+ * results the way the application would:
+ *
+ *   poll   Channel::getSpectrum or Channel::getWaveData every 'poll' ms, i.e. the
+ *          QTimer path; a poll only sees the blocks mixed before it fired.
+ *   tap    a DspTap on the channel, drained every 'poll' ms into a sliding window and
+ *          analysed every hop behind an EnergyGate, i.e. the AnalysisWorker path.
+ *
+ * A note counts as detected at the first result after its onset that is voiced and
+ * names the right note; latency is that result's time minus the onset, in audio time.
+ * The device buffer (DSP block x buffer count) is not part of it, since nothing plays;
+ * it is printed alongside so the two can be added for a given setup. Per configuration
+ * the latency percentiles, the share of notes detected, the share of steady-state
+ * frames on the right note, the share of frames in silence reported as voiced, the
+ * mean cents error and the CPU time per result are printed as a table on stderr and
+ * as one JSON object per line on stdout (or the -o file).
+ */
+
+#include "fmod_resources.h"
+#include "note_segmenter.h"
+#include "pitch_estimator.h"
+#include "dsp_tap.h"
+#include "stft.h"
+#include "tuning.h"
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+//------------------------------------------------------------------------------------------
+
+#define LATENCY_BUFFERS     4           /* setDSPBufferSize buffer count, as fmodbatch */
+#define LATENCY_TAP_POLL    5           /* ms, ANALYSIS_PERIOD_MS */
+#define LATENCY_GUI_POLL    76          /* ms, the MainWindow QTimer */
+#define LATENCY_LOW_NOTE    33          /* A2, index into the tuning table */
+#define LATENCY_HIGH_NOTE   69          /* A5 */
+#define LATENCY_GAP_MS      150         /* silence before a detached note */
+
+enum READ_PATH
+{
+    PATH_SPECTRUM = 0,      /* Channel::getSpectrum, SPECTRUMSIZE */
+    PATH_WAVEDATA,          /* Channel::getWaveData into a PitchEstimator */
+    PATH_TAP                /* DspTap, Stft or PitchEstimator per hop */
+};
+
+struct LatencyConfig
+{
+    std::string  name;
+    READ_PATH    path;
+    PITCH_METHOD method;
+    unsigned     window;        /* samples analysed per result */
+    unsigned     hop;           /* PATH_TAP only */
+    unsigned     pollMs;        /* 0: after every mixed block */
+};
+
+struct TestNote
+{
+    unsigned onset;             /* samples */
+    unsigned length;
+    float    hz;
+    int      index;
+};
+
+struct TestSignal
+{
+    std::vector< float >    samples;
+    std::vector< TestNote > notes;
+};
+
+/**
+ * One analysis result and the audio time, in samples, at which it became available.
+ */
+struct Detection
+{
+    unsigned long long time;
+    Pitch              pitch;
+};
+
+struct LatencyOptions
+{
+    bool        quick;
+    std::string filter;
+    FILE*       json;
+};
+
+//------------------------------------------------------------------------------------------
+
+/**
+ * 'count' notes between LATENCY_LOW_NOTE and LATENCY_HIGH_NOTE, 250-500 ms long, with
+ * a 5 ms attack and release and two harmonics. Every third note follows the previous
+ * one without a gap, so note changes are measured as well as onsets from silence. The
+ * sequence is the same on every run.
+ */
+static void makeSignal( unsigned count, int rate, TestSignal* signal )
+{
+    unsigned seed   = 12345;
+    unsigned cursor = rate * LATENCY_GAP_MS / 1000;
+    unsigned ramp   = rate * 5 / 1000;
+    int      last   = -1;
+
+    signal->notes.clear( );
+
+    for( unsigned n = 0; n < count; n++ )
+    {
+        TestNote note;
+
+        do
+        {
+            seed       = seed * 1664525u + 1013904223u;
+            note.index = LATENCY_LOW_NOTE + ( int )( ( seed >> 8 ) % ( LATENCY_HIGH_NOTE - LATENCY_LOW_NOTE + 1 ) );
+        }
+        while( note.index == last );
+
+        seed = seed * 1664525u + 1013904223u;
+
+        if( n > 0 && n % 3 != 0 )
+            cursor += rate * LATENCY_GAP_MS / 1000;
+
+        note.onset  = cursor;
+        note.length = rate * ( 250 + ( seed >> 8 ) % 251 ) / 1000;
+        note.hz     = Tuning::tables.hz[ note.index ];
+
+        signal->notes.push_back( note );
+
+        cursor += note.length;
+        last    = note.index;
+    }
+
+    signal->samples.assign( cursor + rate * LATENCY_GAP_MS / 1000, 0.0f );
+
+    for( unsigned n = 0; n < signal->notes.size( ); n++ )
+    {
+        const TestNote& note = signal->notes[ n ];
+
+        for( unsigned i = 0; i < note.length; i++ )
+        {
+            double t        = ( double )i / rate;
+            double envelope = std::min( 1.0, std::min( ( double )i / ramp, ( double )( note.length - i ) / ramp ) );
+            double phase    = 2.0 * M_PI * note.hz * t;
+
+            signal->samples[ note.onset + i ] += ( float )( envelope * ( 0.5 * sin( phase ) + 0.2 * sin( 2.0 * phase ) + 0.1 * sin( 3.0 * phase ) ) );
+        }
+    }
+}
+
+/**
+ * A one-shot mono float sample holding the signal, filled through Sound::lock.
+ */
+static STATUS createSignalSound( FMOD::System* system, const std::vector< float >& samples, int rate, FMOD::Sound** sound )
+{
+    FMOD_CREATESOUNDEXINFO exInfo;
+    memset( &exInfo, 0, sizeof( FMOD_CREATESOUNDEXINFO ) );
+
+    exInfo.cbsize           = sizeof( FMOD_CREATESOUNDEXINFO );
+    exInfo.numchannels      = 1;
+    exInfo.format           = FMOD_SOUND_FORMAT_PCMFLOAT;
+    exInfo.defaultfrequency = rate;
+    exInfo.length           = ( unsigned )samples.size( ) * sizeof( float );
+
+    FMOD_RESULT result = system->createSound( 0, FMOD_2D | FMOD_SOFTWARE | FMOD_OPENUSER | FMOD_LOOP_OFF, &exInfo, sound );
+
+    if( result != FMOD_OK )
+    {
+        DEBUG_OUT( FMOD_ErrorString( result ) );
+        return SOUND_CREATION_FAILED;
+    }
+
+    void     *ptr1, *ptr2;
+    unsigned  len1, len2;
+
+    if( ( *sound )->lock( 0, exInfo.length, &ptr1, &ptr2, &len1, &len2 ) != FMOD_OK )
+        return SOUND_LOCK_FAILED;
+
+    memcpy( ptr1, &samples[ 0 ], len1 );
+    ( *sound )->unlock( ptr1, ptr2, len1, len2 );
+
+    return OK;
+}
+
+//------------------------------------------------------------------------------------------
+
+/**
+ * Plays the signal through 'system' and collects every result 'config' produces, with
+ * the time it became available. Returns the mean CPU time per result in 'us'.
+ */
+static STATUS runConfig( FMOD::System* system, int rate, unsigned block, const LatencyConfig& config,
+                         const TestSignal& signal, std::vector< Detection >* detections, double* us )
+{
+    FMOD::Sound*   sound   = 0;
+    FMOD::Channel* channel = 0;
+    STATUS         status  = createSignalSound( system, signal.samples, rate, &sound );
+
+    if( status != OK )
+        return status;
+
+    FMOD_RESULT result = system->playSound( FMOD_CHANNEL_FREE, sound, true, &channel );
+
+    if( result != FMOD_OK )
+    {
+        DEBUG_OUT( FMOD_ErrorString( result ) );
+        fmodReleaseSound( sound );
+        return SOUND_PLAY_FAILED;
+    }
+
+    DspTap tap;
+
+    if( config.path == PATH_TAP )
+        status = tap.attach( system, channel );
+
+    if( status != OK )
+    {
+        channel->stop( );
+        fmodReleaseSound( sound );
+        return status;
+    }
+
+    channel->setPaused( false );
+
+    PitchEstimator*      estimator = 0;
+    Stft*                stft      = 0;
+    std::vector< float > window( config.window );
+    std::vector< float > spectrum;
+    unsigned             fill      = 0;
+    float                binSize   = fmodSpectrumBinSize( system );
+    EnergyGate           gate;
+    unsigned             newest    = std::min( config.window, ( unsigned )GATE_WINDOW );
+
+    if( config.method != PITCH_SPECTRUM_PEAK )
+    {
+        estimator = new PitchEstimator( config.method, config.window, ( float )rate );
+    }
+    else if( config.path == PATH_TAP )
+    {
+        stft    = new Stft( config.window, config.hop, WINDOW_HANN );
+        binSize = ( float )rate / config.window;
+        spectrum.resize( stft->bins( ) );
+    }
+
+    typedef std::chrono::steady_clock Clock;
+
+    unsigned long long mixed    = 0;
+    unsigned long long poll     = ( unsigned long long )config.pollMs * rate / 1000;
+    unsigned long long nextPoll = poll;
+    unsigned long long end      = signal.samples.size( );
+    double             busy     = 0;
+    bool               playing  = true;
+
+    detections->clear( );
+
+    while( playing && mixed < end )
+    {
+        system->update( );
+        mixed += block;
+
+        if( channel->isPlaying( &playing ) != FMOD_OK )
+            playing = false;
+
+        // Polls that fire before the next block is mixed see exactly what is mixed now.
+        unsigned polls = 1;
+
+        if( poll > 0 )
+        {
+            for( polls = 0; nextPoll < mixed + block; nextPoll += poll )
+                polls++;
+        }
+
+        for( unsigned p = 0; p < polls; p++ )
+        {
+            unsigned long long at    = ( poll > 0 ? nextPoll - ( polls - p ) * poll : mixed );
+            Clock::time_point  begin = Clock::now( );
+            Detection          detection;
+
+            detection.time = at;
+
+            if( config.path == PATH_SPECTRUM )
+            {
+                if( fmodReadSpectrum( channel ) == OK &&
+                    fmodDetectPitchFromSpectrum( fmodLastSpectrum( ), SPECTRUMSIZE, binSize, &detection.pitch ) == OK )
+                    detections->push_back( detection );
+            }
+            else if( config.path == PATH_WAVEDATA )
+            {
+                if( channel->getWaveData( estimator->buffer( ), estimator->windowSize( ), 0 ) == FMOD_OK &&
+                    fmodDetectPitchFromPCM( estimator, estimator->buffer( ), &detection.pitch ) == OK )
+                    detections->push_back( detection );
+            }
+            else
+            {
+                // Every complete hop in the tap, as AnalysisWorker::run.
+                for( ;; )
+                {
+                    fill += tap.read( &window[ fill ], config.window - fill );
+
+                    if( fill < config.window )
+                        break;
+
+                    if( !gate.process( &window[ config.window - newest ], newest ) )
+                    {
+                        fmodUnvoicedPitch( &detection.pitch );
+                    }
+                    else if( stft != 0 )
+                    {
+                        stft->analyse( &window[ 0 ], &spectrum[ 0 ] );
+                        fmodDetectPitchFromSpectrum( &spectrum[ 0 ], stft->bins( ), binSize, &detection.pitch );
+                    }
+                    else
+                    {
+                        fmodDetectPitchFromPCM( estimator, &window[ 0 ], &detection.pitch );
+                    }
+
+                    detections->push_back( detection );
+
+                    memmove( &window[ 0 ], &window[ config.hop ], ( config.window - config.hop ) * sizeof( float ) );
+                    fill = config.window - config.hop;
+                }
+            }
+
+            busy += std::chrono::duration< double >( Clock::now( ) - begin ).count( );
+        }
+    }
+
+    *us = ( detections->empty( ) ? 0.0 : busy * 1e6 / detections->size( ) );
+
+    if( tap.dropped( ) > 0 )
+        DEBUG_OUT( "DspTap dropped samples; latency figures for this run are suspect" );
+
+    tap.detach( );
+    channel->stop( );
+    fmodReleaseSound( sound );
+
+    delete estimator;
+    delete stft;
+
+    return OK;
+}
+
+//------------------------------------------------------------------------------------------
+
+struct LatencyResult
+{
+    unsigned detected;
+    unsigned notes;
+    double   p50, p90, p99, max;    /* ms */
+    double   frameAccuracy;         /* steady-state results on the right note */
+    double   falseVoiced;           /* results in silence that were voiced */
+    double   cents;                 /* mean |error| of the right steady-state results */
+};
+
+static double percentile( const std::vector< double >& sorted, double p )
+{
+    if( sorted.empty( ) )
+        return 0.0;
+
+    return sorted[ std::min( sorted.size( ) - 1, ( size_t )( p * ( sorted.size( ) - 1 ) + 0.5 ) ) ];
+}
+
+/**
+ * Matches the results against the notes that were played.
+ */
+static void score( const TestSignal& signal, const std::vector< Detection >& detections, const LatencyConfig& config,
+                   int rate, LatencyResult* r )
+{
+    float                 threshold = NoteSegmenter::minConfidenceFor( config.method );
+    std::vector< double > latencies;
+    unsigned              steady = 0, right = 0, silent = 0, voicedInSilence = 0;
+    double                cents  = 0;
+    size_t                d      = 0;
+
+    for( unsigned n = 0; n < signal.notes.size( ); n++ )
+    {
+        const TestNote&    note  = signal.notes[ n ];
+        unsigned long long stop  = note.onset + note.length;
+        unsigned long long next  = ( n + 1 < signal.notes.size( ) ? signal.notes[ n + 1 ].onset : signal.samples.size( ) );
+        bool               found = false;
+
+        while( d < detections.size( ) && detections[ d ].time < note.onset )
+            d++;
+
+        for( ; d < detections.size( ) && detections[ d ].time < next; d++ )
+        {
+            const Detection& detection = detections[ d ];
+            bool             voiced    = ( detection.pitch.hz > 0.0f && detection.pitch.confidence >= threshold );
+            bool             correct   = ( voiced && Tuning::nearest( detection.pitch.hz ).index == note.index );
+
+            if( correct && !found )
+            {
+                latencies.push_back( ( detection.time - note.onset ) * 1000.0 / rate );
+                found = true;
+            }
+
+            // Whole window inside the note, or whole window inside the gap after it.
+            if( detection.time >= note.onset + config.window && detection.time <= stop )
+            {
+                steady++;
+
+                if( correct )
+                {
+                    right++;
+                    cents += fabs( 1200.0 * log2( detection.pitch.hz / note.hz ) );
+                }
+            }
+            else if( detection.time >= stop + config.window )
+            {
+                silent++;
+
+                if( voiced )
+                    voicedInSilence++;
+            }
+        }
+    }
+
+    std::sort( latencies.begin( ), latencies.end( ) );
+
+    r->detected      = ( unsigned )latencies.size( );
+    r->notes         = ( unsigned )signal.notes.size( );
+    r->p50           = percentile( latencies, 0.50 );
+    r->p90           = percentile( latencies, 0.90 );
+    r->p99           = percentile( latencies, 0.99 );
+    r->max           = ( latencies.empty( ) ? 0.0 : latencies.back( ) );
+    r->frameAccuracy = ( steady > 0 ? ( double )right / steady : 0.0 );
+    r->falseVoiced   = ( silent > 0 ? ( double )voicedInSilence / silent : 0.0 );
+    r->cents         = ( right > 0 ? cents / right : 0.0 );
+}
+
+static void report( const LatencyOptions& options, const LatencyConfig& config, unsigned block, int rate,
+                    const LatencyResult& r, double us )
+{
+    double buffer = ( double )block * LATENCY_BUFFERS * 1000.0 / rate;
+
+    fprintf( stderr, "%-22s %6u %5u %7.1f %6u/%-4u %7.1f %7.1f %7.1f %7.1f %7.1f %7.1f %6.1f %8.1f\n",
+             config.name.c_str( ), block, config.pollMs, buffer, r.detected, r.notes, r.p50, r.p90, r.p99, r.max,
+             r.frameAccuracy * 100.0, r.falseVoiced * 100.0, r.cents, us );
+
+    fprintf( options.json,
+             "{\"config\":\"%s\",\"block\":%u,\"poll_ms\":%u,\"window\":%u,\"hop\":%u,\"buffer_ms\":%.3f,"
+             "\"detected\":%u,\"notes\":%u,\"p50_ms\":%.3f,\"p90_ms\":%.3f,\"p99_ms\":%.3f,\"max_ms\":%.3f,"
+             "\"frame_accuracy\":%.4f,\"false_voiced\":%.4f,\"cents\":%.2f,\"us_per_result\":%.3f}\n",
+             config.name.c_str( ), block, config.pollMs, config.window, config.hop, buffer,
+             r.detected, r.notes, r.p50, r.p90, r.p99, r.max, r.frameAccuracy, r.falseVoiced, r.cents, us );
+    fflush( options.json );
+}
+
+//------------------------------------------------------------------------------------------
+
+static std::vector< LatencyConfig > makeConfigs( bool quick )
+{
+    std::vector< LatencyConfig > configs;
+
+    const unsigned polls[ ] = { LATENCY_GUI_POLL, 20, 0 };
+
+    for( unsigned p = 0; p < sizeof( polls ) / sizeof( polls[ 0 ] ); p++ )
+    {
+        if( quick && p == 1 )
+            continue;
+
+        configs.push_back( { "poll spectrum 8192", PATH_SPECTRUM, PITCH_SPECTRUM_PEAK, SPECTRUMSIZE, 0, polls[ p ] } );
+        configs.push_back( { "poll yin 2048", PATH_WAVEDATA, PITCH_YIN, 2048, 0, polls[ p ] } );
+    }
+
+    configs.push_back( { "tap stft 8192/512", PATH_TAP, PITCH_SPECTRUM_PEAK, 8192, 512, LATENCY_TAP_POLL } );
+
+    if( !quick )
+    {
+        configs.push_back( { "tap stft 4096/256", PATH_TAP, PITCH_SPECTRUM_PEAK, 4096, 256, LATENCY_TAP_POLL } );
+        configs.push_back( { "tap stft 2048/256", PATH_TAP, PITCH_SPECTRUM_PEAK, 2048, 256, LATENCY_TAP_POLL } );
+        configs.push_back( { "tap yin 1024/128", PATH_TAP, PITCH_YIN, 1024, 128, LATENCY_TAP_POLL } );
+    }
+
+    configs.push_back( { "tap yin 2048/256", PATH_TAP, PITCH_YIN, 2048, 256, LATENCY_TAP_POLL } );
+    configs.push_back( { "tap mcleod 2048/256", PATH_TAP, PITCH_MCLEOD, 2048, 256, LATENCY_TAP_POLL } );
+
+    return configs;
+}
+
+/**
+ * A fresh NRT system per block size, since setDSPBufferSize only works before init.
+ */
+static STATUS createSystem( unsigned block, FMOD::System** system, int* rate )
+{
+    STATUS status = fmodSetup( system );
+
+    if( status == OK )
+        status = fmodSetOutputType( *system, NOSOUND_NRT );
+
+    if( status == OK && ( *system )->setDSPBufferSize( block, LATENCY_BUFFERS ) != FMOD_OK )
+    {
+        DEBUG_OUT( "setDSPBufferSize failed" );
+        status = SYSTEM_INITIALIZATION_FAILED;
+    }
+
+    if( status == OK )
+        status = fmodSystemInit( *system );
+
+    *rate = OUTPUTRATE;
+
+    if( status == OK )
+        ( *system )->getSoftwareFormat( rate, 0, 0, 0, 0, 0 );
+
+    return status;
+}
+
+//------------------------------------------------------------------------------------------
+
+int main( int argc, char* argv[ ] )
+{
+    LatencyOptions options;
+
+    options.quick = false;
+    options.json  = stdout;
+
+    for( int i = 1; i < argc; i++ )
+    {
+        std::string arg = argv[ i ];
+
+        if( arg == "-q" )
+            options.quick = true;
+        else if( arg == "-f" && i + 1 < argc )
+            options.filter = argv[ ++i ];
+        else if( arg == "-o" && i + 1 < argc )
+        {
+            options.json = fopen( argv[ ++i ], "w" );
+
+            if( options.json == 0 )
+            {
+                DEBUG_OUT( "Unable to open results file" );
+                return 1;
+            }
+        }
+        else
+        {
+            fprintf( stderr, "usage: %s [-q] [-f <config filter>] [-o <results.jsonl>]\n", argv[ 0 ] );
+            return 1;
+        }
+    }
+
+    //------------------------------------------------
+
+    const unsigned               blocks[ ] = { 256, 512, 1024 };
+    std::vector< LatencyConfig > configs   = makeConfigs( options.quick );
+    std::vector< Detection >     detections;
+
+    fprintf( stderr, "%-22s %6s %5s %7s %11s %7s %7s %7s %7s %7s %7s %6s %8s\n",
+             "config", "block", "poll", "buf ms", "detected", "p50 ms", "p90 ms", "p99 ms", "max ms",
+             "frame%", "false%", "cents", "us/res" );
+
+    for( unsigned b = 0; b < sizeof( blocks ) / sizeof( blocks[ 0 ] ); b++ )
+    {
+        if( options.quick && blocks[ b ] != 1024 )
+            continue;
+
+        FMOD::System* system = 0;
+        int           rate;
+        STATUS        status = createSystem( blocks[ b ], &system, &rate );
+
+        if( status != OK )
+        {
+            fprintf( stderr, "ERROR: FMOD setup failed! [%d]\n", status );
+            return 1;
+        }
+
+        TestSignal signal;
+        makeSignal( options.quick ? 12 : 48, rate, &signal );
+
+        for( unsigned c = 0; c < configs.size( ); c++ )
+        {
+            if( !options.filter.empty( ) && configs[ c ].name.find( options.filter ) == std::string::npos )
+                continue;
+
+            LatencyResult result;
+            double        us = 0;
+
+            status = runConfig( system, rate, blocks[ b ], configs[ c ], signal, &detections, &us );
+
+            if( status != OK )
+            {
+                fprintf( stderr, "%-22s FAILED [%d]\n", configs[ c ].name.c_str( ), status );
+                continue;
+            }
+
+            score( signal, detections, configs[ c ], rate, &result );
+            report( options, configs[ c ], blocks[ b ], rate, result, us );
+        }
+
+        system->release( );
+    }
+
+    if( options.json != stdout )
+        fclose( options.json );
+
+    return 0;
+}
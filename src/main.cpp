@@ -1,8 +1,10 @@
 #include <QtGui/QApplication>
 #include <iostream>
+#include <cstdlib>
 
 #include "mainwindow.h"
 #include "fmod_resources.h"
+#include "trace.h"
 
 //------------------------------------------------------------------------------------------
 
@@ -17,5 +19,16 @@ int main(int argc, char *argv[])
 
     //------------------------------------------------
 
-    return a.exec();
+    int result = a.exec();
+
+    // FMODTEST_TRACE=<file> dumps the hot-path trace on exit.
+    const char* trace = getenv( "FMODTEST_TRACE" );
+
+    if( trace != 0 )
+    {
+        traceSummary( stdout );
+        traceDumpChrome( trace );
+    }
+
+    return result;
 }
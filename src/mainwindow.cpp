@@ -9,6 +9,8 @@
 #include <iostream>
 #include <QDateTime>
 #include <sstream>
+#include <cstring>
+#include <algorithm>
 
 //------------------------------------------------------------------------------------------
 
@@ -32,6 +34,9 @@ void MainWindow::setState( FMOD_STATE st )
             ui->radioOutputESD->setEnabled( false );
             ui->radioOutputOSS->setEnabled( false );
             ui->spinRecordLength->setEnabled( false );
+            ui->checkStreamToDisk->setEnabled( false );
+            ui->checkAlwaysOn->setEnabled( false );
+            ui->spinPreroll->setEnabled( false );
         }
         else if( st == PLAYING )
         {
@@ -46,6 +51,9 @@ void MainWindow::setState( FMOD_STATE st )
             ui->radioOutputESD->setEnabled( false );
             ui->radioOutputOSS->setEnabled( false );
             ui->spinRecordLength->setEnabled( false );
+            ui->checkStreamToDisk->setEnabled( false );
+            ui->checkAlwaysOn->setEnabled( false );
+            ui->spinPreroll->setEnabled( false );
         }
     }
 
@@ -64,6 +72,10 @@ void MainWindow::setState( FMOD_STATE st )
             ui->radioOutputESD->setEnabled( true );
             ui->radioOutputOSS->setEnabled( true );
             ui->spinRecordLength->setEnabled( true );
+            ui->checkStreamToDisk->setEnabled( true );
+            ui->checkAlwaysOn->setEnabled( true );
+            ui->spinPreroll->setEnabled( true );
+            ui->buttonSaveLast->setEnabled( false );
         }
     }
 
@@ -82,10 +94,54 @@ void MainWindow::setState( FMOD_STATE st )
             ui->radioOutputESD->setEnabled( true );
             ui->radioOutputOSS->setEnabled( true );
             ui->spinRecordLength->setEnabled( true );
+            ui->checkStreamToDisk->setEnabled( true );
+            ui->checkAlwaysOn->setEnabled( true );
+            ui->spinPreroll->setEnabled( true );
+            ui->buttonSaveLast->setEnabled( false );
         }
     }
 
     state = st;
+
+    if( state == IDLE && refillDrivers )
+        driversChanged( );
+}
+
+//------------------------------------------------------------------------------------------
+
+OUTPUT_TYPE MainWindow::selectedOutput( ) const
+{
+    if( ui->radioOutputALSA->isChecked( ) )
+        return ALSA;
+    else if( ui->radioOutputESD->isChecked( ) )
+        return ESD;
+
+    return OSS;
+}
+
+/**
+ * Applies the selected output type and playback driver to the engine. Changing the
+ * output type closes the system, so the current sound is dropped first.
+ */
+STATUS MainWindow::configureEngine( )
+{
+    OUTPUT_TYPE output = selectedOutput( );
+
+    if( output != engine->outputType( ) )
+    {
+        channel.reset( );
+        sound.reset( );
+    }
+
+    STATUS result = engine->setOutputType( output );
+
+    if( result != OK )
+        return result;
+
+    if( ui->driverSelectPlayback->currentIndex( ) >= 0 )
+        result = engine->setPlaybackDriver( ui->driverSelectPlayback->currentIndex( ) );
+
+    return result;
 }
 
 //------------------------------------------------------------------------------------------
@@ -96,7 +152,17 @@ void MainWindow::updateInfoPanel( )
     {
         unsigned elapsed = time->elapsed( );
 
-        if( elapsed >= ( ui->spinRecordLength->value( ) * 1000 ) )
+        // A limited save finishes on its own; join it and allow the next one.
+        if( !savePath.isEmpty( ) && !writer->isRunning( ) )
+        {
+            writer->stop( );
+            std::cout << "Saved " << savePath.toLocal8Bit( ).data( ) << std::endl;
+            savePath.clear( );
+            ui->buttonSaveLast->setEnabled( true );
+        }
+
+        // An always-on capture runs until STOP; Max Record Length does not apply.
+        if( !alwaysOn && elapsed >= ( ui->spinRecordLength->value( ) * 1000 ) )
         {
             ui->labelLength->setText( QString::number( ( ui->spinRecordLength->value( ) * 1000 ) ) );
             ui->buttonStop->click( );
@@ -105,6 +171,7 @@ void MainWindow::updateInfoPanel( )
         {
             ui->labelLength->setText( QString::number( time->elapsed( ) ) );
 
+            feedPyramid( );
         }
     }
     else if( state == PLAYING )
@@ -113,6 +180,7 @@ void MainWindow::updateInfoPanel( )
 
         if( elapsed > lastLength )
         {
+            worker->stop( );
             setState( IDLE );
             timer->stop( );
             delete [ ] time;
@@ -122,10 +190,34 @@ void MainWindow::updateInfoPanel( )
         {
             ui->playbackProgress->setValue( ( unsigned )( ( ( float )elapsed / ( float )lastLength ) * 100 ) % 100 + 1 );
 
-            Pitch pitch;
+            unsigned playhead = 0;
+
+            if( channel && channel.get( )->getPosition( &playhead, FMOD_TIMEUNIT_PCM ) == FMOD_OK )
+                ui->waveform->setPlayhead( playhead );
+
+            // Analysis runs on the worker; the GUI only takes its newest result.
+            PitchFrame frame;
+            bool       fresh = false;
+
+            while( worker->pop( &frame ) )
+                fresh = true;
+
+            NoteEvent note;
 
-            fmodDetectPitch( system, channel, &pitch );
-            ui->labelSize->setText( QString::number( pitch.hz ) );
+            while( worker->popNote( &note ) )
+                lastNote = QString( "%1 %2c, %3 s" ).arg( note.note ).arg( note.cents, 0, 'f', 0 ).arg( note.duration, 0, 'f', 2 );
+
+            if( fresh )
+                ui->labelSize->setText( QString::number( frame.pitch.hz ) + ( lastNote.isEmpty( ) ? "" : "   last note: " + lastNote ) );
+
+            // Every spectrum, not just the newest: each one is a column of the waterfall.
+            const float* spectrum;
+
+            while( ( spectrum = worker->frontSpectrum( ) ) != 0 )
+            {
+                ui->spectrogram->addColumn( spectrum );
+                worker->releaseSpectrum( );
+            }
         }
     }
     else
@@ -142,24 +234,18 @@ void MainWindow::buttonPlaybackClicked( )
     if( state != IDLE )
         return;
 
-    if( sound == 0 )
-    {
-        status = fmodSetup( &system );
-
-        if( status != OK )
-        {
-            std::cout << "ERROR: fmodSetup failed! [" << status << "]" << std::endl;
-        }
+    status = configureEngine( );
 
-        status = fmodSystemInit( system );
-
-        if( status != OK )
-        {
-            std::cout << "ERROR: fmodSystemInit failed! [" << status << "]" << std::endl;
-        }
+    if( status != OK )
+    {
+        std::cout << "ERROR: configureEngine failed! [" << status << "]" << std::endl;
+        return;
+    }
 
+    if( !sound )
+    {
         QString path = ui->editFilename->text( ) + ".wav";
-        status = fmodCreateSoundFromFile( system, &sound, path.toLocal8Bit( ).data( ) );
+        status = engine->createSoundFromFile( path.toLocal8Bit( ).data( ), &sound );
 
         if( status != OK )
         {
@@ -168,7 +254,23 @@ void MainWindow::buttonPlaybackClicked( )
         }
     }
 
-    system->playSound( FMOD_CHANNEL_REUSE, sound, false, &channel );
+    // Paused until the worker's tap is on the channel, so the first block is analysed.
+    status = engine->play( sound, &channel, true );
+
+    if( status != OK )
+    {
+        std::cout << "ERROR: play failed! [" << status << "]" << std::endl;
+        return;
+    }
+
+    status = worker->start( engine->system( ), channel.get( ), ( PITCH_METHOD )ui->comboPitchMethod->currentIndex( ) );
+
+    // Playback still works without the tap; there is just nothing to show.
+    if( status != OK )
+        std::cout << "ERROR: analysis tap failed! [" << status << "]" << std::endl;
+
+    ui->spectrogram->setFormat( worker->spectrumBins( ), worker->spectrumBinSize( ) );
+    lastNote.clear( );
 
     time = new QTime( );
     time->start( );
@@ -183,50 +285,63 @@ void MainWindow::buttonRecordClicked( )
 {
     FMOD_RESULT fmod_result;
 
-    unsigned driver = ui->driverSelect->currentIndex( );
-
-    //------------------------------------------------
-    // Specify the output type
-
-    OUTPUT_TYPE output;
+    if( ui->driverSelect->currentIndex( ) < 0 )
+    {
+        std::cout << "ERROR: no record driver available yet" << std::endl;
+        return;
+    }
 
-    if( ui->radioOutputALSA->isChecked( ) )
-        output = ALSA;
-    else if( ui->radioOutputESD->isChecked( ) )
-        output = ESD;
-    else
-        output = OSS;
+    unsigned driver = ui->driverSelect->currentIndex( );
 
     //------------------------------------------------
+    // The system persists between takes; only the output/driver may change.
 
-    status = fmodSetup( &system );
+    status = configureEngine( );
 
     if( status != OK )
     {
-        std::cout << "ERROR: fmodSetup failed! [" << status << "]" << std::endl;
+        std::cout << "ERROR: configureEngine failed! [" << status << "]" << std::endl;
+        return;
     }
 
-    status = fmodSystemInit( system );
+    FMOD::System* system = engine->system( );
 
-    if( status != OK )
-    {
-        std::cout << "ERROR: fmodSystemInit failed! [" << status << "]" << std::endl;
-    }
+    // Streamed recordings loop around a short ring that the writer drains to disk. An
+    // always-on capture loops around a ring of pre-roll length that nothing drains until
+    // SAVE LAST is pressed.
+    bool retro  = ui->checkAlwaysOn->isChecked( );
+    bool stream = !retro && ui->checkStreamToDisk->isChecked( );
 
-    if( sound != 0 )
-        sound->release( );
+    channel.reset( );
 
-    status = fmodCreateSound( system, &sound, ui->spinRecordLength->value( ) );
+    // Record in what the device delivers natively, mono since that is what is analysed.
+    CaptureFormat format;
+    fmodGetCaptureFormat( system, driver, &format );
+
+    if( retro )
+        status = engine->createSound( ui->spinPreroll->value( ) + CAPTURE_PREROLL_MARGIN, &sound, &format );
+    else if( stream )
+        status = engine->createCaptureSound( &sound, &format );
+    else
+        status = engine->createSound( ui->spinRecordLength->value( ), &sound, &format );
 
     if( status != OK )
     {
         std::cout << "ERROR: fmodCreateSound failed! [" << status << "]" << std::endl;
+        return;
     }
 
     //------------------------------------------------
     // Start recording and updating the info panel
 
-    fmod_result = system->recordStart( driver, sound, false );
+    pyramid.clear( );
+    pyramidPosition = 0;
+    pyramidStreamed = stream || retro;
+    alwaysOn        = retro;
+    ui->waveform->setPlayhead( -1 );
+    ui->waveform->fit( );
+
+    fmod_result = system->recordStart( driver, sound.get( ), stream || retro );
 
     if( fmod_result != FMOD_OK )
     {
@@ -234,11 +349,24 @@ void MainWindow::buttonRecordClicked( )
         std::cout << "> " << FMOD_ErrorString( fmod_result ) << std::endl;
     }
 
+    if( stream )
+    {
+        QString path = ui->editFilename->text( ) + ".wav";
+        status = writer->start( system, driver, sound.get( ), path.toLocal8Bit( ).data( ) );
+
+        if( status != OK )
+        {
+            std::cout << "ERROR: CaptureWriter::start failed! [" << status << "]" << std::endl;
+        }
+    }
+
     time = new QTime( );
     time->start( );
 
     timer->start( 76 );
     setState( RECORDING );
+
+    ui->buttonSaveLast->setEnabled( retro );
 }
 
 //------------------------------------------------------------------------------------------
@@ -249,7 +377,15 @@ void MainWindow::buttonStopClicked( )
 
     if( state == RECORDING )
     {
-        fmod_result = system->recordStop( ui->driverSelect->currentIndex( ) );
+        bool streamed = writer->isRunning( ) || alwaysOn;
+
+        // Drain before recordStop, which resets the record position. A save still in
+        // progress ends here, short of its post-roll.
+        writer->stop( );
+        savePath.clear( );
+        feedPyramid( );
+
+        fmod_result = engine->system( )->recordStop( ui->driverSelect->currentIndex( ) );
 
         if( fmod_result != FMOD_OK )
         {
@@ -257,15 +393,21 @@ void MainWindow::buttonStopClicked( )
             std::cout << "> " << FMOD_ErrorString( fmod_result ) << std::endl;
         }
 
-        lastLength = ( time->elapsed( ) > ( ui->spinRecordLength->value( ) * 1000 ) ? ( ui->spinRecordLength->value( ) * 1000 ) : time->elapsed( ) );
+        lastLength = ( !alwaysOn && time->elapsed( ) > ( ui->spinRecordLength->value( ) * 1000 ) ? ( ui->spinRecordLength->value( ) * 1000 ) : time->elapsed( ) );
+        alwaysOn   = false;
         ui->labelLength->setText( QString::number( lastLength ) );
 
         delete [ ] time;
         time = 0;
+
+        // Only the tail of a streamed take is in the ring; playback reloads the file instead.
+        if( streamed )
+            sound.reset( );
     }
     else if( state == PLAYING )
     {
-        channel->stop( );
+        worker->stop( );
+        channel.reset( );
     }
 
     setState( IDLE );
@@ -273,76 +415,209 @@ void MainWindow::buttonStopClicked( )
 
 //------------------------------------------------------------------------------------------
 
-void MainWindow::buttonWriteClicked( )
+/**
+ * Appends whatever has been recorded since the last call to the waveform pyramid. A
+ * streamed take loops around its ring, so a record position behind the last one means
+ * the ring wrapped; the GUI timer is far quicker than a lap. An always-on capture has
+ * no end, so its pyramid starts over on each lap to keep memory fixed.
+ */
+void MainWindow::feedPyramid( )
 {
-    if( sound != 0 )
+    unsigned position = 0;
+    unsigned length   = 0;
+
+    if( !sound || engine->system( )->getRecordPosition( ui->driverSelect->currentIndex( ), &position ) != FMOD_OK )
+        return;
+
+    sound.get( )->getLength( &length, FMOD_TIMEUNIT_PCM );
+
+    if( position < pyramidPosition )
     {
-        std::stringstream filename;
-        filename << ui->editFilename->text( ).toLocal8Bit( ).data( ) << ".wav";
-        SaveToWav( sound, filename.str( ).c_str( ) );
+        if( alwaysOn )
+            pyramid.clear( );
+        else
+            appendToPyramid( pyramidPosition, length );
+
+        pyramidPosition = 0;
+    }
+
+    appendToPyramid( pyramidPosition, position );
+    pyramidPosition = position;
+
+    ui->waveform->dataChanged( );
+}
+
+void MainWindow::appendToPyramid( unsigned from, unsigned to )
+{
+    while( from < to )
+    {
+        unsigned read = 0;
+
+        fmodReadPCM( sound.get( ), from, std::min( to - from, ( unsigned )pyramidScratch.size( ) ), &pyramidScratch[ 0 ], &read );
+
+        if( read == 0 )
+            break;
+
+        pyramid.append( &pyramidScratch[ 0 ], read );
+        from += read;
     }
 }
 
 //------------------------------------------------------------------------------------------
 
-MainWindow::MainWindow(QWidget *parent) :
-    QMainWindow(parent),
-    ui(new Ui::MainWindow)
+void MainWindow::buttonWriteClicked( )
 {
-    system      = 0;
-    sound       = 0;
-    channel     = 0;
-    lastLength  = 0;
-    timer       = new QTimer( this );
-    status      = OK;
-    state       = IDLE;
+    if( sound )
+    {
+        std::stringstream filename;
+        filename << ui->editFilename->text( ).toLocal8Bit( ).data( ) << ".wav";
+        STATUS status = SaveToWav( sound.get( ), filename.str( ).c_str( ) );
 
-    FMOD::System* tempSystem = 0;
+        if( status != OK )
+            std::cout << "ERROR: SaveToWav failed! [" << status << "]" << std::endl;
+    }
+}
 
-    //------------------------------------------------
+/**
+ * Saves the last 'Pre-roll' seconds of an always-on capture plus the next 'Post-roll'
+ * seconds. The writer reads them straight out of the ring while recording carries on.
+ */
+void MainWindow::buttonSaveLastClicked( )
+{
+    if( state != RECORDING || !alwaysOn || !savePath.isEmpty( ) || !sound )
+        return;
 
-    ui->setupUi(this);
+    float rate = OUTPUTRATE;
+    sound.get( )->getDefaults( &rate, 0, 0, 0 );
 
-    //------------------------------------------------
+    // Not more than has actually been recorded since recordStart.
+    unsigned recorded = ( unsigned )( ( double )time->elapsed( ) * rate / 1000.0 );
+    unsigned preroll  = std::min( ( unsigned )( ui->spinPreroll->value( ) * rate ), recorded );
+    unsigned postroll = ( unsigned )( ui->spinPostroll->value( ) * rate );
 
-    status = fmodSetup( &tempSystem );
+    savePath = ui->editFilename->text( ) + QDateTime::currentDateTime( ).toString( "_yyyyMMdd_hhmmss" ) + ".wav";
+
+    status = writer->start( engine->system( ), ui->driverSelect->currentIndex( ), sound.get( ), savePath.toLocal8Bit( ).data( ),
+                            preroll, std::max( 1ull, ( unsigned long long )preroll + postroll ) );
 
     if( status != OK )
     {
-        std::cout << "ERROR: fmodSetup failed! [" << status << "]" << std::endl;
+        std::cout << "ERROR: CaptureWriter::start failed! [" << status << "]" << std::endl;
+        savePath.clear( );
+        return;
     }
 
-    status = fmodSystemInit( tempSystem );
+    ui->buttonSaveLast->setEnabled( false );
+}
 
-    if( status != OK )
-    {
-        std::cout << "ERROR: fmodSystemInit failed! [" << status << "]" << std::endl;
-    }
+//------------------------------------------------------------------------------------------
 
-    //------------------------------------------------
+void MainWindow::pitchMethodChanged( int index )
+{
+    worker->setMethod( ( PITCH_METHOD )index );
+}
 
-    std::vector< std::string > drivers = getDrivers( tempSystem, &status, true );
+//------------------------------------------------------------------------------------------
 
-    if( status != OK )
+/**
+ * Refills one driver combo from the table, keeping the selected device selected if it
+ * is still present even when its index moved.
+ */
+static void fillDriverCombo( QComboBox* combo, std::vector< DriverInfo >* current, const std::vector< DriverInfo >& drivers )
+{
+    int         selected = combo->currentIndex( );
+    std::string name;
+    FMOD_GUID   guid;
+
+    memset( &guid, 0, sizeof( FMOD_GUID ) );
+
+    if( selected >= 0 && selected < ( int )current->size( ) )
     {
-        std::cout << "ERROR: getDrivers failed! [" << status << "]" << std::endl;
+        name = ( *current )[ selected ].name;
+        guid = ( *current )[ selected ].guid;
     }
 
+    combo->clear( );
+    selected = -1;
+
     for( unsigned i = 0; i < drivers.size( ); i++ )
     {
-        ui->driverSelect->addItem( QString( drivers[ i ].c_str( ) ) );
+        combo->addItem( QString( drivers[ i ].name.c_str( ) ) );
+
+        if( drivers[ i ].name == name && memcmp( &drivers[ i ].guid, &guid, sizeof( FMOD_GUID ) ) == 0 )
+            selected = i;
     }
 
-    drivers.clear( );
-    drivers = getDrivers( tempSystem, &status, false );
+    if( selected >= 0 )
+        combo->setCurrentIndex( selected );
 
-    for( unsigned i = 0; i < drivers.size( ); i++ )
+    *current = drivers;
+}
+
+void MainWindow::driversChanged( )
+{
+    // Keep the combos still while a take or playback is using the selected drivers.
+    if( state != IDLE )
     {
-        ui->driverSelectPlayback->addItem( QString( drivers[ i ].c_str( ) ) );
+        refillDrivers = true;
+        return;
     }
 
-    tempSystem->release( );
-    tempSystem = 0;
+    refillDrivers = false;
+
+    fillDriverCombo( ui->driverSelect, &recordDrivers, driverTable->drivers( true ) );
+    fillDriverCombo( ui->driverSelectPlayback, &playbackDrivers, driverTable->drivers( false ) );
+}
+
+void MainWindow::outputTypeChanged( )
+{
+    driverTable->setOutputType( selectedOutput( ) );
+}
+
+//------------------------------------------------------------------------------------------
+
+MainWindow::MainWindow(QWidget *parent) :
+    QMainWindow(parent),
+    ui(new Ui::MainWindow)
+{
+    engine        = new AudioEngine( OSS );
+    driverTable   = new DriverTable( );
+    refillDrivers = false;
+    worker        = new AnalysisWorker( );
+    writer        = new CaptureWriter( );
+    lastLength    = 0;
+    timer         = new QTimer( this );
+    status        = OK;
+    state         = IDLE;
+
+    pyramidPosition = 0;
+    pyramidStreamed = false;
+    alwaysOn        = false;
+    pyramidScratch.resize( 4096 );
+
+    //------------------------------------------------
+
+    ui->setupUi(this);
+
+    //------------------------------------------------
+
+    // Deep zoom reads the take itself, while it is still in the record sound.
+    ui->waveform->setPyramid( &pyramid );
+    ui->waveform->setSampleSource( [ this ]( unsigned long long first, unsigned count, float* mono ) -> unsigned
+    {
+        unsigned read = 0;
+
+        if( sound && !pyramidStreamed )
+            fmodReadPCM( sound.get( ), ( unsigned )first, count, mono, &read );
+
+        return read;
+    } );
+
+    // Device probing can take seconds on ALSA/OSS; the combos fill in when it is done.
+    driverTable->start( selectedOutput( ), [ this ]( )
+    {
+        QMetaObject::invokeMethod( this, "driversChanged", Qt::QueuedConnection );
+    } );
 
     //------------------------------------------------
 
@@ -350,14 +625,25 @@ MainWindow::MainWindow(QWidget *parent) :
     connect( ui->buttonStop, SIGNAL( clicked( ) ), this, SLOT( buttonStopClicked( ) ) );
     connect( ui->buttonPlayback, SIGNAL( clicked( ) ), this, SLOT( buttonPlaybackClicked( ) ) );
     connect( ui->buttonWrite, SIGNAL( clicked( ) ), this, SLOT( buttonWriteClicked( ) ) );
+    connect( ui->buttonSaveLast, SIGNAL( clicked( ) ), this, SLOT( buttonSaveLastClicked( ) ) );
+    connect( ui->comboPitchMethod, SIGNAL( currentIndexChanged( int ) ), this, SLOT( pitchMethodChanged( int ) ) );
+    connect( ui->radioOutputOSS, SIGNAL( clicked( ) ), this, SLOT( outputTypeChanged( ) ) );
+    connect( ui->radioOutputALSA, SIGNAL( clicked( ) ), this, SLOT( outputTypeChanged( ) ) );
+    connect( ui->radioOutputESD, SIGNAL( clicked( ) ), this, SLOT( outputTypeChanged( ) ) );
     connect( timer, SIGNAL( timeout( ) ), this, SLOT( updateInfoPanel( ) ) );
 }
 
 MainWindow::~MainWindow()
 {
+    delete driverTable;
     delete timer;
     delete ui;
+    delete worker;
+    delete writer;
+
+    // Handles must let go before the system they came from.
+    channel.reset( );
+    sound.reset( );
 
-    sound->release( );
-    system->release( );
+    delete engine;
 }
@@ -5,8 +5,14 @@
 
 #include <QMainWindow>
 #include <QTimer>
+#include <QComboBox>
 
 #include "fmod_resources.h"
+#include "audio_engine.h"
+#include "driver_table.h"
+#include "capture_writer.h"
+#include "analysis_worker.h"
+#include "waveform_pyramid.h"
 
 //------------------------------------------------------------------------------------------
 
@@ -25,7 +31,11 @@ public:
 
 protected:
 
-    void setState( FMOD_STATE st );
+    void        setState( FMOD_STATE st );
+    OUTPUT_TYPE selectedOutput( ) const;
+    STATUS      configureEngine( );
+    void        feedPyramid( );
+    void        appendToPyramid( unsigned from, unsigned to );
 
 private slots:
 
@@ -34,20 +44,41 @@ private slots:
     void buttonPlaybackClicked( );
     void updateInfoPanel( );
     void buttonWriteClicked( );
+    void buttonSaveLastClicked( );
+    void pitchMethodChanged( int index );
+    void driversChanged( );
+    void outputTypeChanged( );
     
 private:
     Ui::MainWindow *ui;
     QTimer* timer;
     QTime*  time;
 
-    FMOD::System*  system;
-    FMOD::Sound*   sound;
-    FMOD::Channel* channel;
+    AudioEngine*  engine;
+    SoundHandle   sound;
+    ChannelHandle channel;
+
+    DriverTable*              driverTable;
+    std::vector< DriverInfo > recordDrivers;      /* what the combos currently show */
+    std::vector< DriverInfo > playbackDrivers;
+    bool                      refillDrivers;      /* a refresh arrived while busy */
+
+    AnalysisWorker* worker;
+    CaptureWriter*  writer;
+
+    WaveformPyramid      pyramid;           /* the current take, built as it records */
+    unsigned             pyramidPosition;   /* record position already in the pyramid */
+    bool                 pyramidStreamed;   /* the sound is only a ring, not the take */
+    std::vector< float > pyramidScratch;
+
+    bool    alwaysOn;       /* the take is an always-on ring, saved from with SAVE LAST */
+    QString savePath;       /* file a SAVE LAST is writing to, empty when none */
 
     STATUS     status;
     FMOD_STATE state;
 
     unsigned lastLength;
+    QString  lastNote;      /* most recent NoteEvent from the worker */
 };
 
 //------------------------------------------------------------------------------------------
@@ -0,0 +1,47 @@
+#include "mapped_file.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+//------------------------------------------------------------------------------------------
+
+MappedFile* MappedFile::open( const char* name )
+{
+    int fd = ::open( name, O_RDONLY );
+
+    if( fd < 0 )
+        return 0;
+
+    struct stat info;
+
+    if( fstat( fd, &info ) != 0 || info.st_size <= 0 )
+    {
+        close( fd );
+        return 0;
+    }
+
+    void* address = mmap( 0, ( size_t )info.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+
+    // The mapping keeps its own reference to the file.
+    close( fd );
+
+    if( address == MAP_FAILED )
+        return 0;
+
+    madvise( address, ( size_t )info.st_size, MADV_SEQUENTIAL );
+
+    return new MappedFile( address, ( size_t )info.st_size );
+}
+
+MappedFile::MappedFile( void* address_, size_t size_ )
+{
+    address = address_;
+    size    = size_;
+}
+
+MappedFile::~MappedFile( )
+{
+    munmap( address, size );
+}
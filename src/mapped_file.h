@@ -0,0 +1,42 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+
+//------------------------------------------------------------------------------------------
+
+/**
+ * Read-only mmap of a whole file.
+ *
+ * Used to hand sample files to FMOD with FMOD_OPENMEMORY_POINT, so the data is paged in
+ * on demand instead of being read into a malloc'd buffer and then copied by FMOD. The
+ * mapping has to outlive the FMOD::Sound that points into it; fmodCreateSoundFromFile
+ * keeps it in the sound's user data and fmodReleaseSound unmaps it.
+ */
+class MappedFile
+{
+public:
+
+    /**
+     * Maps 'name', or returns null if it cannot be opened or mapped.
+     */
+    static MappedFile* open( const char* name );
+
+    ~MappedFile( );
+
+    const void* data( ) const   { return address; }
+    size_t      length( ) const { return size; }
+
+private:
+
+    MappedFile( void* address, size_t size );
+    MappedFile( const MappedFile& );
+    MappedFile& operator=( const MappedFile& );
+
+    void*  address;
+    size_t size;
+};
+
+//------------------------------------------------------------------------------------------
+
+#endif // MAPPED_FILE_H
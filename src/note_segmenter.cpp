@@ -0,0 +1,240 @@
+#include "note_segmenter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+//------------------------------------------------------------------------------------------
+
+NoteSegmenter::NoteSegmenter( unsigned bins, float bin_size, Listener listener_, float min_confidence )
+{
+    listener      = listener_;
+    fluxBins      = bins;
+    minConfidence = min_confidence;
+
+    if( bin_size > 0.0f )
+        fluxBins = std::min( bins, ( unsigned )( ONSET_MAX_HZ / bin_size ) + 1 );
+
+    previous.resize( fluxBins );
+
+    reset( );
+}
+
+void NoteSegmenter::reset( )
+{
+    havePrevious = false;
+    historyCount = 0;
+    historyPos   = 0;
+    fluxNow      = 0;
+    fluxPending  = 0;
+    fluxBefore   = 0;
+    lastOnset    = -1e9;
+    pending      = false;
+    pendingTime  = 0;
+    active       = false;
+    start        = 0;
+    releaseTime  = 0;
+    unvoiced     = 0;
+    voiced       = 0;
+    emitted      = 0;
+
+    memset( &pendingPitch, 0, sizeof( pendingPitch ) );
+    begin( 0 );
+    active = false;
+}
+
+//------------------------------------------------------------------------------------------
+
+/**
+ * Sum of the positive changes in log( 1 + c * magnitude ), per bin, so the threshold
+ * does not depend on the spectrum size.
+ */
+float NoteSegmenter::spectralFlux( const float* spectrum )
+{
+    float sum = 0;
+
+    for( unsigned i = 0; i < fluxBins; i++ )
+    {
+        float m = log1pf( ONSET_COMPRESSION * spectrum[ i ] );
+
+        if( havePrevious && m > previous[ i ] )
+            sum += m - previous[ i ];
+
+        previous[ i ] = m;
+    }
+
+    havePrevious = true;
+
+    return ( fluxBins > 0 ? sum / fluxBins : 0.0f );
+}
+
+/**
+ * Whether the pending frame is a flux peak above the adaptive threshold. The median is
+ * over the frames before it, so a long loud passage raises the bar and a quiet one
+ * lowers it.
+ */
+bool NoteSegmenter::isOnset( )
+{
+    float sorted[ ONSET_MEDIAN_FRAMES ];
+    float median = 0;
+
+    if( historyCount > 0 )
+    {
+        std::copy( history, history + historyCount, sorted );
+        std::nth_element( sorted, sorted + historyCount / 2, sorted + historyCount );
+        median = sorted[ historyCount / 2 ];
+    }
+
+    return fluxPending > fluxBefore &&
+           fluxPending >= fluxNow &&
+           fluxPending > median * ONSET_THRESHOLD + ONSET_MIN_FLUX &&
+           pendingTime - lastOnset >= ONSET_MIN_GAP;
+}
+
+//------------------------------------------------------------------------------------------
+
+void NoteSegmenter::process( double time, const float* spectrum, const Pitch& pitch )
+{
+    fluxBefore  = fluxPending;
+    fluxPending = fluxNow;
+    fluxNow     = ( spectrum != 0 ? spectralFlux( spectrum ) : 0.0f );
+
+    if( pending )
+    {
+        if( spectrum != 0 && isOnset( ) )
+        {
+            lastOnset = pendingTime;
+
+            if( active )
+                end( pendingTime );
+
+            begin( pendingTime );
+        }
+
+        apply( pendingTime, pendingPitch );
+
+        history[ historyPos ] = fluxPending;
+        historyPos            = ( historyPos + 1 ) % ONSET_MEDIAN_FRAMES;
+        historyCount          = std::min( historyCount + 1, ( unsigned )ONSET_MEDIAN_FRAMES );
+    }
+
+    pending      = true;
+    pendingTime  = time;
+    pendingPitch = pitch;
+}
+
+void NoteSegmenter::finish( double time )
+{
+    if( pending )
+        apply( pendingTime, pendingPitch );
+
+    pending = false;
+
+    if( active )
+        end( unvoiced > 0 ? releaseTime : time );
+}
+
+//------------------------------------------------------------------------------------------
+
+/**
+ * Feeds one frame's pitch into the current note, starting, ending or splitting it.
+ */
+void NoteSegmenter::apply( double time, const Pitch& pitch )
+{
+    bool      isVoiced = pitch.hz > 0.0f && pitch.confidence >= minConfidence;
+    NoteMatch match    = Tuning::nearest( pitch.hz );
+
+    if( !isVoiced || match.index < 0 )
+    {
+        if( active && unvoiced++ == 0 )
+            releaseTime = time;
+
+        if( active && unvoiced >= NOTE_RELEASE_FRAMES )
+            end( releaseTime );
+
+        return;
+    }
+
+    if( !active )
+        begin( time );
+
+    unvoiced = 0;
+
+    if( voiced > 0 && match.index != dominant )
+    {
+        if( match.index == candidate )
+        {
+            candidateFrames++;
+        }
+        else
+        {
+            candidate       = match.index;
+            candidateFrames = 1;
+            candidateStart  = time;
+        }
+
+        if( candidateFrames >= NOTE_CHANGE_FRAMES )
+        {
+            double at = candidateStart;
+
+            end( at );
+            begin( at );
+        }
+    }
+    else
+    {
+        candidate       = -1;
+        candidateFrames = 0;
+    }
+
+    float w = std::max( pitch.confidence, 1e-3f );
+
+    weight[ match.index ]   += w;
+    hzSum[ match.index ]    += w * pitch.hz;
+    centsSum[ match.index ] += w * match.cents;
+    confidenceSum           += pitch.confidence;
+    voiced++;
+
+    if( dominant < 0 || weight[ match.index ] > weight[ dominant ] )
+        dominant = match.index;
+}
+
+void NoteSegmenter::begin( double time )
+{
+    active          = true;
+    start           = time;
+    unvoiced        = 0;
+    voiced          = 0;
+    confidenceSum   = 0;
+    dominant        = -1;
+    candidate       = -1;
+    candidateFrames = 0;
+    candidateStart  = time;
+
+    memset( weight, 0, sizeof( weight ) );
+    memset( hzSum, 0, sizeof( hzSum ) );
+    memset( centsSum, 0, sizeof( centsSum ) );
+}
+
+void NoteSegmenter::end( double time )
+{
+    active = false;
+
+    if( voiced == 0 || dominant < 0 || time - start < NOTE_MIN_DURATION )
+        return;
+
+    NoteEvent note;
+
+    note.start      = start;
+    note.duration   = time - start;
+    note.hz         = hzSum[ dominant ] / weight[ dominant ];
+    note.cents      = centsSum[ dominant ] / weight[ dominant ];
+    note.confidence = confidenceSum / voiced;
+    note.index      = dominant;
+    note.note       = Tuning::name( dominant );
+
+    emitted++;
+
+    if( listener )
+        listener( note );
+}
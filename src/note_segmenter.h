@@ -0,0 +1,140 @@
+#ifndef NOTE_SEGMENTER_H
+#define NOTE_SEGMENTER_H
+
+#include "fmod_resources.h"
+#include "tuning.h"
+
+#include <functional>
+#include <vector>
+
+//------------------------------------------------------------------------------------------
+
+#define ONSET_MAX_HZ           8000.0f  /* bins above this do not contribute to the flux */
+#define ONSET_COMPRESSION      1000.0f  /* flux is taken over log( 1 + c * magnitude ) */
+#define ONSET_MEDIAN_FRAMES    15       /* frames behind the adaptive threshold */
+#define ONSET_THRESHOLD        1.5f     /* an onset must beat the median flux by this factor */
+#define ONSET_MIN_FLUX         0.02f    /* ... and this much, so noise in silence is ignored */
+#define ONSET_MIN_GAP          0.05     /* seconds between onsets */
+
+#define NOTE_MIN_CONFIDENCE    0.5f     /* YIN / McLeod periodicity below this is unvoiced */
+#define NOTE_MIN_PEAK          0.02f    /* likewise for PITCH_SPECTRUM_PEAK, whose confidence is the peak magnitude */
+#define NOTE_MIN_DURATION      0.05     /* seconds; shorter notes are dropped */
+#define NOTE_RELEASE_FRAMES    3        /* unvoiced frames that end a note */
+#define NOTE_CHANGE_FRAMES     3        /* frames on another note that split it without an onset */
+
+struct NoteEvent
+{
+    double      start;          /* seconds, on the caller's clock */
+    double      duration;
+    float       hz;             /* confidence-weighted mean over the frames on 'index' */
+    float       cents;          /* likewise, relative to the tempered note */
+    float       confidence;     /* mean over the voiced frames */
+    int         index;          /* into the tuning table, C0 = 0 */
+    const char* note;
+};
+
+/**
+ * Turns a stream of analysis frames (spectrum + Pitch) into a timeline of notes.
+ *
+ * Onsets are peaks of the half-wave rectified log spectral flux that clear an adaptive
+ * threshold, a multiple of the median of the last ONSET_MEDIAN_FRAMES values. Between
+ * onsets a note also starts at the first voiced frame after silence, ends after
+ * NOTE_RELEASE_FRAMES unvoiced frames, and is split when the pitch settles on another
+ * note for NOTE_CHANGE_FRAMES frames (legato). Each note reports the tuning table entry
+ * with the most confidence-weighted frames.
+ *
+ * Decisions lag one frame, since a flux peak is only known once the next value is in.
+ * State is fixed in size after construction: one previous spectrum, the median window
+ * and per-note vote tables. So the same object serves the live worker and hour-long
+ * files. Notes go out through the listener as they complete, on the calling thread.
+ */
+class NoteSegmenter
+{
+public:
+
+    typedef std::function< void( const NoteEvent& ) > Listener;
+
+    /**
+     * 'bins' and 'bin_size' (Hz) describe the spectra passed to process( ). Frames whose
+     * Pitch::confidence is under 'min_confidence' are unvoiced; see minConfidenceFor.
+     */
+    NoteSegmenter( unsigned bins, float bin_size, Listener listener, float min_confidence = NOTE_MIN_CONFIDENCE );
+
+    /**
+     * The voicing threshold that suits the confidence reported by 'method'.
+     */
+    static float minConfidenceFor( PITCH_METHOD method )
+    {
+        return ( method == PITCH_SPECTRUM_PEAK ? NOTE_MIN_PEAK : NOTE_MIN_CONFIDENCE );
+    }
+
+    /**
+     * One analysis frame at 'time' seconds. 'spectrum' holds linear magnitudes; it may be
+     * null, in which case only pitch drives the segmentation.
+     */
+    void process( double time, const float* spectrum, const Pitch& pitch );
+
+    /**
+     * Flushes the pending frame and ends any open note at 'time'.
+     */
+    void finish( double time );
+
+    /**
+     * Forgets all state, e.g. before a new stream.
+     */
+    void reset( );
+
+    void setMinConfidence( float min_confidence ) { minConfidence = min_confidence; }
+
+    float    flux( ) const  { return fluxNow; }
+    unsigned notes( ) const { return emitted; }
+
+private:
+
+    float spectralFlux( const float* spectrum );
+    bool  isOnset( );
+    void  apply( double time, const Pitch& pitch );
+    void  begin( double time );
+    void  end( double time );
+
+    Listener listener;
+    unsigned fluxBins;
+    float    minConfidence;
+
+    std::vector< float > previous;        /* compressed magnitudes of the last frame */
+    bool                 havePrevious;
+
+    float    history[ ONSET_MEDIAN_FRAMES ];
+    unsigned historyCount;
+    unsigned historyPos;
+
+    float  fluxNow;                       /* frame t */
+    float  fluxPending;                   /* frame t - 1, the onset candidate */
+    float  fluxBefore;                    /* frame t - 2 */
+    double lastOnset;
+
+    bool   pending;                       /* frame t - 1 waiting for the onset decision */
+    double pendingTime;
+    Pitch  pendingPitch;
+
+    bool     active;
+    double   start;
+    double   releaseTime;                 /* first unvoiced frame of the current run */
+    unsigned unvoiced;
+    unsigned voiced;
+    float    confidenceSum;
+    int      dominant;
+    int      candidate;
+    unsigned candidateFrames;
+    double   candidateStart;
+
+    float weight[ TUNING_NOTES ];
+    float hzSum[ TUNING_NOTES ];
+    float centsSum[ TUNING_NOTES ];
+
+    unsigned emitted;
+};
+
+//------------------------------------------------------------------------------------------
+
+#endif // NOTE_SEGMENTER_H
@@ -0,0 +1,174 @@
+#include "pitch_detector.h"
+#include "trace.h"
+
+//------------------------------------------------------------------------------------------
+
+PitchDetector::PitchDetector( PITCH_METHOD method, float sample_rate, unsigned window_size )
+{
+    type      = method;
+    rate      = sample_rate;
+    stft      = 0;
+    estimator = 0;
+
+    if( window_size == 0 )
+        window_size = ( method == PITCH_SPECTRUM_PEAK ? DETECTOR_SPECTRUM_WINDOW : DETECTOR_TIME_WINDOW );
+
+    if( method == PITCH_SPECTRUM_PEAK )
+    {
+        stft   = new Stft( window_size, window_size, WINDOW_HANN );
+        window = stft->frameSize( );
+
+        spectrum.resize( stft->bins( ) );
+    }
+    else
+    {
+        estimator = new PitchEstimator( method, window_size, sample_rate );
+        window    = estimator->windowSize( );
+    }
+
+    input.resize( window );
+}
+
+PitchDetector::~PitchDetector( )
+{
+    delete stft;
+    delete estimator;
+}
+
+//------------------------------------------------------------------------------------------
+
+STATUS PitchDetector::detect( const float* samples, Pitch* pitch )
+{
+    if( samples == 0 || pitch == 0 )
+    {
+        DEBUG_OUT( "samples or pitch == NULL" );
+        return PARAM_NULL_PASSED;
+    }
+
+    TRACE_SCOPE( TRACE_LEVEL_DEBUG, "PitchDetector::detect" );
+
+    if( stft != 0 )
+    {
+        stft->analyse( samples, &spectrum[ 0 ] );
+        return fmodDetectPitchFromSpectrum( &spectrum[ 0 ], stft->bins( ), rate / ( float )window, pitch );
+    }
+
+    return fmodDetectPitchFromPCM( estimator, samples, pitch );
+}
+
+STATUS PitchDetector::capture( FMOD::Channel* channel )
+{
+    if( channel == 0 )
+    {
+        DEBUG_OUT( "channel == NULL" );
+        return PARAM_NULL_PASSED;
+    }
+
+    FMOD_RESULT result = channel->getWaveData( &input[ 0 ], window, 0 );
+
+    if( result != FMOD_OK )
+    {
+        DEBUG_OUT( FMOD_ErrorString( result ) );
+        return CHANNEL_WAVEDATA_READ_FAILED;
+    }
+
+    return OK;
+}
+
+//------------------------------------------------------------------------------------------
+
+PitchDetectorBatch::PitchDetectorBatch( unsigned streams, PITCH_METHOD method, float sample_rate, unsigned window_size, unsigned threads )
+    : pool( threads )
+{
+    detectors.resize( streams );
+    results.resize( streams );
+
+    for( unsigned s = 0; s < streams; s++ )
+        detectors[ s ] = new PitchDetector( method, sample_rate, window_size );
+}
+
+PitchDetectorBatch::~PitchDetectorBatch( )
+{
+    for( unsigned s = 0; s < detectors.size( ); s++ )
+        delete detectors[ s ];
+}
+
+STATUS PitchDetectorBatch::gather( )
+{
+    for( unsigned s = 0; s < results.size( ); s++ )
+    {
+        if( results[ s ] != OK )
+            return results[ s ];
+    }
+
+    return OK;
+}
+
+//------------------------------------------------------------------------------------------
+
+STATUS PitchDetectorBatch::detect( const float* const* samples, Pitch* pitches )
+{
+    if( samples == 0 || pitches == 0 )
+    {
+        DEBUG_OUT( "samples or pitches == NULL" );
+        return PARAM_NULL_PASSED;
+    }
+
+    TRACE_SCOPE( TRACE_LEVEL_INFO, "PitchDetectorBatch::detect" );
+
+    pool.parallelFor( streams( ), [ & ]( unsigned s )
+    {
+        results[ s ] = detectors[ s ]->detect( samples[ s ], &pitches[ s ] );
+    } );
+
+    return gather( );
+}
+
+STATUS PitchDetectorBatch::detectInterleaved( const float* samples, Pitch* pitches )
+{
+    if( samples == 0 || pitches == 0 )
+    {
+        DEBUG_OUT( "samples or pitches == NULL" );
+        return PARAM_NULL_PASSED;
+    }
+
+    TRACE_SCOPE( TRACE_LEVEL_INFO, "PitchDetectorBatch::detectInterleaved" );
+
+    unsigned stride = streams( );
+    unsigned frames = windowSize( );
+
+    // Each task de-interleaves its own stream, so the copy is parallel too.
+    pool.parallelFor( stride, [ & ]( unsigned s )
+    {
+        float* mono = detectors[ s ]->buffer( );
+
+        for( unsigned i = 0; i < frames; i++ )
+            mono[ i ] = samples[ i * stride + s ];
+
+        results[ s ] = detectors[ s ]->detect( mono, &pitches[ s ] );
+    } );
+
+    return gather( );
+}
+
+STATUS PitchDetectorBatch::detect( FMOD::Channel* const* channels, Pitch* pitches )
+{
+    if( channels == 0 || pitches == 0 )
+    {
+        DEBUG_OUT( "channels or pitches == NULL" );
+        return PARAM_NULL_PASSED;
+    }
+
+    TRACE_SCOPE( TRACE_LEVEL_INFO, "PitchDetectorBatch::detect (channels)" );
+
+    for( unsigned s = 0; s < streams( ); s++ )
+        results[ s ] = detectors[ s ]->capture( channels[ s ] );
+
+    pool.parallelFor( streams( ), [ & ]( unsigned s )
+    {
+        if( results[ s ] == OK )
+            results[ s ] = detectors[ s ]->detect( detectors[ s ]->buffer( ), &pitches[ s ] );
+    } );
+
+    return gather( );
+}
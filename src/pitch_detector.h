@@ -0,0 +1,125 @@
+#ifndef PITCH_DETECTOR_H
+#define PITCH_DETECTOR_H
+
+#include "fmod_resources.h"
+#include "stft.h"
+#include "thread_pool.h"
+
+#include <vector>
+
+//------------------------------------------------------------------------------------------
+
+#define DETECTOR_SPECTRUM_WINDOW  8192      /* default window for PITCH_SPECTRUM_PEAK */
+#define DETECTOR_TIME_WINDOW      2048      /* default window for YIN / McLeod */
+
+/**
+ * Reentrant pitch detection for one stream.
+ *
+ * Owns every buffer it touches (unlike fmodDetectPitch, which reads into a per-thread
+ * spectrum), so any number of detectors can run side by side on different threads.
+ * PITCH_SPECTRUM_PEAK runs a Hann Stft over the window and takes the strongest bin;
+ * YIN and McLeod go through a PitchEstimator. FFT plans and window tables come from
+ * the shared caches, so a bank of detectors of one size holds a single copy of them.
+ */
+class PitchDetector
+{
+public:
+
+    /**
+     * window_size 0 picks DETECTOR_SPECTRUM_WINDOW or DETECTOR_TIME_WINDOW.
+     */
+    PitchDetector( PITCH_METHOD method, float sample_rate, unsigned window_size = 0 );
+    ~PitchDetector( );
+
+    PITCH_METHOD method( ) const     { return type; }
+    unsigned     windowSize( ) const { return window; }
+    float        sampleRate( ) const { return rate; }
+
+    /**
+     * windowSize() floats the caller may fill and pass to detect( ).
+     */
+    float* buffer( ) { return &input[ 0 ]; }
+
+    /**
+     * Pitch of windowSize() mono samples.
+     */
+    STATUS detect( const float* samples, Pitch* pitch );
+
+    /**
+     * Copies the channel's latest windowSize() output samples into buffer( ).
+     * Does not call System::update; whoever drives the system does that.
+     */
+    STATUS capture( FMOD::Channel* channel );
+
+private:
+
+    PitchDetector( const PitchDetector& );
+    PitchDetector& operator=( const PitchDetector& );
+
+    PITCH_METHOD type;
+    unsigned     window;
+    float        rate;
+
+    Stft*           stft;           /* PITCH_SPECTRUM_PEAK */
+    PitchEstimator* estimator;      /* PITCH_YIN, PITCH_MCLEOD */
+
+    std::vector< float > input;
+    std::vector< float > spectrum;
+};
+
+//------------------------------------------------------------------------------------------
+
+/**
+ * A bank of PitchDetectors, one per stream, analysed together on a thread pool.
+ *
+ * Each call analyses one window of every stream and fills one Pitch per stream;
+ * streams are spread over the pool's threads with the caller taking a share. Built
+ * for multi-microphone rigs with tens of inputs on one machine.
+ */
+class PitchDetectorBatch
+{
+public:
+
+    /**
+     * 'threads' as for ThreadPool; 0 uses every hardware thread.
+     */
+    PitchDetectorBatch( unsigned streams, PITCH_METHOD method, float sample_rate, unsigned window_size = 0, unsigned threads = 0 );
+    ~PitchDetectorBatch( );
+
+    unsigned       streams( ) const                 { return ( unsigned )detectors.size( ); }
+    unsigned       windowSize( ) const              { return detectors.empty( ) ? 0 : detectors[ 0 ]->windowSize( ); }
+    PitchDetector* detector( unsigned stream )      { return detectors[ stream ]; }
+
+    /**
+     * samples[ s ] holds windowSize() floats for stream s; pitches holds streams() results.
+     * Returns the first failure, the other streams are still analysed.
+     */
+    STATUS detect( const float* const* samples, Pitch* pitches );
+
+    /**
+     * windowSize() frames of streams() interleaved channels, e.g. one multichannel
+     * capture buffer.
+     */
+    STATUS detectInterleaved( const float* samples, Pitch* pitches );
+
+    /**
+     * One FMOD channel per stream. The wave data is read on the calling thread, since
+     * FMOD serialises API calls anyway, and only the analysis runs in parallel.
+     */
+    STATUS detect( FMOD::Channel* const* channels, Pitch* pitches );
+
+private:
+
+    PitchDetectorBatch( const PitchDetectorBatch& );
+    PitchDetectorBatch& operator=( const PitchDetectorBatch& );
+
+    STATUS gather( );
+
+    std::vector< PitchDetector* > detectors;
+    std::vector< STATUS >         results;
+    ThreadPool                    pool;
+};
+
+//------------------------------------------------------------------------------------------
+
+#endif // PITCH_DETECTOR_H
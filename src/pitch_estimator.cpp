@@ -0,0 +1,251 @@
+#include "pitch_estimator.h"
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+#define YIN_THRESHOLD       0.15f
+#define MCLEOD_CUTOFF       0.9f
+#define MCLEOD_MIN_CLARITY  0.5f        /* NSDF peak below which nothing is periodic */
+
+//------------------------------------------------------------------------------------------
+
+PitchEstimator::PitchEstimator( PITCH_METHOD method, unsigned window_size, float sample_rate, float min_hz, float max_hz )
+    : type( method == PITCH_MCLEOD ? PITCH_MCLEOD : PITCH_YIN ),
+      window( std::max( 64u, window_size ) ),
+      rate( sample_rate ),
+      plan( FftPlan::shared( 2 * std::max( 64u, window_size ) ) )
+{
+    unsigned size = plan->size( );
+    unsigned bins = plan->bins( );
+
+    // Lags are limited to half the window so YIN always integrates over W/2 samples.
+    minLag = std::max( 2u, ( unsigned )( rate / max_hz ) );
+    maxLag = std::min( window / 2 - 1, ( unsigned )( rate / min_hz ) + 1 );
+
+    if( minLag >= maxLag )
+        minLag = 2;
+
+    input.resize( window );
+    padded.resize( size );
+    xRe.resize( bins );
+    xIm.resize( bins );
+    aRe.resize( bins );
+    aIm.resize( bins );
+    scratch.resize( size );
+    correlation.resize( size );
+    energy.resize( window + 1 );
+    curve.resize( window / 2 + 1 );
+}
+
+//------------------------------------------------------------------------------------------
+
+/**
+ * correlation[ tau ] = sum x[ j ] x[ j + tau ], with j running over the first half of
+ * the window for YIN and over the whole overlap for McLeod.
+ */
+void PitchEstimator::correlate( const float* samples )
+{
+    unsigned size = plan->size( );
+    unsigned bins = plan->bins( );
+
+    energy[ 0 ] = 0.0f;
+
+    for( unsigned i = 0; i < window; i++ )
+        energy[ i + 1 ] = energy[ i ] + samples[ i ] * samples[ i ];
+
+    memset( &padded[ 0 ], 0, size * sizeof( float ) );
+    memcpy( &padded[ 0 ], samples, window * sizeof( float ) );
+
+    plan->forward( &padded[ 0 ], &xRe[ 0 ], &xIm[ 0 ], &scratch[ 0 ] );
+
+    if( type == PITCH_YIN )
+    {
+        memset( &padded[ window / 2 ], 0, ( window - window / 2 ) * sizeof( float ) );
+        plan->forward( &padded[ 0 ], &aRe[ 0 ], &aIm[ 0 ], &scratch[ 0 ] );
+
+        // conj( A ) * X
+        for( unsigned k = 0; k < bins; k++ )
+        {
+            float re = aRe[ k ] * xRe[ k ] + aIm[ k ] * xIm[ k ];
+            float im = aRe[ k ] * xIm[ k ] - aIm[ k ] * xRe[ k ];
+
+            aRe[ k ] = re;
+            aIm[ k ] = im;
+        }
+    }
+    else
+    {
+        // |X|^2
+        for( unsigned k = 0; k < bins; k++ )
+        {
+            aRe[ k ] = xRe[ k ] * xRe[ k ] + xIm[ k ] * xIm[ k ];
+            aIm[ k ] = 0.0f;
+        }
+    }
+
+    plan->inverse( &aRe[ 0 ], &aIm[ 0 ], &correlation[ 0 ], &scratch[ 0 ] );
+}
+
+//------------------------------------------------------------------------------------------
+
+bool PitchEstimator::estimateYin( float* lag, float* confidence )
+{
+    unsigned half    = window / 2;
+    float    running = 0.0f;
+
+    // d( tau ) = sum_{j < W/2} ( x[ j ] - x[ j + tau ] )^2, then normalised by its running mean.
+    curve[ 0 ] = 1.0f;
+
+    for( unsigned tau = 1; tau <= maxLag; tau++ )
+    {
+        float d = energy[ half ] + ( energy[ half + tau ] - energy[ tau ] ) - 2.0f * correlation[ tau ];
+
+        d        = std::max( d, 0.0f );
+        running += d;
+
+        curve[ tau ] = ( running > 0.0f ? d * ( float )tau / running : 1.0f );
+    }
+
+    unsigned best = 0;
+
+    for( unsigned tau = minLag; tau <= maxLag; tau++ )
+    {
+        if( curve[ tau ] < YIN_THRESHOLD )
+        {
+            while( tau + 1 <= maxLag && curve[ tau + 1 ] < curve[ tau ] )
+                tau++;
+
+            best = tau;
+            break;
+        }
+    }
+
+    // Nothing under the threshold: report the global minimum with its (low) confidence.
+    if( best == 0 )
+    {
+        best = minLag;
+
+        for( unsigned tau = minLag; tau <= maxLag; tau++ )
+        {
+            if( curve[ tau ] < curve[ best ] )
+                best = tau;
+        }
+    }
+
+    *lag        = interpolate( &curve[ 0 ], best, maxLag + 1 );
+    *confidence = std::min( 1.0f, std::max( 0.0f, 1.0f - curve[ best ] ) );
+
+    return curve[ best ] < YIN_THRESHOLD;
+}
+
+bool PitchEstimator::estimateMcLeod( float* lag, float* confidence )
+{
+    float highest = 0.0f;
+
+    // nsdf( tau ) = 2 r( tau ) / m( tau ), m being the energy of both overlapping parts.
+    for( unsigned tau = 0; tau <= maxLag; tau++ )
+    {
+        float m = energy[ window - tau ] + ( energy[ window ] - energy[ tau ] );
+
+        curve[ tau ] = ( m > 0.0f ? 2.0f * correlation[ tau ] / m : 0.0f );
+    }
+
+    // Key maxima: the highest point of each positive lobe after the first negative crossing.
+    unsigned tau = 1;
+
+    while( tau <= maxLag && curve[ tau ] > 0.0f )
+        tau++;
+
+    unsigned keys[ 64 ];
+    unsigned count = 0;
+
+    while( tau <= maxLag && count < 64 )
+    {
+        while( tau <= maxLag && curve[ tau ] <= 0.0f )
+            tau++;
+
+        unsigned peak = tau;
+
+        while( tau <= maxLag && curve[ tau ] > 0.0f )
+        {
+            if( curve[ tau ] > curve[ peak ] )
+                peak = tau;
+
+            tau++;
+        }
+
+        if( peak <= maxLag && peak >= minLag )
+        {
+            keys[ count++ ] = peak;
+            highest = std::max( highest, curve[ peak ] );
+        }
+    }
+
+    if( count == 0 )
+    {
+        *lag        = 0.0f;
+        *confidence = 0.0f;
+        return false;
+    }
+
+    unsigned best = keys[ 0 ];
+
+    for( unsigned i = 0; i < count; i++ )
+    {
+        if( curve[ keys[ i ] ] >= MCLEOD_CUTOFF * highest )
+        {
+            best = keys[ i ];
+            break;
+        }
+    }
+
+    // Noise still has positive lobes, just low ones: report them with their clarity.
+    *lag        = interpolate( &curve[ 0 ], best, maxLag + 1 );
+    *confidence = std::min( 1.0f, std::max( 0.0f, curve[ best ] ) );
+
+    return curve[ best ] >= MCLEOD_MIN_CLARITY;
+}
+
+//------------------------------------------------------------------------------------------
+
+/**
+ * Vertex of the parabola through values[ index - 1 .. index + 1 ].
+ */
+float PitchEstimator::interpolate( const float* values, unsigned index, unsigned count ) const
+{
+    if( index == 0 || index + 1 >= count )
+        return ( float )index;
+
+    float a = values[ index - 1 ];
+    float b = values[ index ];
+    float c = values[ index + 1 ];
+    float d = a - 2.0f * b + c;
+
+    if( d == 0.0f )
+        return ( float )index;
+
+    return ( float )index + 0.5f * ( a - c ) / d;
+}
+
+bool PitchEstimator::estimate( const float* samples, float* hz, float* confidence )
+{
+    float lag   = 0.0f;
+    bool  found = false;
+
+    *hz         = 0.0f;
+    *confidence = 0.0f;
+
+    correlate( samples );
+
+    if( type == PITCH_YIN )
+        found = estimateYin( &lag, confidence );
+    else
+        found = estimateMcLeod( &lag, confidence );
+
+    // Below YIN's threshold or McLeod's clarity floor the lag is no pitch.
+    if( found && lag > 0.0f )
+        *hz = rate / lag;
+
+    return found && *hz > 0.0f;
+}
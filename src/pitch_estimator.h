@@ -0,0 +1,75 @@
+#ifndef PITCH_ESTIMATOR_H
+#define PITCH_ESTIMATOR_H
+
+#include "fft.h"
+
+#include <vector>
+
+//------------------------------------------------------------------------------------------
+
+enum PITCH_METHOD
+{
+    PITCH_SPECTRUM_PEAK = 0,    /* strongest bin of an 8192 point spectrum */
+    PITCH_YIN,                  /* cumulative mean normalised difference */
+    PITCH_MCLEOD                /* normalised square difference (MPM) */
+};
+
+/**
+ * Time-domain fundamental estimator over short windows (1024-2048 samples).
+ *
+ * Both methods are built from the same autocorrelation terms, which are computed with
+ * one zero-padded FFT round trip instead of the O(n^2) lag loop, and the chosen lag is
+ * refined with parabolic interpolation for sub-sample accuracy. All buffers belong to
+ * the estimator, so estimate() does not allocate; an estimator is not shared between
+ * threads (its FFT plan is, see FftPlan::shared).
+ */
+class PitchEstimator
+{
+public:
+
+    PitchEstimator( PITCH_METHOD method, unsigned window_size, float sample_rate, float min_hz = 40.0f, float max_hz = 2000.0f );
+
+    PITCH_METHOD method( ) const     { return type; }
+    unsigned     windowSize( ) const { return window; }
+    float        sampleRate( ) const { return rate; }
+
+    /**
+     * windowSize() floats callers may fill (e.g. from Channel::getWaveData) and pass back in.
+     */
+    float*       buffer( )           { return &input[ 0 ]; }
+
+    /**
+     * Estimates the fundamental of windowSize() samples. 'confidence' is 0..1
+     * (1 - aperiodicity for YIN, the NSDF peak for McLeod). Returns false, with
+     * hz = 0, when nothing periodic was found in range.
+     */
+    bool estimate( const float* samples, float* hz, float* confidence );
+
+private:
+
+    void  correlate( const float* samples );
+    bool  estimateYin( float* lag, float* confidence );
+    bool  estimateMcLeod( float* lag, float* confidence );
+    float interpolate( const float* values, unsigned index, unsigned count ) const;
+
+    PITCH_METHOD type;
+    unsigned     window;
+    float        rate;
+    unsigned     minLag;
+    unsigned     maxLag;
+
+    std::shared_ptr< const FftPlan > plan;     /* 2 * window, so the correlation does not wrap */
+
+    std::vector< float > input;
+    std::vector< float > padded;
+    std::vector< float > xRe, xIm;
+    std::vector< float > aRe, aIm;
+    std::vector< float > scratch;
+    std::vector< float > correlation;
+    std::vector< float > energy;        /* prefix sums of x^2 */
+    std::vector< float > curve;         /* d'(tau) for YIN, nsdf(tau) for McLeod */
+};
+
+//------------------------------------------------------------------------------------------
+
+#endif // PITCH_ESTIMATOR_H
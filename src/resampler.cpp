@@ -0,0 +1,258 @@
+#include "resampler.h"
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+    #define RESAMPLER_X86 1
+    #include <immintrin.h>
+#endif
+
+//------------------------------------------------------------------------------------------
+// Dot products over one phase. 'count' is always a multiple of 8.
+
+static float dotScalar( const float* x, const float* h, unsigned count )
+{
+    float sum = 0.0f;
+
+    for( unsigned i = 0; i < count; i++ )
+        sum += x[ i ] * h[ i ];
+
+    return sum;
+}
+
+#ifdef RESAMPLER_X86
+
+__attribute__(( target( "sse2" ) ))
+static float dotSSE( const float* x, const float* h, unsigned count )
+{
+    __m128 a = _mm_setzero_ps( );
+    __m128 b = _mm_setzero_ps( );
+
+    for( unsigned i = 0; i < count; i += 8 )
+    {
+        a = _mm_add_ps( a, _mm_mul_ps( _mm_loadu_ps( x + i ), _mm_loadu_ps( h + i ) ) );
+        b = _mm_add_ps( b, _mm_mul_ps( _mm_loadu_ps( x + i + 4 ), _mm_loadu_ps( h + i + 4 ) ) );
+    }
+
+    float lanes[ 4 ];
+    _mm_storeu_ps( lanes, _mm_add_ps( a, b ) );
+
+    return ( lanes[ 0 ] + lanes[ 1 ] ) + ( lanes[ 2 ] + lanes[ 3 ] );
+}
+
+__attribute__(( target( "avx2,fma" ) ))
+static float dotAVX2( const float* x, const float* h, unsigned count )
+{
+    __m256   a = _mm256_setzero_ps( );
+    __m256   b = _mm256_setzero_ps( );
+    unsigned i = 0;
+
+    for( ; i + 16 <= count; i += 16 )
+    {
+        a = _mm256_fmadd_ps( _mm256_loadu_ps( x + i ), _mm256_loadu_ps( h + i ), a );
+        b = _mm256_fmadd_ps( _mm256_loadu_ps( x + i + 8 ), _mm256_loadu_ps( h + i + 8 ), b );
+    }
+
+    if( i < count )
+        a = _mm256_fmadd_ps( _mm256_loadu_ps( x + i ), _mm256_loadu_ps( h + i ), a );
+
+    __m128 sum = _mm_add_ps( _mm256_castps256_ps128( _mm256_add_ps( a, b ) ), _mm256_extractf128_ps( _mm256_add_ps( a, b ), 1 ) );
+
+    sum = _mm_add_ps( sum, _mm_movehl_ps( sum, sum ) );
+    sum = _mm_add_ss( sum, _mm_shuffle_ps( sum, sum, 1 ) );
+
+    return _mm_cvtss_f32( sum );
+}
+
+#endif
+
+//------------------------------------------------------------------------------------------
+
+static unsigned gcd( unsigned a, unsigned b )
+{
+    while( b != 0 )
+    {
+        unsigned t = a % b;
+        a = b;
+        b = t;
+    }
+
+    return a;
+}
+
+/**
+ * Zeroth-order modified Bessel function of the first kind, for the Kaiser window.
+ */
+static double besselI0( double x )
+{
+    double sum  = 1.0;
+    double term = 1.0;
+
+    for( int k = 1; k < 50 && term > sum * 1e-12; k++ )
+    {
+        term *= ( x / ( 2.0 * k ) ) * ( x / ( 2.0 * k ) );
+        sum  += term;
+    }
+
+    return sum;
+}
+
+Resampler::Resampler( unsigned in_rate, unsigned out_rate, FFT_KERNEL kernel_ )
+{
+    inRate  = std::max( 1u, in_rate );
+    outRate = std::max( 1u, out_rate );
+    kernel  = resolveKernel( kernel_ );
+
+    unsigned divisor = gcd( inRate, outRate );
+    unsigned up      = outRate / divisor;
+    unsigned down    = inRate / divisor;
+
+    // Exotic pairs reduce to huge L; a fixed number of phases with a rounded step is
+    // then far closer than the analysis can tell.
+    if( up > RESAMPLER_MAX_PHASES )
+    {
+        down = ( unsigned )std::max( 1.0, floor( ( double )inRate * RESAMPLER_MAX_PHASES / outRate + 0.5 ) );
+        up   = RESAMPLER_MAX_PHASES;
+    }
+
+    phases    = up;
+    stepWhole = down / up;
+    stepPart  = down % up;
+
+    // Downsampling narrows the filter by M / L, so it needs that many more taps.
+    double   cutoff = 0.5 * std::min( 1.0, ( double )up / down ) * RESAMPLER_PASSBAND;
+    unsigned taps   = ( unsigned )ceil( RESAMPLER_TAPS * std::max( 1.0, ( double )down / up ) );
+
+    length = std::min( ( unsigned )RESAMPLER_MAX_TAPS, ( taps + 7 ) & ~7u );
+
+    //------------------------------------------------
+    // Prototype at L times the input rate, split into L reversed phases.
+
+    unsigned total  = phases * length;
+    double   center = ( total - 1 ) / 2.0;
+    double   norm   = besselI0( RESAMPLER_KAISER_BETA );
+
+    bank.assign( total, 0.0f );
+
+    for( unsigned p = 0; p < phases; p++ )
+    {
+        double sum = 0.0;
+        float* taps = &bank[ p * length ];
+
+        for( unsigned j = 0; j < length; j++ )
+        {
+            unsigned n = p + phases * j;
+            double   t = ( n - center ) / phases;
+            double   x = 2.0 * cutoff * t;
+            double   r = 2.0 * n / ( total - 1 ) - 1.0;
+            double   h = 2.0 * cutoff * ( x == 0.0 ? 1.0 : sin( M_PI * x ) / ( M_PI * x ) );
+
+            h *= besselI0( RESAMPLER_KAISER_BETA * sqrt( std::max( 0.0, 1.0 - r * r ) ) ) / norm;
+
+            taps[ length - 1 - j ] = ( float )h;
+            sum += h;
+        }
+
+        for( unsigned j = 0; j < length && sum != 0.0; j++ )
+            taps[ j ] = ( float )( taps[ j ] / sum );
+    }
+
+    history.resize( length - 1 + RESAMPLER_CHUNK );
+
+    reset( );
+}
+
+void Resampler::reset( )
+{
+    std::fill( history.begin( ), history.end( ), 0.0f );
+
+    filled = length - 1;
+    next   = length - 1;
+    phase  = 0;
+}
+
+unsigned Resampler::maxOutput( unsigned count ) const
+{
+    unsigned long long down = ( unsigned long long )stepWhole * phases + stepPart;
+
+    return ( unsigned )( ( ( unsigned long long )count + length ) * phases / down ) + 2;
+}
+
+//------------------------------------------------------------------------------------------
+
+/**
+ * Every output whose newest input sample is already in the history.
+ */
+unsigned Resampler::run( float* out )
+{
+    unsigned written = 0;
+
+    while( next < filled )
+    {
+        const float* x = &history[ next + 1 - length ];
+        const float* h = &bank[ phase * length ];
+
+        switch( kernel )
+        {
+#ifdef RESAMPLER_X86
+        case FFT_KERNEL_AVX2:
+            out[ written ] = dotAVX2( x, h, length );
+            break;
+        case FFT_KERNEL_SSE:
+            out[ written ] = dotSSE( x, h, length );
+            break;
+#endif
+        default:
+            out[ written ] = dotScalar( x, h, length );
+            break;
+        }
+
+        written++;
+
+        next  += stepWhole;
+        phase += stepPart;
+
+        if( phase >= phases )
+        {
+            phase -= phases;
+            next++;
+        }
+    }
+
+    return written;
+}
+
+unsigned Resampler::process( const float* in, unsigned count, float* out )
+{
+    unsigned written = 0;
+
+    while( count > 0 )
+    {
+        unsigned take = std::min( count, ( unsigned )history.size( ) - filled );
+
+        memcpy( &history[ filled ], in, take * sizeof( float ) );
+        filled += take;
+        in     += take;
+        count  -= take;
+
+        written += run( out + written );
+
+        // Keep only what the next output still reaches back to.
+        unsigned keep = std::min( next + 1 - length, filled );
+
+        memmove( &history[ 0 ], &history[ keep ], ( filled - keep ) * sizeof( float ) );
+        filled -= keep;
+        next   -= keep;
+    }
+
+    return written;
+}
+
+unsigned Resampler::flush( float* out )
+{
+    static const float zeros[ RESAMPLER_MAX_TAPS ] = { 0 };
+
+    return process( zeros, length / 2, out );
+}
@@ -0,0 +1,78 @@
+#ifndef RESAMPLER_H
+#define RESAMPLER_H
+
+#include "fft.h"
+
+#include <vector>
+
+//------------------------------------------------------------------------------------------
+
+#define RESAMPLER_TAPS        32        /* per phase when upsampling; more when downsampling */
+#define RESAMPLER_MAX_TAPS    256
+#define RESAMPLER_MAX_PHASES  8192      /* beyond this the ratio is rounded (< 0.1 cent) */
+#define RESAMPLER_KAISER_BETA 8.0       /* about 80 dB stopband */
+#define RESAMPLER_PASSBAND    0.92      /* of the lower Nyquist frequency */
+#define RESAMPLER_CHUNK       4096      /* input samples buffered per pass */
+
+/**
+ * Streaming polyphase resampler for mono float PCM.
+ *
+ * The ratio is reduced to L/M. The Kaiser-windowed sinc prototype is split into L
+ * phases of a fixed length, a multiple of 8, stored reversed. So each output sample is
+ * one contiguous dot product against the input history, run by the SSE or AVX2/FMA
+ * kernel (the same choice as FFT_KERNEL). Each phase is normalised to unity gain at DC.
+ * Input goes in pieces of any size; the filter history and the phase carry over
+ * between calls, so a stream resampled in pieces comes out the same as in one go.
+ * Output is delayed by taps() / 2 input samples.
+ */
+class Resampler
+{
+public:
+
+    Resampler( unsigned in_rate, unsigned out_rate, FFT_KERNEL kernel = FFT_KERNEL_AUTO );
+
+    unsigned inputRate( ) const  { return inRate; }
+    unsigned outputRate( ) const { return outRate; }
+    unsigned taps( ) const       { return length; }
+
+    /**
+     * Most samples process( ) can write for 'count' input samples.
+     */
+    unsigned maxOutput( unsigned count ) const;
+
+    /**
+     * Resamples 'count' samples into 'out', which holds maxOutput( count ). Returns how
+     * many were written.
+     */
+    unsigned process( const float* in, unsigned count, float* out );
+
+    /**
+     * Pushes the tail still in the filter out, as if taps() / 2 zeros followed. 'out'
+     * holds maxOutput( taps( ) ).
+     */
+    unsigned flush( float* out );
+
+    void reset( );
+
+private:
+
+    unsigned run( float* out );
+
+    unsigned   inRate;
+    unsigned   outRate;
+    unsigned   phases;      /* L */
+    unsigned   stepWhole;   /* M / L */
+    unsigned   stepPart;    /* M % L */
+    unsigned   length;      /* taps per phase */
+    FFT_KERNEL kernel;
+
+    std::vector< float > bank;      /* phases * length, each phase reversed */
+    std::vector< float > history;   /* length - 1 old samples, then new input */
+    unsigned             filled;
+    unsigned             next;      /* history index of the newest sample of the next output */
+    unsigned             phase;
+};
+
+//------------------------------------------------------------------------------------------
+
+#endif // RESAMPLER_H
@@ -0,0 +1,156 @@
+#include "spectrogram_widget.h"
+
+#include <QPainter>
+
+#include <algorithm>
+#include <cmath>
+
+//------------------------------------------------------------------------------------------
+
+SpectrogramWidget::SpectrogramWidget( QWidget* parent )
+    : QWidget( parent )
+{
+    column  = 0;
+    bins    = 0;
+    binSize = 0;
+
+    // Black through red and yellow to white.
+    colours.resize( 256 );
+
+    for( int i = 0; i < 256; i++ )
+    {
+        float t = i / 255.0f;
+
+        colours[ i ] = qRgb( ( int )( 255 * std::min( 1.0f, 3.0f * t ) ),
+                             ( int )( 255 * std::min( 1.0f, std::max( 0.0f, 3.0f * t - 1.0f ) ) ),
+                             ( int )( 255 * std::min( 1.0f, std::max( 0.0f, 3.0f * t - 2.0f ) ) ) );
+    }
+
+    setAttribute( Qt::WA_OpaquePaintEvent );
+}
+
+//------------------------------------------------------------------------------------------
+
+void SpectrogramWidget::setFormat( unsigned bins_, float bin_size )
+{
+    if( bins_ == bins && bin_size == binSize )
+        return;
+
+    bins    = bins_;
+    binSize = bin_size;
+
+    buildTables( );
+    clear( );
+}
+
+void SpectrogramWidget::clear( )
+{
+    image.fill( colours[ 0 ] );
+    column = 0;
+    update( );
+}
+
+//------------------------------------------------------------------------------------------
+
+/**
+ * Splits SPECTROGRAM_MIN_HZ .. SPECTROGRAM_MAX_HZ into height() rows of equal ratio. A row
+ * wide enough to contain whole bins takes the loudest of them; a narrower one, at the
+ * bottom where bins are sparse, interpolates between the two bins either side of its
+ * centre frequency.
+ */
+void SpectrogramWidget::buildTables( )
+{
+    int h = image.height( );
+
+    rowBin.assign( h, 0 );
+    rowBins.assign( h, 0 );
+    rowFrac.assign( h, 0.0f );
+
+    if( h == 0 || bins < 2 || binSize <= 0 )
+        return;
+
+    float lo    = SPECTROGRAM_MIN_HZ;
+    float hi    = std::min( SPECTROGRAM_MAX_HZ, ( bins - 1 ) * binSize );
+    float ratio = hi / lo;
+
+    for( int y = 0; y < h; y++ )
+    {
+        int   row   = h - 1 - y;
+        float binLo = lo * powf( ratio, ( float )row / h ) / binSize;
+        float binHi = lo * powf( ratio, ( float )( row + 1 ) / h ) / binSize;
+        int   first = ( int )ceilf( binLo );
+        int   end   = std::min( ( int )ceilf( binHi ), ( int )bins );
+
+        if( end > first )
+        {
+            rowBin[ y ]  = first;
+            rowBins[ y ] = end - first;
+        }
+        else
+        {
+            float centre = std::min( 0.5f * ( binLo + binHi ), ( float )( bins - 2 ) );
+
+            rowBin[ y ]  = ( int )centre;
+            rowFrac[ y ] = centre - rowBin[ y ];
+        }
+    }
+}
+
+//------------------------------------------------------------------------------------------
+
+void SpectrogramWidget::addColumn( const float* spectrum )
+{
+    if( spectrum == 0 || image.isNull( ) || bins == 0 )
+        return;
+
+    const float scale = 255.0f / -SPECTROGRAM_FLOOR_DB;
+
+    for( int y = 0; y < image.height( ); y++ )
+    {
+        const float* bin = spectrum + rowBin[ y ];
+        float        m;
+
+        if( rowBins[ y ] > 0 )
+            m = *std::max_element( bin, bin + rowBins[ y ] );
+        else
+            m = bin[ 0 ] + rowFrac[ y ] * ( bin[ 1 ] - bin[ 0 ] );
+
+        float db    = 20.0f * log10f( m + 1e-9f );
+        int   index = ( int )( ( db - SPECTROGRAM_FLOOR_DB ) * scale );
+
+        ( ( QRgb* )image.scanLine( y ) )[ column ] = colours[ std::min( 255, std::max( 0, index ) ) ];
+    }
+
+    column = ( column + 1 ) % image.width( );
+    update( );
+}
+
+//------------------------------------------------------------------------------------------
+
+void SpectrogramWidget::paintEvent( QPaintEvent* )
+{
+    QPainter painter( this );
+
+    if( image.isNull( ) )
+        return;
+
+    // Oldest column first: [column, width) then [0, column).
+    int w = image.width( );
+    int h = image.height( );
+
+    painter.drawImage( QPoint( 0, 0 ), image, QRect( column, 0, w - column, h ) );
+
+    if( column > 0 )
+        painter.drawImage( QPoint( w - column, 0 ), image, QRect( 0, 0, column, h ) );
+}
+
+void SpectrogramWidget::resizeEvent( QResizeEvent* )
+{
+    if( width( ) <= 0 || height( ) <= 0 )
+        return;
+
+    image = QImage( size( ), QImage::Format_RGB32 );
+
+    buildTables( );
+    clear( );
+}
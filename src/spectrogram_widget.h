@@ -0,0 +1,72 @@
+#ifndef SPECTROGRAM_WIDGET_H
+#define SPECTROGRAM_WIDGET_H
+
+//------------------------------------------------------------------------------------------
+
+#include <QWidget>
+#include <QImage>
+
+#include <vector>
+
+//------------------------------------------------------------------------------------------
+
+#define SPECTROGRAM_MIN_HZ    27.5f     /* A0, bottom row */
+#define SPECTROGRAM_MAX_HZ    8000.0f   /* top row, or Nyquist if lower */
+#define SPECTROGRAM_FLOOR_DB  -90.0f    /* magnitudes below this are black */
+
+/**
+ * Scrolling waterfall of magnitude spectra, newest column on the right, log frequency
+ * upwards.
+ *
+ * The image is a persistent ring of columns: addColumn renders one spectrum into the
+ * next column and advances, and paintEvent blits the two halves either side of it. So
+ * the cost of a new frame is one column of height() pixels, never the whole history.
+ * Which bins feed which row is decided once per format or size change, in rowBin /
+ * rowBins / rowFrac, and dB to colour goes through a 256 entry colours.
+ */
+class SpectrogramWidget : public QWidget
+{
+    Q_OBJECT
+
+public:
+
+    explicit SpectrogramWidget( QWidget* parent = 0 );
+
+    /**
+     * Number of bins in each spectrum and their width in Hz. Clears the history when
+     * either changes.
+     */
+    void setFormat( unsigned bins, float bin_size );
+
+    /**
+     * Draws 'spectrum' (linear magnitudes, as from Channel::getSpectrum) as the newest
+     * column. Only that column is rendered; the repaint is two blits of the image.
+     */
+    void addColumn( const float* spectrum );
+
+    void clear( );
+
+protected:
+
+    void paintEvent( QPaintEvent* event );
+    void resizeEvent( QResizeEvent* event );
+
+private:
+
+    void buildTables( );
+
+    QImage   image;
+    int      column;            /* next column to draw */
+
+    unsigned bins;
+    float    binSize;
+
+    std::vector< int >   rowBin;     /* first bin of each row, row 0 at the top */
+    std::vector< int >   rowBins;    /* bins the row covers; 0 = interpolate at rowFrac */
+    std::vector< float > rowFrac;
+    std::vector< QRgb >  colours;
+};
+
+//------------------------------------------------------------------------------------------
+
+#endif // SPECTROGRAM_WIDGET_H
@@ -0,0 +1,265 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <atomic>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+
+//------------------------------------------------------------------------------------------
+
+/**
+ * Bounded single-producer/single-consumer queue.
+ *
+ * Exactly one thread may push and exactly one other thread may pop. Neither side
+ * locks or allocates after construction; a push into a full ring fails and the
+ * value is dropped, which is what a real-time producer wants.
+ */
+template< typename T >
+class SpscRing
+{
+public:
+
+    explicit SpscRing( unsigned capacity )
+    {
+        unsigned size = 2;
+
+        while( size < capacity )
+            size <<= 1;
+
+        slots.resize( size );
+        mask = size - 1;
+        head = 0;
+        tail = 0;
+    }
+
+    unsigned capacity( ) const { return mask + 1; }
+
+    unsigned size( ) const
+    {
+        return tail.load( std::memory_order_acquire ) - head.load( std::memory_order_acquire );
+    }
+
+    /**
+     * Producer side.
+     */
+    bool push( const T& value )
+    {
+        unsigned t = tail.load( std::memory_order_relaxed );
+
+        if( t - head.load( std::memory_order_acquire ) > mask )
+            return false;
+
+        slots[ t & mask ] = value;
+        tail.store( t + 1, std::memory_order_release );
+
+        return true;
+    }
+
+    /**
+     * Consumer side.
+     */
+    bool pop( T* value )
+    {
+        unsigned h = head.load( std::memory_order_relaxed );
+
+        if( h == tail.load( std::memory_order_acquire ) )
+            return false;
+
+        *value = slots[ h & mask ];
+        head.store( h + 1, std::memory_order_release );
+
+        return true;
+    }
+
+private:
+
+    SpscRing( const SpscRing& );
+    SpscRing& operator=( const SpscRing& );
+
+    std::vector< T > slots;
+    unsigned         mask;
+
+    // Each index on its own cache line so producer and consumer do not false-share.
+    alignas( 64 ) std::atomic< unsigned > head;     /* written by the consumer */
+    alignas( 64 ) std::atomic< unsigned > tail;     /* written by the producer */
+};
+
+//------------------------------------------------------------------------------------------
+
+/**
+ * SpscRing for fixed-size blocks of floats (spectra, sample buffers) that are too big to
+ * copy through push/pop. The producer fills a slot in place between claim and publish;
+ * the consumer reads it in place between front and release. Same threading rules and
+ * the same drop-when-full behaviour as SpscRing.
+ */
+class SpscBlockRing
+{
+public:
+
+    SpscBlockRing( unsigned capacity, unsigned block_size )
+    {
+        unsigned size = 2;
+
+        while( size < capacity )
+            size <<= 1;
+
+        blocks.resize( ( size_t )size * block_size );
+        block = block_size;
+        mask  = size - 1;
+        head  = 0;
+        tail  = 0;
+    }
+
+    unsigned capacity( ) const  { return mask + 1; }
+    unsigned blockSize( ) const { return block; }
+
+    unsigned size( ) const
+    {
+        return tail.load( std::memory_order_acquire ) - head.load( std::memory_order_acquire );
+    }
+
+    /**
+     * Producer side: the next free block, or null when the ring is full.
+     */
+    float* claim( )
+    {
+        unsigned t = tail.load( std::memory_order_relaxed );
+
+        if( t - head.load( std::memory_order_acquire ) > mask )
+            return 0;
+
+        return &blocks[ ( size_t )( t & mask ) * block ];
+    }
+
+    void publish( )
+    {
+        tail.store( tail.load( std::memory_order_relaxed ) + 1, std::memory_order_release );
+    }
+
+    /**
+     * Consumer side: the oldest published block, or null when empty.
+     */
+    const float* front( ) const
+    {
+        unsigned h = head.load( std::memory_order_relaxed );
+
+        if( h == tail.load( std::memory_order_acquire ) )
+            return 0;
+
+        return &blocks[ ( size_t )( h & mask ) * block ];
+    }
+
+    void release( )
+    {
+        head.store( head.load( std::memory_order_relaxed ) + 1, std::memory_order_release );
+    }
+
+private:
+
+    SpscBlockRing( const SpscBlockRing& );
+    SpscBlockRing& operator=( const SpscBlockRing& );
+
+    std::vector< float > blocks;
+    unsigned             block;
+    unsigned             mask;
+
+    alignas( 64 ) std::atomic< unsigned > head;
+    alignas( 64 ) std::atomic< unsigned > tail;
+};
+
+//------------------------------------------------------------------------------------------
+
+/**
+ * SpscRing for a continuous stream of samples, written and read in runs of any length
+ * rather than one element or fixed block at a time. A write that does not fit is
+ * dropped whole, so the reader never sees a stream with a hole in the middle of a run.
+ */
+class SpscSampleRing
+{
+public:
+
+    explicit SpscSampleRing( unsigned capacity )
+    {
+        unsigned size = 2;
+
+        while( size < capacity )
+            size <<= 1;
+
+        samples.resize( size );
+        mask = size - 1;
+        head = 0;
+        tail = 0;
+    }
+
+    unsigned capacity( ) const { return mask + 1; }
+
+    unsigned size( ) const
+    {
+        return tail.load( std::memory_order_acquire ) - head.load( std::memory_order_acquire );
+    }
+
+    /**
+     * Producer side: all 'count' samples, or none if they do not fit.
+     */
+    bool write( const float* data, unsigned count )
+    {
+        unsigned t = tail.load( std::memory_order_relaxed );
+
+        if( count > capacity( ) - ( t - head.load( std::memory_order_acquire ) ) )
+            return false;
+
+        unsigned at    = t & mask;
+        unsigned first = std::min( count, capacity( ) - at );
+
+        memcpy( &samples[ at ], data, first * sizeof( float ) );
+        memcpy( &samples[ 0 ], data + first, ( count - first ) * sizeof( float ) );
+
+        tail.store( t + count, std::memory_order_release );
+
+        return true;
+    }
+
+    /**
+     * Consumer side: up to 'count' samples, returns how many were read.
+     */
+    unsigned read( float* data, unsigned count )
+    {
+        unsigned h = head.load( std::memory_order_relaxed );
+
+        count = std::min( count, tail.load( std::memory_order_acquire ) - h );
+
+        unsigned at    = h & mask;
+        unsigned first = std::min( count, capacity( ) - at );
+
+        memcpy( data, &samples[ at ], first * sizeof( float ) );
+        memcpy( data + first, &samples[ 0 ], ( count - first ) * sizeof( float ) );
+
+        head.store( h + count, std::memory_order_release );
+
+        return count;
+    }
+
+    /**
+     * Consumer side: discards everything published so far.
+     */
+    void clear( )
+    {
+        head.store( tail.load( std::memory_order_acquire ), std::memory_order_release );
+    }
+
+private:
+
+    SpscSampleRing( const SpscSampleRing& );
+    SpscSampleRing& operator=( const SpscSampleRing& );
+
+    std::vector< float > samples;
+    unsigned             mask;
+
+    alignas( 64 ) std::atomic< unsigned > head;
+    alignas( 64 ) std::atomic< unsigned > tail;
+};
+
+//------------------------------------------------------------------------------------------
+
+#endif // SPSC_RING_H
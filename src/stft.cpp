@@ -0,0 +1,135 @@
+#include "stft.h"
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <mutex>
+
+//------------------------------------------------------------------------------------------
+
+/**
+ * Periodic (DFT-even) windows, which is what a sliding analysis wants.
+ */
+void makeWindow( WINDOW_TYPE type, float* table, unsigned size )
+{
+    for( unsigned i = 0; i < size; i++ )
+    {
+        double x = 2.0 * M_PI * ( double )i / ( double )size;
+
+        switch( type )
+        {
+        case WINDOW_TRIANGLE:
+            table[ i ] = ( float )( 1.0 - fabs( 2.0 * ( double )i / ( double )size - 1.0 ) );
+            break;
+        case WINDOW_HANN:
+            table[ i ] = ( float )( 0.5 - 0.5 * cos( x ) );
+            break;
+        case WINDOW_BLACKMAN_HARRIS:
+            table[ i ] = ( float )( 0.35875 - 0.48829 * cos( x ) + 0.14128 * cos( 2.0 * x ) - 0.01168 * cos( 3.0 * x ) );
+            break;
+        default:
+            table[ i ] = 1.0f;
+            break;
+        }
+    }
+}
+
+std::shared_ptr< const std::vector< float > > sharedWindow( WINDOW_TYPE type, unsigned size )
+{
+    struct Entry
+    {
+        WINDOW_TYPE                                   type;
+        std::shared_ptr< const std::vector< float > > table;
+    };
+
+    static std::mutex           lock;
+    static std::vector< Entry > tables;
+
+    std::lock_guard< std::mutex > guard( lock );
+
+    for( unsigned i = 0; i < tables.size( ); i++ )
+    {
+        if( tables[ i ].type == type && tables[ i ].table->size( ) == size )
+            return tables[ i ].table;
+    }
+
+    std::shared_ptr< std::vector< float > > table = std::make_shared< std::vector< float > >( size );
+    makeWindow( type, &( *table )[ 0 ], size );
+
+    Entry entry = { type, table };
+    tables.push_back( entry );
+
+    return table;
+}
+
+//------------------------------------------------------------------------------------------
+
+Stft::Stft( unsigned frame_size, unsigned hop_size, WINDOW_TYPE window_type, FFT_KERNEL kernel )
+    : plan( FftPlan::shared( frame_size, kernel ) )
+{
+    unsigned size = plan->size( );
+
+    hop  = std::max( 1u, std::min( hop_size, size ) );
+    fill = 0;
+
+    fifo.resize( size );
+    windowed.resize( size );
+    re.resize( plan->bins( ) );
+    im.resize( plan->bins( ) );
+    scratch.resize( size );
+
+    window = sharedWindow( window_type, size );
+
+    // Normalise so a full scale sine reads ~1.0 at its bin, whatever the window.
+    double sum = 0.0;
+
+    for( unsigned i = 0; i < size; i++ )
+        sum += ( *window )[ i ];
+
+    scale = ( float )( 2.0 / sum );
+}
+
+//------------------------------------------------------------------------------------------
+
+unsigned Stft::push( const float* samples, unsigned count )
+{
+    unsigned take = std::min( count, plan->size( ) - fill );
+
+    memcpy( &fifo[ fill ], samples, take * sizeof( float ) );
+    fill += take;
+
+    return take;
+}
+
+bool Stft::nextFrame( float* magnitudes )
+{
+    unsigned size = plan->size( );
+
+    if( fill < size )
+        return false;
+
+    analyse( &fifo[ 0 ], magnitudes );
+
+    memmove( &fifo[ 0 ], &fifo[ hop ], ( size - hop ) * sizeof( float ) );
+    fill = size - hop;
+
+    return true;
+}
+
+void Stft::analyse( const float* frame, float* magnitudes )
+{
+    unsigned size = plan->size( );
+
+    const float* table = &( *window )[ 0 ];
+
+    for( unsigned i = 0; i < size; i++ )
+        windowed[ i ] = frame[ i ] * table[ i ];
+
+    plan->forward( &windowed[ 0 ], &re[ 0 ], &im[ 0 ], &scratch[ 0 ] );
+    plan->magnitude( &re[ 0 ], &im[ 0 ], magnitudes, plan->bins( ), scale );
+}
+
+void Stft::reset( )
+{
+    fill = 0;
+}
@@ -0,0 +1,91 @@
+#ifndef STFT_H
+#define STFT_H
+
+#include "fft.h"
+
+#include <memory>
+#include <vector>
+
+//------------------------------------------------------------------------------------------
+
+enum WINDOW_TYPE
+{
+    WINDOW_RECT = 0,
+    WINDOW_TRIANGLE,            /* what Channel::getSpectrum is called with */
+    WINDOW_HANN,
+    WINDOW_BLACKMAN_HARRIS
+};
+
+void makeWindow( WINDOW_TYPE type, float* table, unsigned size );
+
+/**
+ * A process-wide, read-only window table, built on first request.
+ */
+std::shared_ptr< const std::vector< float > > sharedWindow( WINDOW_TYPE type, unsigned size );
+
+/**
+ * Short-time Fourier transform over raw mono PCM.
+ *
+ * Samples are pushed in any sized pieces; every time a full frame is buffered,
+ * nextFrame() windows it, transforms it and slides forward by the hop. All memory
+ * is allocated up front so the per-frame path never allocates. The FFT plan and
+ * window table are shared with every other Stft of the same size.
+ *
+ *     while( count > 0 )
+ *     {
+ *         unsigned used = stft.push( samples, count );
+ *         samples += used;
+ *         count   -= used;
+ *
+ *         while( stft.nextFrame( spectrum ) )
+ *             ...
+ *     }
+ */
+class Stft
+{
+public:
+
+    Stft( unsigned frame_size, unsigned hop_size, WINDOW_TYPE window = WINDOW_HANN, FFT_KERNEL kernel = FFT_KERNEL_AUTO );
+
+    unsigned frameSize( ) const { return plan->size( ); }
+    unsigned hopSize( ) const   { return hop; }
+    unsigned bins( ) const      { return plan->bins( ); }
+
+    const FftPlan& fft( ) const { return *plan; }
+
+    /**
+     * Buffers up to a frame's worth of samples, returns how many were taken.
+     */
+    unsigned push( const float* samples, unsigned count );
+
+    /**
+     * Writes bins() magnitudes for the next complete frame. False if none is ready.
+     */
+    bool nextFrame( float* magnitudes );
+
+    /**
+     * Magnitudes of one frameSize() block, independent of the pushed stream.
+     */
+    void analyse( const float* frame, float* magnitudes );
+
+    void reset( );
+
+private:
+
+    std::shared_ptr< const FftPlan >              plan;
+    std::shared_ptr< const std::vector< float > > window;
+
+    unsigned hop;
+    unsigned fill;
+    float    scale;
+
+    std::vector< float > fifo;
+    std::vector< float > windowed;
+    std::vector< float > re;
+    std::vector< float > im;
+    std::vector< float > scratch;
+};
+
+//------------------------------------------------------------------------------------------
+
+#endif // STFT_H
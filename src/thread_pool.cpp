@@ -0,0 +1,103 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+//------------------------------------------------------------------------------------------
+
+ThreadPool::ThreadPool( unsigned threads )
+{
+    task    = 0;
+    count   = 0;
+    next    = 0;
+    job     = 0;
+    active  = 0;
+    running = true;
+
+    if( threads == 0 )
+        threads = std::max( 1u, std::thread::hardware_concurrency( ) );
+
+    for( unsigned i = 1; i < threads; i++ )
+        workers.push_back( std::thread( &ThreadPool::run, this ) );
+}
+
+ThreadPool::~ThreadPool( )
+{
+    {
+        std::lock_guard< std::mutex > guard( lock );
+        running = false;
+    }
+
+    wake.notify_all( );
+
+    for( unsigned i = 0; i < workers.size( ); i++ )
+        workers[ i ].join( );
+}
+
+//------------------------------------------------------------------------------------------
+
+void ThreadPool::parallelFor( unsigned count, const std::function< void( unsigned ) >& task )
+{
+    if( count == 0 )
+        return;
+
+    // Not worth waking anyone for a single item.
+    if( count == 1 || workers.empty( ) )
+    {
+        for( unsigned i = 0; i < count; i++ )
+            task( i );
+
+        return;
+    }
+
+    {
+        std::lock_guard< std::mutex > guard( lock );
+
+        this->task   = &task;
+        this->count  = count;
+        this->next   = 0;
+        this->active = ( unsigned )workers.size( );
+        this->job++;
+    }
+
+    wake.notify_all( );
+
+    work( );
+
+    std::unique_lock< std::mutex > guard( lock );
+    done.wait( guard, [ this ]( ) { return active == 0; } );
+
+    this->task = 0;
+}
+
+void ThreadPool::work( )
+{
+    unsigned i;
+
+    while( ( i = next.fetch_add( 1 ) ) < count )
+        ( *task )( i );
+}
+
+void ThreadPool::run( )
+{
+    unsigned long long seen = 0;
+
+    std::unique_lock< std::mutex > guard( lock );
+
+    while( true )
+    {
+        wake.wait( guard, [ & ]( ) { return job != seen || !running; } );
+
+        if( !running )
+            return;
+
+        seen = job;
+        guard.unlock( );
+
+        work( );
+
+        guard.lock( );
+
+        if( --active == 0 )
+            done.notify_one( );
+    }
+}
@@ -0,0 +1,62 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//------------------------------------------------------------------------------------------
+
+/**
+ * Fixed set of worker threads for fork/join loops.
+ *
+ * parallelFor hands out indices from a shared atomic counter, so uneven items balance
+ * themselves, and the calling thread works through indices too instead of idling.
+ * One loop runs at a time; parallelFor is not meant to be called concurrently.
+ */
+class ThreadPool
+{
+public:
+
+    /**
+     * 'threads' in total including the caller; 0 uses every hardware thread.
+     */
+    explicit ThreadPool( unsigned threads = 0 );
+    ~ThreadPool( );
+
+    unsigned size( ) const { return ( unsigned )workers.size( ) + 1; }
+
+    /**
+     * Runs task( i ) for every i in [0, count) and returns once all have finished.
+     */
+    void parallelFor( unsigned count, const std::function< void( unsigned ) >& task );
+
+private:
+
+    ThreadPool( const ThreadPool& );
+    ThreadPool& operator=( const ThreadPool& );
+
+    void run( );
+    void work( );
+
+    std::vector< std::thread > workers;
+
+    std::mutex              lock;
+    std::condition_variable wake;
+    std::condition_variable done;
+
+    const std::function< void( unsigned ) >* task;
+    unsigned                                 count;
+    std::atomic< unsigned >                  next;
+
+    unsigned long long job;         /* bumped for every parallelFor */
+    unsigned           active;      /* workers still inside the current job */
+    bool               running;
+};
+
+//------------------------------------------------------------------------------------------
+
+#endif // THREAD_POOL_H
@@ -0,0 +1,153 @@
+#include "trace.h"
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <atomic>
+
+//------------------------------------------------------------------------------------------
+
+typedef std::chrono::steady_clock Clock;
+
+struct TraceBuffer
+{
+    unsigned                thread;
+    std::atomic< uint64_t > count;          /* total events ever written */
+    TraceEvent              events[ TRACE_RING_EVENTS ];
+};
+
+static const Clock::time_point     epoch = Clock::now( );
+
+static std::mutex                  registryLock;
+static std::vector< TraceBuffer* > registry;    /* never freed, threads may exit before a dump */
+
+static thread_local TraceBuffer*   local = 0;
+
+static TraceBuffer* localBuffer( )
+{
+    if( local == 0 )
+    {
+        TraceBuffer* buffer = new TraceBuffer( );
+
+        std::lock_guard< std::mutex > guard( registryLock );
+
+        buffer->thread = ( unsigned )registry.size( ) + 1;
+        buffer->count  = 0;
+        registry.push_back( buffer );
+
+        local = buffer;
+    }
+
+    return local;
+}
+
+//------------------------------------------------------------------------------------------
+
+uint64_t traceNow( )
+{
+    return ( uint64_t )std::chrono::duration_cast< std::chrono::nanoseconds >( Clock::now( ) - epoch ).count( );
+}
+
+void traceRecord( const char* name, uint64_t begin, uint64_t duration )
+{
+    TraceBuffer* buffer = localBuffer( );
+    uint64_t     index  = buffer->count.load( std::memory_order_relaxed );
+    TraceEvent&  event  = buffer->events[ index % TRACE_RING_EVENTS ];
+
+    event.name     = name;
+    event.begin    = begin;
+    event.duration = duration;
+
+    buffer->count.store( index + 1, std::memory_order_release );
+}
+
+//------------------------------------------------------------------------------------------
+
+/**
+ * Calls 'visit' for every retained event of every thread, oldest first per thread.
+ * Meant for when tracing threads are quiet; an event being overwritten during the
+ * walk may come out torn.
+ */
+template< typename VISIT >
+static void forEachEvent( VISIT visit )
+{
+    std::lock_guard< std::mutex > guard( registryLock );
+
+    for( unsigned b = 0; b < registry.size( ); b++ )
+    {
+        TraceBuffer* buffer = registry[ b ];
+        uint64_t     count  = buffer->count.load( std::memory_order_acquire );
+        uint64_t     first  = ( count > TRACE_RING_EVENTS ? count - TRACE_RING_EVENTS : 0 );
+
+        for( uint64_t i = first; i < count; i++ )
+            visit( buffer->thread, buffer->events[ i % TRACE_RING_EVENTS ] );
+    }
+}
+
+bool traceDumpChrome( const char* file_name )
+{
+    FILE* fp = fopen( file_name, "w" );
+
+    if( fp == 0 )
+        return false;
+
+    bool first = true;
+
+    fputs( "{\"traceEvents\":[\n", fp );
+
+    forEachEvent( [ & ]( unsigned thread, const TraceEvent& event )
+    {
+        if( event.duration == 0 )
+            fprintf( fp, "%s{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":1,\"tid\":%u}",
+                     ( first ? "" : ",\n" ), event.name, event.begin / 1000.0, thread );
+        else
+            fprintf( fp, "%s{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u}",
+                     ( first ? "" : ",\n" ), event.name, event.begin / 1000.0, event.duration / 1000.0, thread );
+
+        first = false;
+    } );
+
+    fputs( "\n],\"displayTimeUnit\":\"ns\"}\n", fp );
+
+    return fclose( fp ) == 0;
+}
+
+void traceSummary( FILE* fp )
+{
+    struct Stats
+    {
+        uint64_t count;
+        uint64_t total;
+        uint64_t worst;
+    };
+
+    std::map< std::string, Stats > stats;
+
+    forEachEvent( [ & ]( unsigned, const TraceEvent& event )
+    {
+        Stats& s = stats[ event.name ];
+
+        s.count++;
+        s.total += event.duration;
+
+        if( event.duration > s.worst )
+            s.worst = event.duration;
+    } );
+
+    fprintf( fp, "%-24s %10s %12s %12s\n", "stage", "count", "mean us", "max us" );
+
+    for( std::map< std::string, Stats >::const_iterator i = stats.begin( ); i != stats.end( ); ++i )
+    {
+        fprintf( fp, "%-24s %10llu %12.2f %12.2f\n", i->first.c_str( ), ( unsigned long long )i->second.count,
+                 i->second.total / 1000.0 / ( double )i->second.count, i->second.worst / 1000.0 );
+    }
+}
+
+void traceClear( )
+{
+    std::lock_guard< std::mutex > guard( registryLock );
+
+    for( unsigned b = 0; b < registry.size( ); b++ )
+        registry[ b ]->count = 0;
+}
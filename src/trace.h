@@ -0,0 +1,90 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <chrono>
+#include <cstdio>
+#include <stdint.h>
+
+//------------------------------------------------------------------------------------------
+// Hot-path tracing.
+//
+// Trace points record into a fixed-size ring owned by the calling thread (allocated
+// the first time that thread traces, never afterwards), so tracing costs two clock
+// reads and a store - no locks, allocation or console I/O. Points above TRACE_LEVEL
+// compile to nothing:
+//
+//     DEFINES += TRACE_LEVEL=3        # everything, including per-stage timings
+//     DEFINES += TRACE_LEVEL=0        # tracing compiled out
+//
+// traceDumpChrome( ) writes every thread's ring as Chrome trace JSON (load it in
+// chrome://tracing or Perfetto); traceSummary( ) prints per-name counts and times.
+
+#define TRACE_LEVEL_NONE   0
+#define TRACE_LEVEL_ERROR  1
+#define TRACE_LEVEL_INFO   2
+#define TRACE_LEVEL_DEBUG  3      /* per-stage timings inside the analysis hot path */
+
+#ifndef TRACE_LEVEL
+    #define TRACE_LEVEL TRACE_LEVEL_INFO
+#endif
+
+#define TRACE_RING_EVENTS  16384  /* per thread, oldest overwritten first */
+
+//------------------------------------------------------------------------------------------
+
+struct TraceEvent
+{
+    const char* name;       /* must be a string literal / static string */
+    uint64_t    begin;      /* ns since the trace epoch */
+    uint64_t    duration;   /* ns, 0 for instant events */
+};
+
+uint64_t traceNow( );
+void     traceRecord( const char* name, uint64_t begin, uint64_t duration );
+
+bool     traceDumpChrome( const char* file_name );
+void     traceSummary( FILE* fp );
+void     traceClear( );
+
+template< bool ENABLED >
+class TraceScope
+{
+public:
+
+    explicit TraceScope( const char* name_ ) : name( name_ ), begin( traceNow( ) ) { }
+    ~TraceScope( ) { traceRecord( name, begin, traceNow( ) - begin ); }
+
+private:
+
+    const char* name;
+    uint64_t    begin;
+};
+
+template< >
+class TraceScope< false >
+{
+public:
+
+    explicit TraceScope( const char* ) { }
+};
+
+//------------------------------------------------------------------------------------------
+
+#define TRACE_CONCAT_( a, b ) a##b
+#define TRACE_CONCAT( a, b )  TRACE_CONCAT_( a, b )
+
+/**
+ * Times the rest of the enclosing block.
+ */
+#define TRACE_SCOPE( level, name ) \
+    TraceScope< ( level ) <= TRACE_LEVEL > TRACE_CONCAT( traceScope_, __COUNTER__ )( name )
+
+/**
+ * Records a zero-length marker.
+ */
+#define TRACE_INSTANT( level, name ) \
+    do { if( ( level ) <= TRACE_LEVEL ) traceRecord( name, traceNow( ), 0 ); } while( 0 )
+
+//------------------------------------------------------------------------------------------
+
+#endif // TRACE_H
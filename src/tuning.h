@@ -0,0 +1,254 @@
+#ifndef TUNING_H
+#define TUNING_H
+
+#include <cstring>
+#include <stdint.h>
+
+//------------------------------------------------------------------------------------------
+// Note/frequency tables generated at compile time.
+//
+// A TuningTable is fixed by its A4 reference (in milli-Hz, since templates cannot take
+// floats) and a temperament, which gives the ratio of each pitch class to the C below
+// it. Frequencies, their log2 and the "C#4" style names for the 120 notes C0..B9 are
+// all constexpr, and nearest() is a closed-form log2 lookup instead of a table scan.
+//
+// The default table used by fmod_resources can be re-pitched from the .pro file:
+//     DEFINES += TUNING_A4_MILLIHZ=442000
+
+#ifndef TUNING_A4_MILLIHZ
+    #define TUNING_A4_MILLIHZ 440000
+#endif
+
+#define TUNING_NOTES 120
+#define TUNING_A4    57          /* index of A4 in C0..B9 */
+
+//------------------------------------------------------------------------------------------
+
+constexpr double ctExp2( double x )
+{
+    int whole = ( int )x;
+
+    if( ( double )whole > x )
+        whole--;
+
+    double y    = ( x - whole ) * 0.69314718055994530942;
+    double term = 1.0;
+    double sum  = 1.0;
+
+    for( int i = 1; i < 30; i++ )
+    {
+        term *= y / i;
+        sum  += term;
+    }
+
+    for( ; whole > 0; whole-- )
+        sum *= 2.0;
+
+    for( ; whole < 0; whole++ )
+        sum *= 0.5;
+
+    return sum;
+}
+
+constexpr double ctLog2( double x )
+{
+    int exponent = 0;
+
+    while( x >= 1.4142135623730951 )
+    {
+        x *= 0.5;
+        exponent++;
+    }
+
+    while( x < 0.7071067811865476 )
+    {
+        x *= 2.0;
+        exponent--;
+    }
+
+    // log2( x ) = 2 atanh( t ) / ln 2, t = ( x - 1 ) / ( x + 1 )
+    double t   = ( x - 1.0 ) / ( x + 1.0 );
+    double t2  = t * t;
+    double sum = 0.0;
+    double pow = t;
+
+    for( int i = 1; i < 40; i += 2 )
+    {
+        sum += pow / i;
+        pow *= t2;
+    }
+
+    return exponent + sum * 2.0 / 0.69314718055994530942;
+}
+
+/**
+ * log2 for the per-frame path: exponent bits plus a short atanh series on the
+ * mantissa, about 1e-7 octaves (1e-4 cents) from the real thing. Branch-free apart
+ * from the mantissa fold, so loops over it vectorise.
+ */
+inline float fastLog2( float x )
+{
+    uint32_t bits;
+    memcpy( &bits, &x, sizeof( bits ) );
+
+    int exponent = ( int )( ( bits >> 23 ) & 0xff ) - 127;
+
+    bits = ( bits & 0x007fffff ) | 0x3f800000;
+
+    float m;
+    memcpy( &m, &bits, sizeof( m ) );
+
+    if( m > 1.41421356f )
+    {
+        m *= 0.5f;
+        exponent++;
+    }
+
+    float t  = ( m - 1.0f ) / ( m + 1.0f );
+    float t2 = t * t;
+
+    return ( float )exponent + t * ( 2.88539008f + t2 * ( 0.96179669f + t2 * ( 0.57707802f + t2 * 0.41219858f ) ) );
+}
+
+//------------------------------------------------------------------------------------------
+
+struct EqualTemperament
+{
+    static constexpr double ratio( int pitch_class ) { return ctExp2( pitch_class / 12.0 ); }
+};
+
+/**
+ * 5-limit just intonation on C.
+ */
+struct JustIntonation
+{
+    static constexpr double ratio( int pitch_class )
+    {
+        const double ratios[ 12 ] = { 1.0, 16.0 / 15.0, 9.0 / 8.0, 6.0 / 5.0, 5.0 / 4.0, 4.0 / 3.0,
+                                      45.0 / 32.0, 3.0 / 2.0, 8.0 / 5.0, 5.0 / 3.0, 9.0 / 5.0, 15.0 / 8.0 };
+        return ratios[ pitch_class ];
+    }
+};
+
+//------------------------------------------------------------------------------------------
+
+struct NoteMatch
+{
+    int   index;      /* 0..TUNING_NOTES-1, or -1 for hz <= 0 */
+    float hz;         /* frequency of that note */
+    float cents;      /* offset of the input from it, -50..50 inside the table */
+};
+
+template< unsigned A4_MILLIHZ = TUNING_A4_MILLIHZ, class TEMPERAMENT = EqualTemperament >
+struct TuningTable
+{
+    struct Tables
+    {
+        float hz[ TUNING_NOTES ];
+        float log2hz[ TUNING_NOTES ];
+        char  name[ TUNING_NOTES ][ 4 ];
+    };
+
+    static constexpr double a4( ) { return A4_MILLIHZ / 1000.0; }
+
+    static constexpr double frequency( int note )
+    {
+        return a4( ) * TEMPERAMENT::ratio( note % 12 ) / TEMPERAMENT::ratio( TUNING_A4 % 12 ) * ctExp2( note / 12 - TUNING_A4 / 12 );
+    }
+
+    static constexpr Tables build( )
+    {
+        const char letters[ 12 ][ 2 ] = { { 'C', ' ' }, { 'C', '#' }, { 'D', ' ' }, { 'D', '#' }, { 'E', ' ' }, { 'F', ' ' },
+                                          { 'F', '#' }, { 'G', ' ' }, { 'G', '#' }, { 'A', ' ' }, { 'A', '#' }, { 'B', ' ' } };
+        Tables t = { };
+
+        for( int i = 0; i < TUNING_NOTES; i++ )
+        {
+            t.hz[ i ]      = ( float )frequency( i );
+            t.log2hz[ i ]  = ( float )ctLog2( frequency( i ) );
+            t.name[ i ][ 0 ] = letters[ i % 12 ][ 0 ];
+            t.name[ i ][ 1 ] = letters[ i % 12 ][ 1 ];
+            t.name[ i ][ 2 ] = ( char )( '0' + i / 12 );
+            t.name[ i ][ 3 ] = 0;
+        }
+
+        return t;
+    }
+
+    static constexpr Tables tables = build( );
+
+    static const char* name( int note ) { return tables.name[ note ]; }
+
+    /**
+     * Nearest note and cents offset in O(1): round the semitone distance from A4,
+     * then let the neighbours compete, which settles uneven temperaments.
+     */
+    static NoteMatch nearest( float hz )
+    {
+        NoteMatch match;
+
+        if( !( hz > 0.0f ) )
+        {
+            match.index = -1;
+            match.hz    = 0.0f;
+            match.cents = 0.0f;
+            return match;
+        }
+
+        float octaves = fastLog2( hz );
+        int   index   = closest( octaves );
+
+        match.index = index;
+        match.hz    = tables.hz[ index ];
+        match.cents = 1200.0f * ( octaves - tables.log2hz[ index ] );
+
+        return match;
+    }
+
+    /**
+     * nearest() over whole arrays; 'index' and 'cents' may be null if not wanted.
+     */
+    static void nearest( const float* hz, unsigned count, int* index, float* cents )
+    {
+        for( unsigned i = 0; i < count; i++ )
+        {
+            float octaves = fastLog2( hz[ i ] );
+            int   note    = ( hz[ i ] > 0.0f ? closest( octaves ) : -1 );
+
+            if( index != 0 )
+                index[ i ] = note;
+
+            if( cents != 0 )
+                cents[ i ] = ( note < 0 ? 0.0f : 1200.0f * ( octaves - tables.log2hz[ note ] ) );
+        }
+    }
+
+private:
+
+    static int closest( float octaves )
+    {
+        float semitones = 12.0f * ( octaves - tables.log2hz[ TUNING_A4 ] ) + ( float )TUNING_A4;
+        int   index     = ( int )( semitones + 0.5f ) - ( semitones < -0.5f ? 1 : 0 );
+
+        if( index < 0 )
+            index = 0;
+        else if( index > TUNING_NOTES - 1 )
+            index = TUNING_NOTES - 1;
+
+        if( index > 0 && octaves - tables.log2hz[ index - 1 ] < tables.log2hz[ index ] - octaves )
+            index--;
+        else if( index < TUNING_NOTES - 1 && tables.log2hz[ index + 1 ] - octaves < octaves - tables.log2hz[ index ] )
+            index++;
+
+        return index;
+    }
+};
+
+template< unsigned A4_MILLIHZ, class TEMPERAMENT >
+constexpr typename TuningTable< A4_MILLIHZ, TEMPERAMENT >::Tables TuningTable< A4_MILLIHZ, TEMPERAMENT >::tables;
+
+typedef TuningTable< > Tuning;
+
+//------------------------------------------------------------------------------------------
+
+#endif // TUNING_H
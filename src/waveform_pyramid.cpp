@@ -0,0 +1,188 @@
+#include "waveform_pyramid.h"
+
+#include <algorithm>
+#include <cmath>
+
+//------------------------------------------------------------------------------------------
+
+WaveformPyramid::WaveformPyramid( )
+{
+    clear( );
+}
+
+void WaveformPyramid::clear( )
+{
+    for( unsigned i = 0; i < PYRAMID_LEVELS; i++ )
+    {
+        levels[ i ].clear( );
+        pendingCount[ i ] = 0;
+    }
+
+    total = 0;
+}
+
+//------------------------------------------------------------------------------------------
+
+void WaveformPyramid::append( const float* samples, unsigned count )
+{
+    WaveformBucket& acc = pending[ 0 ];     /* meanSquare holds the running sum of squares */
+
+    for( unsigned i = 0; i < count; )
+    {
+        unsigned take = std::min( count - i, PYRAMID_BASE - pendingCount[ 0 ] );
+
+        if( pendingCount[ 0 ] == 0 )
+        {
+            acc.min        = samples[ i ];
+            acc.max        = samples[ i ];
+            acc.meanSquare = 0;
+        }
+
+        float lo  = acc.min;
+        float hi  = acc.max;
+        float sum = acc.meanSquare;
+
+        for( unsigned j = i; j < i + take; j++ )
+        {
+            float s = samples[ j ];
+
+            lo   = std::min( lo, s );
+            hi   = std::max( hi, s );
+            sum += s * s;
+        }
+
+        acc.min        = lo;
+        acc.max        = hi;
+        acc.meanSquare = sum;
+
+        pendingCount[ 0 ] += take;
+        total             += take;
+        i                 += take;
+
+        if( pendingCount[ 0 ] == PYRAMID_BASE )
+        {
+            WaveformBucket bucket = { lo, hi, sum / PYRAMID_BASE };
+
+            pendingCount[ 0 ] = 0;
+            push( 0, bucket );
+        }
+    }
+}
+
+/**
+ * Stores a completed bucket and folds it into the partial bucket of the level above,
+ * completing that one in turn every PYRAMID_FACTOR buckets.
+ */
+void WaveformPyramid::push( unsigned level, const WaveformBucket& bucket )
+{
+    levels[ level ].push_back( bucket );
+
+    if( ++level == PYRAMID_LEVELS )
+        return;
+
+    WaveformBucket& acc = pending[ level ];
+
+    if( pendingCount[ level ]++ == 0 )
+    {
+        acc = bucket;
+    }
+    else
+    {
+        acc.min         = std::min( acc.min, bucket.min );
+        acc.max         = std::max( acc.max, bucket.max );
+        acc.meanSquare += bucket.meanSquare;
+    }
+
+    if( pendingCount[ level ] == PYRAMID_FACTOR )
+    {
+        WaveformBucket parent = { acc.min, acc.max, acc.meanSquare / PYRAMID_FACTOR };
+
+        pendingCount[ level ] = 0;
+        push( level, parent );
+    }
+}
+
+//------------------------------------------------------------------------------------------
+
+void WaveformPyramid::add( Accumulator* acc, const WaveformBucket& bucket, unsigned long long samples )
+{
+    if( acc->count == 0 )
+    {
+        acc->min = bucket.min;
+        acc->max = bucket.max;
+    }
+    else
+    {
+        acc->min = std::min( acc->min, bucket.min );
+        acc->max = std::max( acc->max, bucket.max );
+    }
+
+    acc->sumSquares += ( double )bucket.meanSquare * samples;
+    acc->count      += samples;
+}
+
+/**
+ * Adds every complete bucket of 'level' that overlaps [start, end) to 'acc'. The part of
+ * the range past the last complete bucket (the tail of a take still being recorded) is
+ * taken from the level below, down to the partial level 0 bucket.
+ */
+void WaveformPyramid::gather( unsigned level, unsigned long long start, unsigned long long end, Accumulator* acc ) const
+{
+    unsigned long long size     = ( unsigned long long )PYRAMID_BASE << ( 2 * level );
+    unsigned long long complete = levels[ level ].size( );
+    unsigned long long first    = start / size;
+    unsigned long long last     = std::min( ( end + size - 1 ) / size, complete );
+
+    for( unsigned long long i = first; i < last; i++ )
+        add( acc, levels[ level ][ i ], size );
+
+    if( end <= complete * size )
+        return;
+
+    unsigned long long tail = std::max( start, complete * size );
+
+    if( level > 0 )
+    {
+        gather( level - 1, tail, end, acc );
+    }
+    else if( pendingCount[ 0 ] > 0 )
+    {
+        WaveformBucket partial = pending[ 0 ];
+
+        partial.meanSquare /= pendingCount[ 0 ];
+        add( acc, partial, pendingCount[ 0 ] );
+    }
+}
+
+void WaveformPyramid::query( double first, double samples_per_column, unsigned columns, WaveformBucket* out ) const
+{
+    for( unsigned c = 0; c < columns; c++ )
+    {
+        double start = std::max( 0.0, first + c * samples_per_column );
+        double end   = std::min( ( double )total, first + ( c + 1 ) * samples_per_column );
+
+        out[ c ].min        = 0;
+        out[ c ].max        = 0;
+        out[ c ].meanSquare = 0;
+
+        if( end <= start )
+            continue;
+
+        // Coarsest level whose buckets still fit inside the column.
+        unsigned level = 0;
+
+        while( level + 1 < PYRAMID_LEVELS && ( double )( ( unsigned long long )PYRAMID_BASE << ( 2 * ( level + 1 ) ) ) <= end - start )
+            level++;
+
+        Accumulator acc = { 0, 0, 0, 0 };
+
+        gather( level, ( unsigned long long )start, ( unsigned long long )ceil( end ), &acc );
+
+        if( acc.count > 0 )
+        {
+            out[ c ].min        = acc.min;
+            out[ c ].max        = acc.max;
+            out[ c ].meanSquare = ( float )( acc.sumSquares / acc.count );
+        }
+    }
+}
@@ -0,0 +1,74 @@
+#ifndef WAVEFORM_PYRAMID_H
+#define WAVEFORM_PYRAMID_H
+
+#include <vector>
+
+//------------------------------------------------------------------------------------------
+
+#define PYRAMID_BASE      64        /* samples per level 0 bucket */
+#define PYRAMID_FACTOR    4         /* buckets of one level per bucket of the next */
+#define PYRAMID_LEVELS    12        /* enough for 64 * 4^11 samples, ~67 days at 48 kHz */
+
+struct WaveformBucket
+{
+    float min;
+    float max;
+    float meanSquare;       /* sqrt for RMS */
+};
+
+/**
+ * Min/max/RMS mipmap of a mono signal, built incrementally as samples arrive.
+ *
+ * Level 0 summarises PYRAMID_BASE samples per bucket and every level above it has a
+ * quarter of the buckets of the one below, so the whole pyramid is about 4/3 of level 0
+ * (12 bytes per 64 samples; ~45 MB for an hour at 48 kHz). append() is amortised O(1)
+ * per sample. query() picks, per output column, the coarsest level whose buckets are no
+ * wider than the column, so it reads a handful of buckets per column at any zoom: drawing
+ * is O(columns) whether the view spans a second or the whole take. Spans narrower than
+ * PYRAMID_BASE are served from level 0; a view that zooms further needs the raw samples.
+ *
+ * Not thread safe; append and query from the same thread.
+ */
+class WaveformPyramid
+{
+public:
+
+    WaveformPyramid( );
+
+    void append( const float* samples, unsigned count );
+    void clear( );
+
+    unsigned long long frames( ) const { return total; }
+
+    /**
+     * Summarises 'columns' consecutive spans of 'samples_per_column' samples, the first
+     * starting at sample 'first'. Columns wholly outside [0, frames()) come back as zero.
+     */
+    void query( double first, double samples_per_column, unsigned columns, WaveformBucket* out ) const;
+
+private:
+
+    struct Accumulator
+    {
+        float    min;
+        float    max;
+        double   sumSquares;        /* of samples, weighted by count */
+        unsigned long long count;   /* samples covered */
+    };
+
+    void push( unsigned level, const WaveformBucket& bucket );
+    void gather( unsigned level, unsigned long long start, unsigned long long end, Accumulator* acc ) const;
+
+    static void add( Accumulator* acc, const WaveformBucket& bucket, unsigned long long samples );
+
+    std::vector< WaveformBucket > levels[ PYRAMID_LEVELS ];
+
+    WaveformBucket pending[ PYRAMID_LEVELS ];     /* partial bucket of each level */
+    unsigned       pendingCount[ PYRAMID_LEVELS ];    /* samples (level 0) or children in it */
+
+    unsigned long long total;
+};
+
+//------------------------------------------------------------------------------------------
+
+#endif // WAVEFORM_PYRAMID_H
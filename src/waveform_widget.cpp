@@ -0,0 +1,218 @@
+#include "waveform_widget.h"
+
+#include <QPainter>
+#include <QWheelEvent>
+#include <QMouseEvent>
+
+#include <algorithm>
+#include <cmath>
+
+//------------------------------------------------------------------------------------------
+
+WaveformWidget::WaveformWidget( QWidget* parent )
+    : QWidget( parent )
+{
+    pyramid         = 0;
+    first           = 0;
+    samplesPerPixel = PYRAMID_BASE;
+    following       = true;
+    playhead        = -1;
+    dragX           = 0;
+    dragFirst       = 0;
+
+    setAttribute( Qt::WA_OpaquePaintEvent );
+}
+
+void WaveformWidget::setPyramid( const WaveformPyramid* pyramid_ )
+{
+    pyramid = pyramid_;
+    fit( );
+}
+
+void WaveformWidget::setSampleSource( SampleSource source_ )
+{
+    source = source_;
+    update( );
+}
+
+void WaveformWidget::dataChanged( )
+{
+    if( following )
+        fit( );
+    else
+        update( );
+}
+
+void WaveformWidget::setPlayhead( double frame )
+{
+    playhead = frame;
+    update( );
+}
+
+//------------------------------------------------------------------------------------------
+
+void WaveformWidget::fit( )
+{
+    unsigned long long frames = ( pyramid != 0 ? pyramid->frames( ) : 0 );
+
+    first           = 0;
+    samplesPerPixel = std::max( 1.0, ( double )frames / std::max( 1, width( ) ) );
+    following       = true;
+
+    update( );
+}
+
+/**
+ * Keeps at least one sample per pixel and the view inside the take.
+ */
+void WaveformWidget::clampView( )
+{
+    double frames = ( pyramid != 0 ? ( double )pyramid->frames( ) : 0.0 );
+    double span   = frames / std::max( 1, width( ) );
+
+    samplesPerPixel = std::max( 1.0, std::min( samplesPerPixel, std::max( 1.0, span ) ) );
+    first           = std::max( 0.0, std::min( first, frames - samplesPerPixel * width( ) ) );
+    following       = ( samplesPerPixel >= span );
+}
+
+//------------------------------------------------------------------------------------------
+
+/**
+ * One bucket per pixel column: from the pyramid, or from raw samples when zoomed in
+ * past level 0 and a source is available.
+ */
+void WaveformWidget::readColumns( )
+{
+    int w = width( );
+
+    columns.resize( w );
+
+    if( samplesPerPixel >= PYRAMID_BASE || !source )
+    {
+        pyramid->query( first, samplesPerPixel, w, &columns[ 0 ] );
+        return;
+    }
+
+    unsigned long long start = ( unsigned long long )first;
+    unsigned           count = ( unsigned )ceil( samplesPerPixel * w ) + 1;
+
+    raw.resize( count );
+    count = source( start, count, &raw[ 0 ] );
+
+    // The samples are gone (a streamed take, or the sound was released).
+    if( count == 0 )
+    {
+        pyramid->query( first, samplesPerPixel, w, &columns[ 0 ] );
+        return;
+    }
+
+    for( int x = 0; x < w; x++ )
+    {
+        unsigned a = ( unsigned )( first + x * samplesPerPixel - start );
+        unsigned b = std::min( count, ( unsigned )ceil( first + ( x + 1 ) * samplesPerPixel - start ) );
+
+        WaveformBucket& c = columns[ x ];
+
+        c.min        = 0;
+        c.max        = 0;
+        c.meanSquare = 0;
+
+        if( a >= b )
+            continue;
+
+        c.min = c.max = raw[ a ];
+
+        for( unsigned i = a; i < b; i++ )
+        {
+            c.min         = std::min( c.min, raw[ i ] );
+            c.max         = std::max( c.max, raw[ i ] );
+            c.meanSquare += raw[ i ] * raw[ i ];
+        }
+
+        c.meanSquare /= ( b - a );
+    }
+}
+
+void WaveformWidget::paintEvent( QPaintEvent* )
+{
+    QPainter painter( this );
+
+    painter.fillRect( rect( ), QColor( 0x22, 0x22, 0x22 ) );
+
+    if( pyramid == 0 || pyramid->frames( ) == 0 )
+        return;
+
+    readColumns( );
+
+    float  mid   = height( ) / 2.0f;
+    QColor peak( 0x4a, 0x90, 0xd9 );
+    QColor rms( 0xa8, 0xd0, 0xf8 );
+
+    painter.setPen( QColor( 0x55, 0x55, 0x55 ) );
+    painter.drawLine( 0, ( int )mid, width( ), ( int )mid );
+
+    for( int x = 0; x < ( int )columns.size( ); x++ )
+    {
+        const WaveformBucket& c = columns[ x ];
+        float                 r = sqrtf( c.meanSquare );
+
+        painter.setPen( peak );
+        painter.drawLine( x, ( int )( mid - c.max * mid ), x, ( int )( mid - c.min * mid ) );
+
+        painter.setPen( rms );
+        painter.drawLine( x, ( int )( mid - r * mid ), x, ( int )( mid + r * mid ) );
+    }
+
+    if( playhead >= first && playhead < first + samplesPerPixel * width( ) )
+    {
+        int x = ( int )( ( playhead - first ) / samplesPerPixel );
+
+        painter.setPen( Qt::red );
+        painter.drawLine( x, 0, x, height( ) );
+    }
+}
+
+void WaveformWidget::resizeEvent( QResizeEvent* )
+{
+    if( following )
+        fit( );
+    else
+        clampView( );
+}
+
+//------------------------------------------------------------------------------------------
+
+void WaveformWidget::wheelEvent( QWheelEvent* event )
+{
+    double anchor = first + event->x( ) * samplesPerPixel;
+
+    samplesPerPixel *= ( event->delta( ) > 0 ? 0.8 : 1.25 );
+    clampView( );
+
+    first = anchor - event->x( ) * samplesPerPixel;
+    clampView( );
+
+    update( );
+    event->accept( );
+}
+
+void WaveformWidget::mousePressEvent( QMouseEvent* event )
+{
+    dragX     = event->x( );
+    dragFirst = first;
+}
+
+void WaveformWidget::mouseMoveEvent( QMouseEvent* event )
+{
+    if( !( event->buttons( ) & Qt::LeftButton ) )
+        return;
+
+    first = dragFirst - ( event->x( ) - dragX ) * samplesPerPixel;
+    clampView( );
+    update( );
+}
+
+void WaveformWidget::mouseDoubleClickEvent( QMouseEvent* )
+{
+    fit( );
+}
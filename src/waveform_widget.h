@@ -0,0 +1,85 @@
+#ifndef WAVEFORM_WIDGET_H
+#define WAVEFORM_WIDGET_H
+
+//------------------------------------------------------------------------------------------
+
+#include <QWidget>
+
+#include "waveform_pyramid.h"
+
+#include <functional>
+#include <vector>
+
+//------------------------------------------------------------------------------------------
+
+/**
+ * Zoomable min/max/RMS view of a WaveformPyramid.
+ *
+ * Every repaint asks the pyramid for one bucket per pixel column, so it costs the same
+ * at any zoom and any take length. Closer in than PYRAMID_BASE samples per pixel it
+ * reads the visible samples through the SampleSource instead, if one is set; that is
+ * still bounded by PYRAMID_BASE samples per column.
+ *
+ * Wheel zooms about the cursor, drag pans, double click fits the whole take. Until
+ * the user zooms, the view follows the take as it grows.
+ */
+class WaveformWidget : public QWidget
+{
+    Q_OBJECT
+
+public:
+
+    /**
+     * Fills 'mono' with up to 'count' samples from 'first' on; returns how many it wrote.
+     */
+    typedef std::function< unsigned( unsigned long long first, unsigned count, float* mono ) > SampleSource;
+
+    explicit WaveformWidget( QWidget* parent = 0 );
+
+    void setPyramid( const WaveformPyramid* pyramid );
+    void setSampleSource( SampleSource source );
+
+    /**
+     * Call after appending to the pyramid.
+     */
+    void dataChanged( );
+
+    /**
+     * Marks sample 'frame'; negative hides the marker.
+     */
+    void setPlayhead( double frame );
+
+    void fit( );
+
+protected:
+
+    void paintEvent( QPaintEvent* event );
+    void resizeEvent( QResizeEvent* event );
+    void wheelEvent( QWheelEvent* event );
+    void mousePressEvent( QMouseEvent* event );
+    void mouseMoveEvent( QMouseEvent* event );
+    void mouseDoubleClickEvent( QMouseEvent* event );
+
+private:
+
+    void clampView( );
+    void readColumns( );
+
+    const WaveformPyramid* pyramid;
+    SampleSource           source;
+
+    double first;               /* sample at the left edge */
+    double samplesPerPixel;
+    bool   following;           /* refit as the take grows */
+    double playhead;
+
+    int    dragX;
+    double dragFirst;
+
+    std::vector< WaveformBucket > columns;
+    std::vector< float >          raw;
+};
+
+//------------------------------------------------------------------------------------------
+
+#endif // WAVEFORM_WIDGET_H